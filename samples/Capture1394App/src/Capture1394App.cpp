@@ -82,10 +82,17 @@ void Capture1394App::setup()
 		{
 			console() << *it << endl;
 		}
+		// choose the fastest mode of at least 640x480
+		Capture1394::VideoModeConstraints constraints;
+		constraints.mMinResolution = Vec2i( 640, 480 );
 		Capture1394::Options options;
-		options.videoMode( videoModes[ 10 ] );
+		options.videoModeConstraints( constraints );
 		//options.setVideoMode( videoModes[ 0 ] );
 		mCapture1394 = Capture1394::create( options );
+		console() << "Selected video mode: " << mCapture1394->getVideoMode() << endl;
+		const int speeds[] = { 100, 200, 400, 800, 1600, 3200 };
+		console() << "Iso speed: S" << speeds[ mCapture1394->getIsoSpeed() - DC1394_ISO_SPEED_MIN ] <<
+			( mCapture1394->getOperationMode() == DC1394_OPERATION_MODE_1394B ? " 1394B" : " legacy" ) << endl;
 		mCapture1394->start();
 	}
 	catch ( const Capture1394Exc &exc )
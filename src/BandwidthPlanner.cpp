@@ -0,0 +1,273 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "BandwidthPlanner.h"
+
+using namespace std;
+
+namespace mndl {
+
+//! Isochronous cycles per second.
+static const float kCyclesPerSecond = 8000.f;
+
+static bool isFormat7( dc1394video_mode_t videoMode )
+{
+	return ( DC1394_VIDEO_MODE_FORMAT7_MIN <= videoMode ) && ( videoMode <= DC1394_VIDEO_MODE_FORMAT7_MAX );
+}
+
+uint32_t BandwidthPlanner::getBandwidthUnits( uint32_t packetBytes, dc1394speed_t speed )
+{
+	// payload and the isochronous header and trailer in quadlets, scaled to the S1600 units of the IRM
+	uint32_t quadlets = ( packetBytes + 3 ) / 4 + 3;
+	if ( speed >= DC1394_ISO_SPEED_1600 )
+		return quadlets >> ( speed - DC1394_ISO_SPEED_1600 );
+	else
+		return quadlets << ( DC1394_ISO_SPEED_1600 - speed );
+}
+
+uint32_t BandwidthPlanner::getMaxPacketBytes( dc1394speed_t speed )
+{
+	return 1024 << ( speed - DC1394_ISO_SPEED_100 );
+}
+
+float BandwidthPlanner::getFormat7FrameRate( uint64_t frameBytes, uint32_t packetBytes )
+{
+	if ( ( frameBytes == 0 ) || ( packetBytes == 0 ) )
+		return 0.f;
+	uint64_t packets = ( frameBytes + packetBytes - 1 ) / packetBytes;
+	return kCyclesPerSecond / packets;
+}
+
+uint32_t BandwidthPlanner::getFormat7PacketBytes( uint64_t frameBytes, uint32_t unitBytes, uint32_t maxBytes, float frameRate )
+{
+	if ( ( unitBytes == 0 ) || ( frameRate <= 0.f ) )
+		return maxBytes;
+
+	// one packet per cycle, so the frame rate limits the packets of a frame
+	uint64_t packets = static_cast< uint64_t >( kCyclesPerSecond / frameRate );
+	if ( packets == 0 )
+		return maxBytes;
+	uint64_t packetBytes = ( frameBytes + packets - 1 ) / packets;
+	packetBytes = std::max< uint64_t >( ( ( packetBytes + unitBytes - 1 ) / unitBytes ) * unitBytes, unitBytes );
+	return static_cast< uint32_t >( std::min< uint64_t >( packetBytes, maxBytes ) );
+}
+
+//! Frame rate of Format7 request \a request with \a packetBytes packets.
+static float getFrameRate( const BandwidthPlanner::Request &request, uint32_t packetBytes )
+{
+	float frameRate = BandwidthPlanner::getFormat7FrameRate( request.mFrameBytes, packetBytes );
+	if ( request.mMaxFrameRate > 0.f )
+		frameRate = std::min( frameRate, request.mMaxFrameRate );
+	return frameRate;
+}
+
+//! Returns the smallest packet size above \a packetBytes that sends the frame in fewer packets, or 0 if there is none.
+static uint32_t getNextPacketBytes( const BandwidthPlanner::Request &request, uint32_t packetBytes, uint32_t maxPacketBytes )
+{
+	uint64_t packets = ( request.mFrameBytes + packetBytes - 1 ) / packetBytes;
+	if ( packets <= 1 )
+		return 0;
+
+	uint64_t next = ( request.mFrameBytes + packets - 2 ) / ( packets - 1 );
+	next = ( ( next + request.mUnitBytes - 1 ) / request.mUnitBytes ) * request.mUnitBytes;
+	if ( next > maxPacketBytes )
+		return 0;
+	return static_cast< uint32_t >( next );
+}
+
+BandwidthPlanner::Plan BandwidthPlanner::plan( const vector< Request > &requests, dc1394speed_t maxSpeed )
+{
+	Plan result;
+	result.mAllocations.resize( requests.size() );
+	vector< uint32_t > maxPacketBytes( requests.size(), 0 );
+
+	// start every Format7 camera at its smallest packet, fixed modes have a fixed load
+	uint32_t units = 0;
+	for ( size_t i = 0; i < requests.size(); i++ )
+	{
+		const Request &request = requests[ i ];
+		Allocation &allocation = result.mAllocations[ i ];
+		allocation.mSpeed = std::min( maxSpeed, request.mMaxSpeed );
+
+		if ( request.mFormat7 )
+		{
+			if ( ( request.mUnitBytes == 0 ) || ( request.mFrameBytes == 0 ) )
+				return result;
+			uint32_t limit = getMaxPacketBytes( allocation.mSpeed );
+			if ( request.mMaxBytes > 0 )
+				limit = std::min( limit, request.mMaxBytes );
+			limit -= limit % request.mUnitBytes;
+			if ( limit == 0 )
+				return result;
+
+			maxPacketBytes[ i ] = limit;
+			allocation.mPacketBytes = request.mUnitBytes;
+			allocation.mFrameRate = getFrameRate( request, allocation.mPacketBytes );
+		}
+		else
+		{
+			double bytesPerCycle = std::ceil( request.mFrameBytes * request.mFrameRate / kCyclesPerSecond );
+			allocation.mPacketBytes = ( ( static_cast< uint32_t >( bytesPerCycle ) + 3 ) / 4 ) * 4;
+			if ( allocation.mPacketBytes > getMaxPacketBytes( allocation.mSpeed ) )
+				return result;
+			allocation.mFrameRate = request.mFrameRate;
+		}
+
+		allocation.mBandwidthUnits = getBandwidthUnits( allocation.mPacketBytes, allocation.mSpeed );
+		units += allocation.mBandwidthUnits;
+	}
+
+	if ( units > kMaxBandwidthUnits )
+		return result;
+
+	// grow the packet of the camera gaining the most frame rate per bandwidth unit until nothing fits
+	for ( ;; )
+	{
+		int best = -1;
+		float bestGain = 0.f;
+		uint32_t bestPacketBytes = 0;
+		uint32_t bestUnits = 0;
+		for ( size_t i = 0; i < requests.size(); i++ )
+		{
+			const Request &request = requests[ i ];
+			const Allocation &allocation = result.mAllocations[ i ];
+			if ( !request.mFormat7 )
+				continue;
+
+			uint32_t packetBytes = getNextPacketBytes( request, allocation.mPacketBytes, maxPacketBytes[ i ] );
+			if ( packetBytes == 0 )
+				continue;
+			float frameRate = getFrameRate( request, packetBytes );
+			if ( frameRate <= allocation.mFrameRate )
+				continue;
+			uint32_t packetUnits = getBandwidthUnits( packetBytes, allocation.mSpeed );
+			if ( units - allocation.mBandwidthUnits + packetUnits > kMaxBandwidthUnits )
+				continue;
+
+			float gain = ( frameRate - allocation.mFrameRate ) /
+						 std::max( packetUnits - allocation.mBandwidthUnits, 1u );
+			if ( gain > bestGain )
+			{
+				best = int( i );
+				bestGain = gain;
+				bestPacketBytes = packetBytes;
+				bestUnits = packetUnits;
+			}
+		}
+
+		if ( best < 0 )
+			break;
+
+		Allocation &allocation = result.mAllocations[ best ];
+		units = units - allocation.mBandwidthUnits + bestUnits;
+		allocation.mPacketBytes = bestPacketBytes;
+		allocation.mBandwidthUnits = bestUnits;
+		allocation.mFrameRate = getFrameRate( requests[ best ], bestPacketBytes );
+	}
+
+	result.mFeasible = true;
+	result.mBandwidthUnits = units;
+	for ( auto it = result.mAllocations.cbegin(); it != result.mAllocations.cend(); ++it )
+		result.mFrameRate += it->mFrameRate;
+	return result;
+}
+
+BandwidthPlanner::Request BandwidthPlanner::createRequest( const Capture1394::DeviceRef &device, const Capture1394::VideoMode &videoMode )
+{
+	Request request;
+	{
+		Capture1394::Device::NativeLock nativeLock = device->lockNative();
+		request.mMaxSpeed = device->getNative()->bmode_capable ? DC1394_ISO_SPEED_800 : DC1394_ISO_SPEED_400;
+	}
+
+	uint32_t bits = 0;
+	dc1394_get_color_coding_bit_size( videoMode.getColorCoding(), &bits );
+	request.mFrameBytes = static_cast< uint64_t >( videoMode.getResolution().x ) * videoMode.getResolution().y * bits / 8;
+
+	if ( isFormat7( videoMode.getVideoMode() ) )
+	{
+		request.mFormat7 = true;
+		const Capture1394::Device::Format7Info *info = device->findFormat7Info( videoMode.getVideoMode() );
+		if ( info )
+		{
+			request.mUnitBytes = info->mUnitBytes;
+			request.mMaxBytes = info->mMaxBytes;
+		}
+		request.mMaxFrameRate = videoMode.getTargetFrameRate();
+	}
+	else
+	{
+		dc1394_framerate_as_float( videoMode.getFrameRate(), &request.mFrameRate );
+	}
+	return request;
+}
+
+void BandwidthPlanner::reserve( const Plan &plan, const vector< Capture1394Ref > &captures )
+{
+	if ( !plan.mFeasible )
+		throw Capture1394Exc( "The requested video modes do not fit the bus bandwidth." );
+	if ( plan.mAllocations.size() != captures.size() )
+		throw Capture1394Exc( "The bandwidth plan does not match the captures." );
+
+	try
+	{
+		for ( size_t i = 0; i < captures.size(); i++ )
+		{
+			const Capture1394Ref &capture = captures[ i ];
+			const Allocation &allocation = plan.mAllocations[ i ];
+
+			capture->setIsoSpeed( allocation.mSpeed );
+			Capture1394::VideoMode videoMode = capture->getVideoMode();
+			if ( isFormat7( videoMode.getVideoMode() ) )
+			{
+				videoMode.setPacketSize( allocation.mPacketBytes );
+				capture->setVideoMode( videoMode );
+			}
+
+			// not held across the calls above, which may stop the capture thread waiting for it in a reconnect
+			Capture1394::Device::NativeLock nativeLock = capture->getDevice()->lockNative();
+			dc1394camera_t *camera = capture->getDevice()->getNative();
+			int channel;
+			Capture1394::checkError( dc1394_iso_allocate_channel( camera, 0, &channel ) );
+			Capture1394::checkError( dc1394_video_set_iso_channel( camera, channel ) );
+			Capture1394::checkError( dc1394_iso_allocate_bandwidth( camera, allocation.mBandwidthUnits ) );
+			capture->setIsoResourcesReserved( true );
+		}
+	}
+	catch ( const Capture1394Exc & )
+	{
+		release( captures );
+		throw;
+	}
+}
+
+void BandwidthPlanner::release( const vector< Capture1394Ref > &captures )
+{
+	for ( auto it = captures.cbegin(); it != captures.cend(); ++it )
+	{
+		{
+			Capture1394::Device::NativeLock nativeLock = ( *it )->getDevice()->lockNative();
+			dc1394_iso_release_all( ( *it )->getDevice()->getNative() );
+		}
+		( *it )->setIsoResourcesReserved( false );
+	}
+}
+
+} // namespace mndl
@@ -0,0 +1,109 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Cinder.h"
+
+#include <dc1394/dc1394.h>
+
+#include "Capture1394.h"
+
+namespace mndl {
+
+/** Plans the isochronous bus load of several cameras sharing a bus. The planning itself does not touch
+ *  the cameras, plan() only works on the requests, so it can be checked without hardware.
+ */
+class BandwidthPlanner
+{
+	public:
+		//! Bandwidth units available in a 125us isochronous cycle.
+		static const uint32_t kMaxBandwidthUnits = 4915;
+
+		//! Bus requirements of a camera.
+		struct Request
+		{
+			Request() : mFormat7( false ), mFrameBytes( 0 ), mFrameRate( 0.f ), mUnitBytes( 0 ), mMaxBytes( 0 ),
+						mMaxFrameRate( 0.f ), mMaxSpeed( DC1394_ISO_SPEED_400 ) {}
+
+			bool mFormat7;
+			//! Image size in bytes.
+			uint64_t mFrameBytes;
+			//! Frame rate of fixed video modes.
+			float mFrameRate;
+			//! Format7 packet size limits in bytes.
+			uint32_t mUnitBytes, mMaxBytes;
+			//! Upper limit of the Format7 frame rate, 0 is unlimited.
+			float mMaxFrameRate;
+			//! Highest isochronous speed supported by the camera.
+			dc1394speed_t mMaxSpeed;
+		};
+
+		//! Planned bus settings of a camera.
+		struct Allocation
+		{
+			Allocation() : mSpeed( DC1394_ISO_SPEED_400 ), mPacketBytes( 0 ), mBandwidthUnits( 0 ), mFrameRate( 0.f ) {}
+
+			dc1394speed_t mSpeed;
+			uint32_t mPacketBytes;
+			uint32_t mBandwidthUnits;
+			float mFrameRate;
+		};
+
+		struct Plan
+		{
+			Plan() : mFeasible( false ), mBandwidthUnits( 0 ), mFrameRate( 0.f ) {}
+
+			//! Whether the requests fit the bus, the allocations are only valid if true.
+			bool mFeasible;
+			//! One allocation per request.
+			std::vector< Allocation > mAllocations;
+			uint32_t mBandwidthUnits;
+			//! Aggregate frame rate of all cameras.
+			float mFrameRate;
+		};
+
+		/** Plans the requests for a bus of speed \a maxSpeed. Every camera runs at the highest speed both support,
+		 *  the Format7 packet sizes are chosen to maximize the aggregate frame rate within the bus bandwidth.
+		 */
+		static Plan plan( const std::vector< Request > &requests, dc1394speed_t maxSpeed = DC1394_ISO_SPEED_3200 );
+
+		//! Returns the request of \a device capturing in \a videoMode.
+		static Request createRequest( const Capture1394::DeviceRef &device, const Capture1394::VideoMode &videoMode );
+
+		/** Applies \a plan to \a captures and allocates their isochronous channels and bandwidth.
+		 *  The captures should be stopped. Throws Capture1394Exc and releases the allocations on failure.
+		 */
+		static void reserve( const Plan &plan, const std::vector< Capture1394Ref > &captures );
+		//! Releases the channels and bandwidth allocated by reserve().
+		static void release( const std::vector< Capture1394Ref > &captures );
+
+		//! Returns the bandwidth units of a packet of \a packetBytes at \a speed.
+		static uint32_t getBandwidthUnits( uint32_t packetBytes, dc1394speed_t speed );
+		//! Returns the largest isochronous packet in bytes at \a speed.
+		static uint32_t getMaxPacketBytes( dc1394speed_t speed );
+		//! Returns the frame rate of a Format7 mode with \a frameBytes images sent in \a packetBytes packets.
+		static float getFormat7FrameRate( uint64_t frameBytes, uint32_t packetBytes );
+		/** Returns the smallest packet size, a multiple of \a unitBytes up to \a maxBytes, that sends \a frameBytes images
+		 *  at \a frameRate, or \a maxBytes if the frame rate cannot be reached.
+		 */
+		static uint32_t getFormat7PacketBytes( uint64_t frameBytes, uint32_t unitBytes, uint32_t maxBytes, float frameRate );
+};
+
+} // namespace mndl
@@ -0,0 +1,154 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "CapabilityCache.h"
+
+using namespace std;
+
+namespace mndl {
+
+static const char *kCacheMagic = "capture1394-capabilities";
+static const int kCacheVersion = 2;
+//! Offset of the V_FORMAT_INQ register relative to the command registers base.
+static const uint64_t kVideoFormatInqOffset = 0x100;
+
+bool CapabilityCache::readSignature( dc1394camera_t *camera, uint32_t *signature )
+{
+	return dc1394_get_control_register( camera, kVideoFormatInqOffset, signature ) == DC1394_SUCCESS;
+}
+
+ci::fs::path CapabilityCache::getPath( uint64_t guid ) const
+{
+	stringstream name;
+	name << hex << setw( 16 ) << setfill( '0' ) << guid << ".cache";
+	return mDirectory / name.str();
+}
+
+bool CapabilityCache::load( const Capture1394::Device *device ) const
+{
+	dc1394camera_t *camera = device->mCamera;
+
+	ifstream in( getPath( camera->guid ).string().c_str() );
+	if ( !in )
+		return false;
+
+	string magic;
+	int version;
+	in >> magic >> version;
+	if ( ( magic != kCacheMagic ) || ( version != kCacheVersion ) )
+		return false;
+
+	uint32_t vendorId, modelId, swVersion, cachedSignature;
+	in >> vendorId >> modelId >> swVersion >> cachedSignature;
+	if ( ( !in ) || ( vendorId != camera->vendor_id ) || ( modelId != camera->model_id ) ||
+		 ( swVersion != camera->unit_sub_sw_version ) )
+		return false;
+
+	uint32_t signature;
+	if ( ( !readSignature( camera, &signature ) ) || ( signature != cachedSignature ) )
+		return false;
+
+	vector< Capture1394::VideoMode > videoModes;
+	size_t num;
+	in >> num;
+	for ( size_t i = 0; in && ( i < num ); i++ )
+	{
+		int width, height, videoMode, coding, frameRate;
+		in >> width >> height >> videoMode >> coding >> frameRate;
+		videoModes.push_back( Capture1394::VideoMode( ci::Vec2i( width, height ), dc1394video_mode_t( videoMode ),
+					dc1394color_coding_t( coding ), dc1394framerate_t( frameRate ) ) );
+	}
+
+	vector< Capture1394::Device::Format7Info > format7Info;
+	in >> num;
+	for ( size_t i = 0; in && ( i < num ); i++ )
+	{
+		Capture1394::Device::Format7Info info;
+		int videoMode;
+		in >> videoMode >> info.mMaxSize.x >> info.mMaxSize.y >> info.mUnitSize.x >> info.mUnitSize.y >>
+			info.mUnitPosition.x >> info.mUnitPosition.y >> info.mUnitBytes >> info.mMaxBytes;
+		info.mVideoMode = dc1394video_mode_t( videoMode );
+		format7Info.push_back( info );
+	}
+
+	vector< Capture1394::Device::FeatureInfo > featureInfo;
+	in >> num;
+	for ( size_t i = 0; in && ( i < num ); i++ )
+	{
+		Capture1394::Device::FeatureInfo info;
+		int id;
+		in >> id >> info.mMin >> info.mMax >> info.mAbsoluteCapable >> info.mAbsoluteMin >> info.mAbsoluteMax;
+		info.mId = dc1394feature_t( id );
+		featureInfo.push_back( info );
+	}
+
+	if ( !in )
+		return false;
+
+	device->mSupportedVideoModes = videoModes;
+	device->mFormat7Info = format7Info;
+	device->mFeatureInfo = featureInfo;
+	return true;
+}
+
+void CapabilityCache::save( const Capture1394::Device *device ) const
+{
+	dc1394camera_t *camera = device->mCamera;
+
+	uint32_t signature;
+	if ( !readSignature( camera, &signature ) )
+		return;
+
+	ofstream out( getPath( camera->guid ).string().c_str() );
+	if ( !out )
+		return;
+
+	out << setprecision( 9 );
+	out << kCacheMagic << " " << kCacheVersion << "\n";
+	out << camera->vendor_id << " " << camera->model_id << " " << camera->unit_sub_sw_version << " " << signature << "\n";
+
+	const vector< Capture1394::VideoMode > &videoModes = device->mSupportedVideoModes;
+	out << videoModes.size() << "\n";
+	for ( auto it = videoModes.cbegin(); it != videoModes.cend(); ++it )
+	{
+		out << it->getResolution().x << " " << it->getResolution().y << " " << it->getVideoMode() << " " <<
+			it->getColorCoding() << " " << it->getFrameRate() << "\n";
+	}
+
+	const vector< Capture1394::Device::Format7Info > &format7Info = device->mFormat7Info;
+	out << format7Info.size() << "\n";
+	for ( auto it = format7Info.cbegin(); it != format7Info.cend(); ++it )
+	{
+		out << it->mVideoMode << " " << it->mMaxSize.x << " " << it->mMaxSize.y << " " <<
+			it->mUnitSize.x << " " << it->mUnitSize.y << " " << it->mUnitPosition.x << " " <<
+			it->mUnitPosition.y << " " << it->mUnitBytes << " " << it->mMaxBytes << "\n";
+	}
+
+	const vector< Capture1394::Device::FeatureInfo > &featureInfo = device->mFeatureInfo;
+	out << featureInfo.size() << "\n";
+	for ( auto it = featureInfo.cbegin(); it != featureInfo.cend(); ++it )
+	{
+		out << it->mId << " " << it->mMin << " " << it->mMax << " " << it->mAbsoluteCapable << " " <<
+			it->mAbsoluteMin << " " << it->mAbsoluteMax << "\n";
+	}
+}
+
+} // namespace mndl
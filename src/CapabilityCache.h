@@ -0,0 +1,49 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+
+#include "cinder/Cinder.h"
+
+#include "Capture1394.h"
+
+namespace mndl {
+
+//! Stores the probed capabilities of the devices on disk, one file per GUID.
+class CapabilityCache
+{
+	public:
+		CapabilityCache( const ci::fs::path &directory ) : mDirectory( directory ) {}
+
+		/** Fills the capabilities of \a device from the cache. Returns false if there is no entry, or the entry was
+		 *  written for a different vendor, model, firmware or mode set.
+		 */
+		bool load( const Capture1394::Device *device ) const;
+		//! Writes the capabilities of \a device to the cache.
+		void save( const Capture1394::Device *device ) const;
+
+	protected:
+		ci::fs::path getPath( uint64_t guid ) const;
+		//! Reads the video format inquiry register, which changes when the supported modes of the camera change.
+		static bool readSignature( dc1394camera_t *camera, uint32_t *signature );
+
+		ci::fs::path mDirectory;
+};
+
+} // namespace mndl
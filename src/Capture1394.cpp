@@ -15,7 +15,15 @@
  along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstring>
+#include <exception>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "Cinder/app/App.h"
 
@@ -23,6 +31,9 @@
 
 #include "SurfaceCache.h"
 #include "Capture1394.h"
+#include "CapabilityCache.h"
+#include "BandwidthPlanner.h"
+#include "VideoModeSolver.h"
 
 using namespace std;
 
@@ -35,14 +46,18 @@ class ContextManager
 
 		static std::shared_ptr< ContextManager > instance();
 		static dc1394_t * getContext();
+		//! Guards the calls creating, freeing and enumerating cameras, which share the lists of the context.
+		static std::mutex & getMutex() { return sMutex; }
 
 	private:
 		static dc1394_t * sContext;
 		static std::shared_ptr< ContextManager > sInstance;
+		static std::mutex sMutex;
 };
 
 dc1394_t *ContextManager::sContext = NULL;
 shared_ptr< ContextManager > ContextManager::sInstance;
+mutex ContextManager::sMutex;
 
 ContextManager::~ContextManager()
 {
@@ -68,8 +83,30 @@ dc1394_t * ContextManager::getContext()
 	return sContext;
 }
 
+//! Upper limit of the threads probing the cameras in getDevices()
+static const size_t kMaxProbeThreads = 8;
+//! Number of dma buffers in the capture ring
+static const uint32_t kNumDmaBuffers = 8;
+//! Longest time the capture thread waits for a frame before checking for a stalled camera in seconds.
+static const double kFrameWaitTimeout = 0.1;
+//! Polling interval in seconds when the capture backend has no file descriptor to wait on.
+static const double kFramePollInterval = 0.002;
+//! Interval of the cycle timer samples of the clock model in seconds.
+static const double kClockSampleInterval = 0.5;
+//! Duration of an isochronous cycle in seconds.
+static const double kCycleDuration = 1.0 / 8000.0;
+
 bool Capture1394::sDevicesEnumerated = false;
 vector< Capture1394::DeviceRef > Capture1394::sDevices;
+shared_ptr< CapabilityCache > Capture1394::sCapabilityCache;
+
+void Capture1394::setCapabilityCacheDirectory( const ci::fs::path &directory )
+{
+	if ( directory.empty() )
+		sCapabilityCache.reset();
+	else
+		sCapabilityCache = shared_ptr< CapabilityCache >( new CapabilityCache( directory ) );
+}
 
 const vector< Capture1394::DeviceRef > & Capture1394::getDevices( bool forceRefresh )
 {
@@ -80,58 +117,53 @@ const vector< Capture1394::DeviceRef > & Capture1394::getDevices( bool forceRefr
 
 	dc1394camera_list_t *cameraList;
 	dc1394_t *context = ContextManager::instance()->getContext();
-	checkError( dc1394_camera_enumerate ( context, &cameraList ) );
-
-	for ( uint32_t i = 0; i < cameraList->num; i++ )
+	vector< uint64_t > guids;
 	{
-		Capture1394::DeviceRef device = Capture1394::DeviceRef( new Capture1394::Device( cameraList->ids[ i ].guid ) );
-		dc1394camera_t *camera = device->getNative();
+		lock_guard< mutex > lock( ContextManager::getMutex() );
+		checkError( dc1394_camera_enumerate ( context, &cameraList ) );
+		for ( uint32_t i = 0; i < cameraList->num; i++ )
+			guids.push_back( cameraList->ids[ i ].guid );
+		dc1394_camera_free_list( cameraList );
+	}
+	sort( guids.begin(), guids.end() );
 
-		dc1394video_modes_t videoModes;
-		checkError( dc1394_video_get_supported_modes( camera, &videoModes) );
+	// the cameras are created one by one, dc1394_camera_new() changes the context shared by all of them
+	vector< DeviceRef > devices;
+	for ( auto it = guids.cbegin(); it != guids.cend(); ++it )
+		devices.push_back( Capture1394::DeviceRef( new Capture1394::Device( *it ) ) );
 
-		for ( int v = 0; v < videoModes.num; v++ )
+	// probing the video modes, Format7 limits and features is a chain of bus transactions on each camera, it runs concurrently
+	vector< exception_ptr > errors( guids.size() );
+	atomic< size_t > nextDevice( 0 );
+	auto probeFn = [ & ]()
+	{
+		for ( size_t i = nextDevice++; i < devices.size(); i = nextDevice++ )
 		{
-			dc1394video_mode_t videoMode = videoModes.modes[ v ];
-			dc1394color_coding_t coding;
-			dc1394_get_color_coding_from_video_mode( camera, videoMode, &coding );
-			unsigned width, height;
-			dc1394_get_image_size_from_video_mode( camera, videoMode, &width, &height );
-
-			if ( !dc1394_is_video_mode_scalable( videoMode ) )
+			try
 			{
-				dc1394framerates_t framerates;
-				checkError( dc1394_video_get_supported_framerates( camera, videoMode, &framerates ) );
-				for ( int j = framerates.num - 1; j >= 0; j-- )
-				{
-					device->mSupportedVideoModes.push_back(
-						Capture1394::VideoMode( ci::Vec2i( width, height ), videoMode, coding,
-							framerates.framerates[ j ] ) );
-				}
+				devices[ i ]->probeCapabilities();
 			}
-			else
+			catch ( ... )
 			{
-				// Modes corresponding for format6 and format7 do not have framerates
-				device->mSupportedVideoModes.push_back( Capture1394::VideoMode( ci::Vec2i( width, height ), videoMode, coding ) );
+				errors[ i ] = current_exception();
 			}
 		}
+	};
 
-		// format 7
-		dc1394format7modeset_t format7Modes;
-		checkError( dc1394_format7_get_modeset( camera, &format7Modes ) );
-		for ( int v = 0; v < DC1394_VIDEO_MODE_FORMAT7_NUM; v++ )
-		{
-			dc1394format7mode_t mode = format7Modes.mode[ v ];
-			if ( ! mode.present )
-				continue;
-
-			device->mSupportedVideoModes.push_back(
-				Capture1394::VideoMode(
-					ci::Vec2i( mode.max_size_x, mode.max_size_y ), dc1394video_mode_t( DC1394_VIDEO_MODE_FORMAT7_0 + v ), mode.color_coding ) );
-		}
+	const size_t numThreads = min< size_t >( guids.size(), kMaxProbeThreads );
+	vector< thread > threads;
+	for ( size_t i = 1; i < numThreads; i++ )
+		threads.push_back( thread( probeFn ) );
+	probeFn();
+	for ( auto it = threads.begin(); it != threads.end(); ++it )
+		it->join();
 
-		sDevices.push_back( device );
+	for ( auto it = errors.cbegin(); it != errors.cend(); ++it )
+	{
+		if ( *it )
+			rethrow_exception( *it );
 	}
+	sDevices = devices;
 
 	sDevicesEnumerated = true;
 	return sDevices;
@@ -167,16 +199,169 @@ void Capture1394::checkError( dc1394error_t err )
 		throw Capture1394Exc( err );
 }
 
-Capture1394::Device::Device( uint64_t guid )
+Capture1394::Device::Device( uint64_t guid ) :
+	mGuid( guid ), mCaptureSetUp( false ), mCapabilitiesProbed( false )
 {
 	dc1394_t *context = ContextManager::instance()->getContext();
-	mCamera = dc1394_camera_new( context, guid );
+	{
+		lock_guard< mutex > lock( ContextManager::getMutex() );
+		mCamera = dc1394_camera_new( context, guid );
+	}
+	if ( mCamera == NULL )
+		throw Capture1394Exc( "Failed to initialize camera." );
+	mName = mCamera->model;
+}
+
+void Capture1394::Device::probeCapabilities() const
+{
+	if ( mCapabilitiesProbed )
+		return;
+
+	lock_guard< mutex > lock( mCapabilitiesMutex );
+	if ( mCapabilitiesProbed )
+		return;
+
+	NativeLock nativeLock = lockNative();
+
+	if ( sCapabilityCache && sCapabilityCache->load( this ) )
+	{
+		mCapabilitiesProbed = true;
+		return;
+	}
+
+	mSupportedVideoModes.clear();
+	mFormat7Info.clear();
+	mFeatureInfo.clear();
+
+	dc1394video_modes_t videoModes;
+	checkError( dc1394_video_get_supported_modes( mCamera, &videoModes) );
+
+	for ( uint32_t v = 0; v < videoModes.num; v++ )
+	{
+		dc1394video_mode_t videoMode = videoModes.modes[ v ];
+		dc1394color_coding_t coding;
+		dc1394_get_color_coding_from_video_mode( mCamera, videoMode, &coding );
+		unsigned width, height;
+		dc1394_get_image_size_from_video_mode( mCamera, videoMode, &width, &height );
+
+		if ( !dc1394_is_video_mode_scalable( videoMode ) )
+		{
+			dc1394framerates_t framerates;
+			checkError( dc1394_video_get_supported_framerates( mCamera, videoMode, &framerates ) );
+			for ( int j = framerates.num - 1; j >= 0; j-- )
+			{
+				mSupportedVideoModes.push_back(
+					Capture1394::VideoMode( ci::Vec2i( width, height ), videoMode, coding,
+						framerates.framerates[ j ] ) );
+			}
+		}
+		else
+		{
+			// Modes corresponding for format6 and format7 do not have framerates
+			mSupportedVideoModes.push_back( Capture1394::VideoMode( ci::Vec2i( width, height ), videoMode, coding ) );
+		}
+	}
+
+	// format 7
+	dc1394format7modeset_t format7Modes;
+	checkError( dc1394_format7_get_modeset( mCamera, &format7Modes ) );
+	for ( int v = 0; v < DC1394_VIDEO_MODE_FORMAT7_NUM; v++ )
+	{
+		dc1394format7mode_t mode = format7Modes.mode[ v ];
+		if ( ! mode.present )
+			continue;
+
+		// one entry per color coding, so the coding can be chosen like a video mode
+		dc1394color_codings_t codings = mode.color_codings;
+		if ( codings.num == 0 )
+		{
+			codings.num = 1;
+			codings.codings[ 0 ] = mode.color_coding;
+		}
+		for ( uint32_t c = 0; c < codings.num; c++ )
+		{
+			mSupportedVideoModes.push_back(
+				Capture1394::VideoMode(
+					ci::Vec2i( mode.max_size_x, mode.max_size_y ), dc1394video_mode_t( DC1394_VIDEO_MODE_FORMAT7_0 + v ), codings.codings[ c ] ) );
+		}
+
+		Format7Info info;
+		info.mVideoMode = dc1394video_mode_t( DC1394_VIDEO_MODE_FORMAT7_0 + v );
+		info.mMaxSize = ci::Vec2i( mode.max_size_x, mode.max_size_y );
+		info.mUnitSize = ci::Vec2i( mode.unit_size_x, mode.unit_size_y );
+		info.mUnitPosition = ci::Vec2i( mode.unit_pos_x, mode.unit_pos_y );
+		info.mUnitBytes = mode.unit_packet_size;
+		info.mMaxBytes = mode.max_packet_size;
+		mFormat7Info.push_back( info );
+	}
+
+	// feature boundaries
+	dc1394featureset_t featureSet;
+	checkError( dc1394_feature_get_all( mCamera, &featureSet ) );
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		const dc1394feature_info_t &feature = featureSet.feature[ i ];
+		if ( !feature.available )
+			continue;
+
+		FeatureInfo info;
+		info.mId = feature.id;
+		info.mMin = feature.min;
+		info.mMax = feature.max;
+		info.mAbsoluteCapable = feature.absolute_capable;
+		info.mAbsoluteMin = feature.abs_min;
+		info.mAbsoluteMax = feature.abs_max;
+		mFeatureInfo.push_back( info );
+	}
+
+	if ( sCapabilityCache )
+		sCapabilityCache->save( this );
+	mCapabilitiesProbed = true;
+}
+
+const Capture1394::Device::Format7Info * Capture1394::Device::findFormat7Info( dc1394video_mode_t videoMode ) const
+{
+	probeCapabilities();
+	for ( auto it = mFormat7Info.cbegin(); it != mFormat7Info.cend(); ++it )
+	{
+		if ( it->mVideoMode == videoMode )
+			return &( *it );
+	}
+	return NULL;
+}
+
+bool Capture1394::Device::reconnect()
+{
+	dc1394_t *context = ContextManager::instance()->getContext();
+	const uint64_t guid = mGuid;
+
+	lock_guard< mutex > lock( ContextManager::getMutex() );
+	dc1394camera_list_t *cameraList;
+	if ( dc1394_camera_enumerate( context, &cameraList ) != DC1394_SUCCESS )
+		return false;
+	bool found = false;
+	for ( uint32_t i = 0; i < cameraList->num; i++ )
+		found = found || ( cameraList->ids[ i ].guid == guid );
+	dc1394_camera_free_list( cameraList );
+	if ( !found )
+		return false;
+
+	dc1394camera_t *camera = dc1394_camera_new( context, guid );
+	if ( camera == NULL )
+		return false;
+
+	// the other threads using the handle finish with the old one before it is freed
+	NativeLock nativeLock = lockNative();
+	dc1394_camera_free( mCamera );
+	mCamera = camera;
+	return true;
 }
 
 Capture1394::Device::~Device()
 {
 	dc1394_video_set_transmission( mCamera, DC1394_OFF );
 	dc1394_capture_stop( mCamera );
+	lock_guard< mutex > lock( ContextManager::getMutex() );
 	dc1394_camera_free( mCamera );
 }
 
@@ -185,18 +370,30 @@ Capture1394::Capture1394( const Options &options, const DeviceRef device ) :
 {}
 
 Capture1394::Obj::Obj( const Options &options, const Capture1394::DeviceRef device ) :
-	mOptions( options ), mDevice( device ), mHasNewFrame( false ),
-	mIsCapturing( false )
+	mOptions( options ), mDevice( device ), mOutputColorCoding( DC1394_COLOR_CODING_RGB8 ), mState( STATE_STOPPED ),
+	mFeatureSetValid( false ), mMeasureReconnect( false ), mHasNewFrame( false ), mIsCapturing( false )
 {
+	mThreadRunning = false;
+	mParkRequested = false;
+	mParked = false;
+	mOperationMode = DC1394_OPERATION_MODE_LEGACY;
+	mIsoSpeed = DC1394_ISO_SPEED_400;
+	mFrameInterval = 0.0;
+	mMonoIsBayer = true;
+	mTriggerArmed = false;
+	mNextGrabId = 0;
+	mCaptureFlags = DC1394_CAPTURE_FLAGS_DEFAULT;
+	mRingAllocated = false;
+
 	if ( !device )
 	{
 		mDevice = Capture1394::getDevices()[ 0 ];
 	}
-	dc1394camera_t *camera = mDevice->getNative();
-
 	if ( mOptions.getVideoMode().getAutoVideoMode() )
 	{
-		Capture1394::VideoMode videoMode = mDevice->getSupportedVideoModes()[ 0 ];
+		Capture1394::VideoMode videoMode;
+		if ( !VideoModeSolver::solve( mDevice, mOptions.getVideoModeConstraints(), &videoMode ) )
+			throw Capture1394Exc( "No video mode satisfies the constraints." );
 		mOptions.setVideoMode( videoMode );
 	}
 
@@ -210,147 +407,1121 @@ Capture1394::Obj::Obj( const Options &options, const Capture1394::DeviceRef devi
 			maxRes = res;
 	}
 	mSurfaceCache = std::shared_ptr< SurfaceCache >( new SurfaceCache( maxRes.x, maxRes.y, ci::SurfaceChannelOrder::RGB, 8 ) );
+	mScratchBuffer.resize( maxRes.x * maxRes.y * 3 );
+	mMosaicBuffer.resize( maxRes.x * maxRes.y );
 
-	Capture1394::checkError( dc1394_video_set_operation_mode( camera, mOptions.getOperationMode() ) );
-
-	Capture1394::checkError( dc1394_video_set_iso_speed( camera, DC1394_ISO_SPEED_400 ) );
+	Capture1394::checkError( applyIsoSettings() );
 	setVideoMode( mOptions.getVideoMode() );
+
+	if ( pipe( mWakeupPipe ) != 0 )
+		throw Capture1394Exc( "Failed to create the wakeup pipe." );
+	fcntl( mWakeupPipe[ 0 ], F_SETFL, fcntl( mWakeupPipe[ 0 ], F_GETFL ) | O_NONBLOCK );
 }
 
 Capture1394::Obj::~Obj()
 {
-	if ( mIsCapturing )
-		stop();
+	try
+	{
+		if ( mIsCapturing || mThread || mRingAllocated )
+			halt( false );
+	}
+	catch ( const Capture1394Exc & )
+	{
+	}
+	close( mWakeupPipe[ 0 ] );
+	close( mWakeupPipe[ 1 ] );
 }
 
 void Capture1394::Obj::setVideoMode( const VideoMode &videoMode )
 {
+	chrono::steady_clock::time_point switchTime = chrono::steady_clock::now();
+
+	// a warm stop parks the capture thread and keeps the dma ring
 	bool wasCapturing = mIsCapturing;
 	if ( mIsCapturing )
 		stop();
 	{
 		lock_guard< mutex > lock( mMutex );
-		mOptions.setVideoMode( videoMode );
+		mOptions.setVideoMode( alignRoi( videoMode ) );
+		mRoiPosition = mOptions.getVideoMode().getPosition();
 
 		mWidth = mOptions.getVideoMode().getResolution().x;
 		mHeight = mOptions.getVideoMode().getResolution().y;
 		mSurfaceCache->resize( mWidth, mHeight );
 
-		dc1394video_mode_t dcVideoMode = mOptions.getVideoMode().getVideoMode();
-		if ( ( dcVideoMode < DC1394_VIDEO_MODE_FORMAT7_MIN ) || ( DC1394_VIDEO_MODE_FORMAT7_MAX < dcVideoMode ) )
+		// cameras without raw codings send their bayer mosaic as Format7 mono
+		mMonoIsBayer = true;
+		const vector< VideoMode > &supportedModes = mDevice->getSupportedVideoModes();
+		for ( auto it = supportedModes.cbegin(); it != supportedModes.cend(); ++it )
 		{
-			Capture1394::checkError( dc1394_video_set_framerate( mDevice->getNative(), mOptions.getVideoMode().getFrameRate() ) );
+			if ( ( it->getVideoMode() == mOptions.getVideoMode().getVideoMode() ) &&
+				 ( ( it->getColorCoding() == DC1394_COLOR_CODING_RAW8 ) || ( it->getColorCoding() == DC1394_COLOR_CODING_RAW16 ) ) )
+				mMonoIsBayer = false;
 		}
-		else
+
+		Capture1394::checkError( applyVideoMode( mRoiPosition ) );
+		mHasNewFrame = false;
+	}
+
+	// the ring buffers are laid out for the packets of the mode, they have to be set up again if any of it changes
+	if ( mRingAllocated && ( getRingLayout() != mRingLayout ) )
+	{
+		dc1394_capture_stop( mDevice->getNative() );
+		setRingAllocated( false );
+	}
+
+	if ( wasCapturing )
+		start();
+
+	lock_guard< mutex > lock( mMutex );
+	mStats.mLastModeSwitchTime = chrono::duration< double >( chrono::steady_clock::now() - switchTime ).count();
+}
+
+Capture1394::VideoMode Capture1394::Obj::alignRoi( const VideoMode &videoMode ) const
+{
+	const Device::Format7Info *info = mDevice->findFormat7Info( videoMode.getVideoMode() );
+	if ( !info )
+		return videoMode;
+
+	// the position unit defaults to the size unit if the camera does not report it
+	ci::Vec2i unitSize( std::max( info->mUnitSize.x, 1 ), std::max( info->mUnitSize.y, 1 ) );
+	ci::Vec2i unitPosition( info->mUnitPosition.x > 0 ? info->mUnitPosition.x : unitSize.x,
+							info->mUnitPosition.y > 0 ? info->mUnitPosition.y : unitSize.y );
+
+	ci::Vec2i size = videoMode.getResolution();
+	if ( ( size.x <= 0 ) || ( size.y <= 0 ) )
+		size = info->mMaxSize;
+	size.x = std::max( unitSize.x, std::min( size.x - size.x % unitSize.x, info->mMaxSize.x ) );
+	size.y = std::max( unitSize.y, std::min( size.y - size.y % unitSize.y, info->mMaxSize.y ) );
+
+	ci::Vec2i position = videoMode.getPosition();
+	position.x = std::max( 0, std::min( position.x, info->mMaxSize.x - size.x ) );
+	position.y = std::max( 0, std::min( position.y, info->mMaxSize.y - size.y ) );
+	position.x -= position.x % unitPosition.x;
+	position.y -= position.y % unitPosition.y;
+
+	VideoMode aligned( videoMode );
+	aligned.setResolution( size );
+	aligned.setPosition( position );
+	return aligned;
+}
+
+void Capture1394::Obj::setRoi( const ci::Area &roi )
+{
+	// the options only change with the capture thread stopped, reading them here does not race with it
+	VideoMode videoMode = mOptions.getVideoMode();
+	if ( !mDevice->findFormat7Info( videoMode.getVideoMode() ) )
+		throw Capture1394Exc( "Region of interest requires a Format7 video mode." );
+
+	videoMode.setPosition( roi.getUL() );
+	videoMode.setResolution( roi.getSize() );
+	videoMode = alignRoi( videoMode );
+
+	// a moved region keeps the frame layout, the camera takes the new position between two frames
+	if ( videoMode.getResolution() == mOptions.getVideoMode().getResolution() )
+	{
+		Device::NativeLock nativeLock = mDevice->lockNative();
+		if ( dc1394_format7_set_image_position( mDevice->getNative(), videoMode.getVideoMode(),
+					videoMode.getPosition().x, videoMode.getPosition().y ) == DC1394_SUCCESS )
 		{
-			Capture1394::checkError( dc1394_format7_set_roi( mDevice->getNative(),
-						dcVideoMode,
-						mOptions.getVideoMode().getColorCoding(),
-						DC1394_USE_MAX_AVAIL,
-						0, 0, mWidth, mHeight ) );
+			lock_guard< mutex > lock( mMutex );
+			mRoiPosition = videoMode.getPosition();
+			return;
 		}
+	}
 
-		Capture1394::checkError( dc1394_video_set_mode( mDevice->getNative(), dcVideoMode ) );
-		mHasNewFrame = false;
+	setVideoMode( videoMode );
+}
+
+Capture1394::Obj::RingLayout Capture1394::Obj::getRingLayout()
+{
+	dc1394camera_t *camera = mDevice->getNative();
+	const VideoMode &videoMode = mOptions.getVideoMode();
+	RingLayout layout;
+	layout.mVideoMode = videoMode.getVideoMode();
+	layout.mColorCoding = videoMode.getColorCoding();
+	if ( ( DC1394_VIDEO_MODE_FORMAT7_MIN <= layout.mVideoMode ) && ( layout.mVideoMode <= DC1394_VIDEO_MODE_FORMAT7_MAX ) )
+	{
+		// an unreadable register leaves its part 0, which still differs from a readable one
+		dc1394_format7_get_total_bytes( camera, layout.mVideoMode, &layout.mFrameBytes );
+		dc1394_format7_get_packet_size( camera, layout.mVideoMode, &layout.mPacketBytes );
+		dc1394_format7_get_packets_per_frame( camera, layout.mVideoMode, &layout.mPacketsPerFrame );
+	}
+	else
+	{
+		// the packet size of the fixed modes follows from the frame rate
+		layout.mFrameRate = videoMode.getFrameRate();
 	}
+
+	if ( layout.mFrameBytes == 0 )
+	{
+		uint32_t bits = 0;
+		dc1394_get_color_coding_bit_size( layout.mColorCoding, &bits );
+		layout.mFrameBytes = static_cast< uint64_t >( mWidth ) * mHeight * bits / 8;
+	}
+	return layout;
+}
+
+dc1394error_t Capture1394::Obj::applyIsoSettings()
+{
+	dc1394camera_t *camera = mDevice->getNative();
+	dc1394operation_mode_t operationMode = mOptions.getOperationMode();
+	dc1394speed_t speed = mOptions.getIsoSpeed();
+
+	if ( mOptions.getAutoIsoSpeed() )
+	{
+		// the fastest speed the camera accepts in 1394B mode, read back because unsupported speeds can be ignored
+		if ( camera->bmode_capable &&
+			 ( dc1394_video_set_operation_mode( camera, DC1394_OPERATION_MODE_1394B ) == DC1394_SUCCESS ) )
+		{
+			for ( int s = DC1394_ISO_SPEED_MAX; s >= DC1394_ISO_SPEED_800; s-- )
+			{
+				dc1394speed_t negotiated;
+				if ( ( dc1394_video_set_iso_speed( camera, dc1394speed_t( s ) ) == DC1394_SUCCESS ) &&
+					 ( dc1394_video_get_iso_speed( camera, &negotiated ) == DC1394_SUCCESS ) &&
+					 ( negotiated == s ) )
+				{
+					mOperationMode = DC1394_OPERATION_MODE_1394B;
+					mIsoSpeed = negotiated;
+					return DC1394_SUCCESS;
+				}
+			}
+		}
+
+		operationMode = DC1394_OPERATION_MODE_LEGACY;
+		speed = DC1394_ISO_SPEED_400;
+	}
+
+	dc1394error_t err = dc1394_video_set_operation_mode( camera, operationMode );
+	if ( err != DC1394_SUCCESS )
+		return err;
+	err = dc1394_video_set_iso_speed( camera, speed );
+	if ( err != DC1394_SUCCESS )
+		return err;
+	mOperationMode = operationMode;
+	mIsoSpeed = speed;
+	return DC1394_SUCCESS;
+}
+
+void Capture1394::Obj::setIsoSpeed( dc1394speed_t speed )
+{
+	bool wasCapturing = mIsCapturing;
+	if ( mIsCapturing )
+		stop();
+
+	mOptions.setAutoIsoSpeed( false );
+	mOptions.setIsoSpeed( speed );
+	// legacy mode reaches S400, lowering the speed goes back to it so the camera also works on legacy ports
+	mOptions.setOperationMode( speed > DC1394_ISO_SPEED_400 ? DC1394_OPERATION_MODE_1394B : DC1394_OPERATION_MODE_LEGACY );
+	Capture1394::checkError( applyIsoSettings() );
+
 	if ( wasCapturing )
 		start();
 }
 
+dc1394error_t Capture1394::Obj::applyVideoMode( const ci::Vec2i &roiPosition )
+{
+	dc1394camera_t *camera = mDevice->getNative();
+	dc1394video_mode_t dcVideoMode = mOptions.getVideoMode().getVideoMode();
+	dc1394error_t err;
+	if ( ( dcVideoMode < DC1394_VIDEO_MODE_FORMAT7_MIN ) || ( DC1394_VIDEO_MODE_FORMAT7_MAX < dcVideoMode ) )
+	{
+		err = dc1394_video_set_framerate( camera, mOptions.getVideoMode().getFrameRate() );
+	}
+	else
+	{
+		const VideoMode &videoMode = mOptions.getVideoMode();
+		uint32_t packetSize = videoMode.getPacketSize();
+		if ( ( packetSize == 0 ) && ( videoMode.getTargetFrameRate() > 0.f ) )
+		{
+			// the packet limits depend on the region of interest, so it is set before querying them
+			err = dc1394_format7_set_roi( camera, dcVideoMode, videoMode.getColorCoding(), DC1394_USE_MAX_AVAIL,
+					roiPosition.x, roiPosition.y, mWidth, mHeight );
+			if ( err != DC1394_SUCCESS )
+				return err;
+
+			uint32_t unitBytes, maxBytes, bits = 0;
+			err = dc1394_format7_get_packet_parameters( camera, dcVideoMode, &unitBytes, &maxBytes );
+			if ( err != DC1394_SUCCESS )
+				return err;
+			dc1394_get_color_coding_bit_size( videoMode.getColorCoding(), &bits );
+			packetSize = BandwidthPlanner::getFormat7PacketBytes( static_cast< uint64_t >( mWidth ) * mHeight * bits / 8,
+					unitBytes, maxBytes, videoMode.getTargetFrameRate() );
+		}
+
+		err = dc1394_format7_set_roi( camera,
+					dcVideoMode,
+					videoMode.getColorCoding(),
+					packetSize ? packetSize : DC1394_USE_MAX_AVAIL,
+					roiPosition.x, roiPosition.y,
+					mWidth, mHeight );
+	}
+	if ( err != DC1394_SUCCESS )
+		return err;
+
+	err = dc1394_video_set_mode( camera, dcVideoMode );
+	if ( err == DC1394_SUCCESS )
+		updateFrameInterval();
+	return err;
+}
+
+void Capture1394::Obj::updateFrameInterval()
+{
+	dc1394camera_t *camera = mDevice->getNative();
+	dc1394video_mode_t dcVideoMode = mOptions.getVideoMode().getVideoMode();
+	if ( ( DC1394_VIDEO_MODE_FORMAT7_MIN <= dcVideoMode ) && ( dcVideoMode <= DC1394_VIDEO_MODE_FORMAT7_MAX ) )
+	{
+		// the frame interval register is optional, one packet is sent per cycle otherwise
+		float interval = 0.f;
+		uint32_t packets = 0;
+		if ( ( dc1394_format7_get_frame_interval( camera, dcVideoMode, &interval ) == DC1394_SUCCESS ) && ( interval > 0.f ) )
+			mFrameInterval = interval;
+		else if ( dc1394_format7_get_packets_per_frame( camera, dcVideoMode, &packets ) == DC1394_SUCCESS )
+			mFrameInterval = packets * kCycleDuration;
+	}
+	else
+	{
+		float fps = 0.f;
+		if ( ( dc1394_framerate_as_float( mOptions.getVideoMode().getFrameRate(), &fps ) == DC1394_SUCCESS ) && ( fps > 0.f ) )
+			mFrameInterval = 1.0 / fps;
+	}
+}
+
 void Capture1394::Obj::start()
 {
-	Capture1394::checkError( dc1394_video_set_transmission( mDevice->getNative(), DC1394_ON ) );
-	Capture1394::checkError( dc1394_capture_setup( mDevice->getNative(), 8, DC1394_CAPTURE_FLAGS_DEFAULT ) );
-	mThreadShouldQuit = false;
-	mThread = shared_ptr< thread >( new thread( bind( &Capture1394::Obj::threadedFunc, this ) ) );
+	if ( mIsCapturing )
+		return;
+	if ( mAcquireBufferFn && ( !isOutputColorCodingSupported( mOutputColorCoding ) ) )
+		throw Capture1394Exc( "MONO8 output buffers need a mono or raw video mode." );
+
+	dc1394camera_t *camera = mDevice->getNative();
+	if ( !mRingAllocated )
+	{
+		Capture1394::checkError( dc1394_capture_setup( camera, kNumDmaBuffers, mCaptureFlags ) );
+		setRingAllocated( true );
+		mRingLayout = getRingLayout();
+	}
+	Capture1394::checkError( startTransmission() );
 	mHasNewFrame = false;
 	mIsCapturing = true;
+	setState( STATE_CAPTURING );
+
+	// resume the thread parked by a warm stop
+	if ( mThreadRunning )
+	{
+		{
+			lock_guard< mutex > lock( mMutex );
+			mParkRequested = false;
+		}
+		mParkCond.notify_all();
+		return;
+	}
+
+	// the thread has given up on a lost camera
+	if ( mThread )
+	{
+		mThread->join();
+		mThread.reset();
+	}
+
+	mThreadShouldQuit = false;
+	mParkRequested = false;
+	// consume the wakeup of the previous stop
+	char buffer[ 16 ];
+	while ( read( mWakeupPipe[ 0 ], buffer, sizeof( buffer ) ) > 0 )
+		;
+	mFeatureSetValid = false;
+	mThreadRunning = true;
+	mThread = shared_ptr< thread >( new thread( bind( &Capture1394::Obj::threadedFunc, this ) ) );
 }
 
 void Capture1394::Obj::stop()
+{
+	halt( mOptions.getWarmRestart() );
+}
+
+void Capture1394::Obj::halt( bool warm )
 {
 	if ( mThread )
 	{
-		mThreadShouldQuit = true;
-		mThread->join();
-		mThread.reset();
+		chrono::steady_clock::time_point stopTime = chrono::steady_clock::now();
+		if ( warm && mThreadRunning )
+		{
+			mParkRequested = true;
+			wakeThread();
+			unique_lock< mutex > lock( mMutex );
+			mParkCond.wait( lock, [ this ]() { return mParked || !mThreadRunning; } );
+		}
+		else
+		{
+			{
+				lock_guard< mutex > lock( mMutex );
+				mThreadShouldQuit = true;
+			}
+			mParkCond.notify_all();
+			wakeThread();
+			mThread->join();
+			mThread.reset();
+		}
+
+		lock_guard< mutex > lock( mMutex );
+		mStats.mLastStopLatency = chrono::duration< double >( chrono::steady_clock::now() - stopTime ).count();
+	}
+
+	// the pending grabs will not get their frames anymore, grab() times out
+	{
+		lock_guard< mutex > lock( mMutex );
+		mPendingGrabs.clear();
+	}
+
+	// fetched after the capture thread stopped, which might have reconnected the camera
+	dc1394camera_t *camera = mDevice->getNative();
+
+	// a lost camera cannot be switched off, only a healthy one reports errors
+	bool healthy = ( getState() == STATE_CAPTURING );
+	dc1394error_t err = dc1394_video_set_transmission( camera, DC1394_OFF );
+	if ( ( !warm ) && mRingAllocated )
+	{
+		dc1394error_t stopErr = dc1394_capture_stop( camera );
+		if ( err == DC1394_SUCCESS )
+			err = stopErr;
+		setRingAllocated( false );
 	}
-	Capture1394::checkError( dc1394_video_set_transmission( mDevice->getNative(), DC1394_OFF ) );
-	Capture1394::checkError( dc1394_capture_stop( mDevice->getNative() ) );
 	mIsCapturing = false;
+	setState( STATE_STOPPED );
+	if ( healthy )
+		Capture1394::checkError( err );
 }
 
-void Capture1394::Obj::threadedFunc()
+void Capture1394::Obj::setRingAllocated( bool allocated )
 {
+	mRingAllocated = allocated;
+	mDevice->mCaptureSetUp = allocated;
+}
+
+void Capture1394::Obj::wakeThread()
+{
+	// the capture thread never blocks on the camera, it waits on this pipe as well
+	char wakeup = 0;
+	if ( write( mWakeupPipe[ 1 ], &wakeup, 1 ) < 0 )
+		ci::app::console() << "Capture1394: failed to wake up the capture thread." << endl;
+}
+
+bool Capture1394::Obj::parkThread()
+{
+	{
+		unique_lock< mutex > lock( mMutex );
+		if ( mParkRequested )
+		{
+			mParked = true;
+			mParkCond.notify_all();
+			mParkCond.wait( lock, [ this ]() { return ( !mParkRequested ) || mThreadShouldQuit; } );
+			mParked = false;
+		}
+	}
+
+	char buffer[ 16 ];
+	while ( read( mWakeupPipe[ 0 ], buffer, sizeof( buffer ) ) > 0 )
+		;
+	if ( mThreadShouldQuit )
+		return false;
+
+	// drop the frames left in the ring from before the stop
 	dc1394camera_t *camera = mDevice->getNative();
 	dc1394video_frame_t *frame = NULL;
+	while ( ( dc1394_capture_dequeue( camera, DC1394_CAPTURE_POLICY_POLL, &frame ) == DC1394_SUCCESS ) && frame )
+		dc1394_capture_enqueue( camera, frame );
+	return true;
+}
+
+Capture1394::State Capture1394::Obj::getState() const
+{
+	lock_guard< mutex > lock( mMutex );
+	return mState;
+}
+
+void Capture1394::Obj::setState( State state )
+{
+	StateChangedFn stateChangedFn;
+	{
+		lock_guard< mutex > lock( mMutex );
+		if ( mState == state )
+			return;
+		mState = state;
+		stateChangedFn = mStateChangedFn;
+	}
+	if ( stateChangedFn )
+		stateChangedFn( state );
+}
 
+void Capture1394::Obj::setStateChangedCallback( const StateChangedFn &stateChangedFn )
+{
+	lock_guard< mutex > lock( mMutex );
+	mStateChangedFn = stateChangedFn;
+}
+
+Capture1394::Stats Capture1394::Obj::getStats() const
+{
+	lock_guard< mutex > lock( mMutex );
+	return mStats;
+}
+
+void Capture1394::Obj::threadedFunc()
+{
+	dc1394video_frame_t *frame = NULL;
+
+	// remember the features, so they can be restored if the camera is lost
+	mFeatureSetValid = ( dc1394_feature_get_all( mDevice->getNative(), &mFeatureSet ) == DC1394_SUCCESS );
+
+	mClockModel.reset();
+	mLastClockSample = chrono::steady_clock::time_point();
+
+	// the capture loop works with error codes only, exceptions are reserved for the setup functions
+	chrono::steady_clock::time_point lastFrameTime = chrono::steady_clock::now();
 	while ( !mThreadShouldQuit )
 	{
-		// drain all frames
-		if ( mOptions.getDiscardFrames() )
+		sampleClock();
+		dc1394camera_t *camera = mDevice->getNative();
+
+		// wait for a frame or the wakeup from stop() instead of blocking in the dequeue
+		int fd = dc1394_capture_get_fileno( camera );
+		WaitResult result = wait( fd, ( fd >= 0 ) ? kFrameWaitTimeout : kFramePollInterval );
+		if ( result == WAIT_WAKEUP )
 		{
-			bool empty = false;
-			while ( !empty )
+			if ( !parkThread() )
+				break;
+			lastFrameTime = chrono::steady_clock::now();
+			continue;
+		}
+		if ( ( result == WAIT_TIMEOUT ) && ( fd >= 0 ) )
+		{
+			// the camera stopped sending frames without reporting an error
+			// a triggered camera is silent until the next trigger
+			const double stallTimeout = mOptions.getStallTimeout();
+			if ( ( stallTimeout > 0.0 ) && ( mOptions.getTrigger() == TRIGGER_NONE ) &&
+				 ( chrono::steady_clock::now() - lastFrameTime > chrono::duration< double >( stallTimeout ) ) )
 			{
-				if ( dc1394_capture_dequeue( camera, DC1394_CAPTURE_POLICY_POLL, &frame ) == DC1394_SUCCESS )
-				{
-					if ( frame != NULL )
-						dc1394_capture_enqueue( camera, frame );
-					else
-						empty = true;
-				}
-				else
-				{
-					empty = true;
-				}
+				if ( !recover() )
+					break;
+				lastFrameTime = chrono::steady_clock::now();
 			}
+			continue;
+		}
+
+		// a dequeue failing after the retries means the camera was unplugged or the bus has been reset
+		if ( retry( [ & ]() { return dc1394_capture_dequeue( camera, DC1394_CAPTURE_POLICY_POLL, &frame ); } ) != DC1394_SUCCESS )
+		{
+			// retries cut short by a stop are not a lost camera, the next wait parks or quits
+			if ( mThreadShouldQuit || mParkRequested )
+				continue;
+			if ( !recover() )
+				break;
+			lastFrameTime = chrono::steady_clock::now();
+			continue;
 		}
 
-		Capture1394::checkError( dc1394_capture_dequeue( camera, DC1394_CAPTURE_POLICY_WAIT, &frame ) );
+		// skip to the newest frame, triggered frames belong to their grabs
+		while ( mOptions.getDiscardFrames() && ( mOptions.getTrigger() == TRIGGER_NONE ) && frame && ( frame->frames_behind > 0 ) )
+		{
+			dc1394_capture_enqueue( camera, frame );
+			if ( dc1394_capture_dequeue( camera, DC1394_CAPTURE_POLICY_POLL, &frame ) != DC1394_SUCCESS )
+				frame = NULL;
+		}
 
 		if ( frame )
 		{
-			if ( !dc1394_capture_is_frame_corrupt( camera, frame ) )
+			lastFrameTime = chrono::steady_clock::now();
+
+			dc1394error_t err = processFrame( frame );
+			if ( err != DC1394_SUCCESS )
+				reportError( err );
+
+			if ( retry( [ & ]() { return dc1394_capture_enqueue( camera, frame ); } ) != DC1394_SUCCESS )
+			{
+				// the frame goes back to the ring after a warm stop cut the retries short
+				bool returned = mParkRequested && parkThread() &&
+								( dc1394_capture_enqueue( camera, frame ) == DC1394_SUCCESS );
+				if ( mThreadShouldQuit )
+					break;
+				if ( ( !returned ) && ( !recover() ) )
+					break;
+				lastFrameTime = chrono::steady_clock::now();
+			}
+		}
+	}
+
+	{
+		lock_guard< mutex > lock( mMutex );
+		mThreadRunning = false;
+	}
+	mParkCond.notify_all();
+}
+
+Capture1394::Obj::WaitResult Capture1394::Obj::wait( int fd, double seconds )
+{
+	struct pollfd fds[ 2 ];
+	fds[ 0 ].fd = mWakeupPipe[ 0 ];
+	fds[ 0 ].events = POLLIN;
+	fds[ 0 ].revents = 0;
+	fds[ 1 ].fd = fd;
+	fds[ 1 ].events = POLLIN;
+	fds[ 1 ].revents = 0;
+
+	int ret = poll( fds, ( fd >= 0 ) ? 2 : 1, static_cast< int >( seconds * 1000.0 ) );
+	if ( mThreadShouldQuit || ( ( ret > 0 ) && ( fds[ 0 ].revents != 0 ) ) )
+		return WAIT_WAKEUP;
+	if ( ret > 0 )
+		return WAIT_FRAME;
+	return WAIT_TIMEOUT;
+}
+
+template< typename Op >
+dc1394error_t Capture1394::Obj::retry( Op op )
+{
+	chrono::duration< double > backoff( mOptions.getRetryBackoff() );
+	dc1394error_t err = op();
+	for ( int i = 0; ( err != DC1394_SUCCESS ) && ( i < mOptions.getMaxRetries() ) && ( !mThreadShouldQuit ) && ( !mParkRequested ); i++ )
+	{
+		reportError( err );
+		// a stop or a warm stop ends the backoff, the capture loop sees its wakeup
+		if ( wait( -1, backoff.count() ) == WAIT_WAKEUP )
+			return err;
+		backoff *= 2;
+		err = op();
+	}
+	if ( err != DC1394_SUCCESS )
+		reportError( err );
+	return err;
+}
+
+void Capture1394::Obj::reportError( dc1394error_t err )
+{
+	ErrorFn errorFn;
+	{
+		lock_guard< mutex > lock( mMutex );
+		mStats.mNumErrors++;
+		mStats.mLastError = err;
+		errorFn = mErrorFn;
+	}
+	if ( errorFn )
+		errorFn( err );
+}
+
+void Capture1394::Obj::setErrorCallback( const ErrorFn &errorFn )
+{
+	lock_guard< mutex > lock( mMutex );
+	mErrorFn = errorFn;
+}
+
+dc1394error_t Capture1394::Obj::processFrame( dc1394video_frame_t *frame )
+{
+	if ( dc1394_capture_is_frame_corrupt( mDevice->getNative(), frame ) )
+	{
+		lock_guard< mutex > lock( mMutex );
+		mStats.mNumCorruptFrames++;
+		return DC1394_SUCCESS;
+	}
+
+	if ( mAcquireBufferFn )
+	{
+		int32_t rowBytes = mWidth * ( ( mOutputColorCoding == DC1394_COLOR_CODING_MONO8 ) ? 1 : 3 );
+		uint8_t *data = mAcquireBufferFn( mWidth, mHeight, &rowBytes );
+		if ( data )
+		{
+			dc1394error_t err = convertFrame( frame, data, rowBytes, mOutputColorCoding );
+			// the callbacks see the buffer before it goes back to the provider, a failed conversion is not delivered
+			if ( err == DC1394_SUCCESS )
+				frameDelivered( frame, -1, data, rowBytes );
+			if ( mReleaseBufferFn )
+				mReleaseBufferFn( data, err == DC1394_SUCCESS );
+			if ( err != DC1394_SUCCESS )
+				return err;
+		}
+		else
+		{
+			lock_guard< mutex > lock( mMutex );
+			mStats.mNumDroppedFrames++;
+		}
+	}
+	else
+	{
+		// the surface is only wrapped on the application thread, so the capture path does not allocate
+		int id = mSurfaceCache->acquire();
+		if ( id >= 0 )
+		{
+			dc1394error_t err = convertFrame( frame, mSurfaceCache->getData( id ),
+					mSurfaceCache->getRowBytes(), DC1394_COLOR_CODING_RGB8 );
+			if ( err != DC1394_SUCCESS )
+			{
+				mSurfaceCache->discard( id );
+				return err;
+			}
+			frameDelivered( frame, id, mSurfaceCache->getData( id ), mSurfaceCache->getRowBytes() );
+		}
+		else
+		{
+			lock_guard< mutex > lock( mMutex );
+			mStats.mNumDroppedFrames++;
+		}
+	}
+	return DC1394_SUCCESS;
+}
+
+void Capture1394::Obj::sampleClock()
+{
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	if ( now - mLastClockSample < chrono::duration< double >( kClockSampleInterval ) )
+		return;
+	mLastClockSample = now;
+
+	uint32_t cycleTimer;
+	uint64_t localTime;
+	if ( dc1394_read_cycle_timer( mDevice->getNative(), &cycleTimer, &localTime ) == DC1394_SUCCESS )
+		mClockModel.addSample( cycleTimer, localTime, chrono::steady_clock::now() );
+}
+
+chrono::steady_clock::time_point Capture1394::Obj::getExposureTime( const dc1394video_frame_t *frame )
+{
+	// the frame was completed after the transmission of its packets, one per cycle
+	double transmission = frame->packets_per_frame * kCycleDuration;
+	if ( mClockModel.isValid() )
+	{
+		double busTime = mClockModel.hostToBus( frame->timestamp ) - transmission;
+		// the host timestamps carry the latency of the dma completion, free running frames follow the frame period
+		if ( mOptions.getTrigger() == TRIGGER_NONE )
+			busTime = mClockModel.smoothFrameTime( busTime );
+		return mClockModel.busToSteady( busTime );
+	}
+
+	// until the model has samples, shift the host timestamp to the steady clock directly
+	int64_t age = chrono::duration_cast< chrono::microseconds >( chrono::system_clock::now().time_since_epoch() ).count() -
+				  static_cast< int64_t >( frame->timestamp );
+	return chrono::steady_clock::now() -
+		   chrono::duration_cast< chrono::steady_clock::duration >( chrono::microseconds( age ) + chrono::duration< double >( transmission ) );
+}
+
+void Capture1394::Obj::frameDelivered( dc1394video_frame_t *frame, int surfaceId, uint8_t *data, int32_t rowBytes )
+{
+	chrono::steady_clock::time_point exposureTime = getExposureTime( frame );
+
+	FrameInfo frameInfo;
+	shared_ptr< SurfaceGrabFn > grabFn;
+	{
+		// publish under the lock, so getSurface() always pairs the surface with its frame info
+		lock_guard< mutex > lock( mMutex );
+		if ( surfaceId >= 0 )
+		{
+			mSurfaceCache->publish( surfaceId );
+			mHasNewFrame = true;
+		}
+		mStats.mNumFrames++;
+		mLatestFrameInfo.mTimestamp = frame->timestamp;
+		mLatestFrameInfo.mExposureTime = exposureTime;
+		mLatestFrameInfo.mFramesBehind = frame->frames_behind;
+		mLatestFrameInfo.mFrameNumber = mStats.mNumFrames;
+		frameInfo = mLatestFrameInfo;
+		frameInfo.mData = data;
+		frameInfo.mRowBytes = rowBytes;
+		frameInfo.mSize = ci::Vec2i( frame->size[ 0 ], frame->size[ 1 ] );
+		if ( mMeasureReconnect )
+		{
+			mStats.mLastReconnectLatency = chrono::duration< double >( chrono::steady_clock::now() - mLostTime ).count();
+			mMeasureReconnect = false;
+		}
+
+		// frames exposed before the trigger are leftovers of earlier triggers
+		if ( ( !mPendingGrabs.empty() ) && ( exposureTime >= mPendingGrabs.front().mTriggerTime ) )
+		{
+			PendingGrab &grab = mPendingGrabs.front();
+			grabFn = grab.mGrabFn;
+			double latency = chrono::duration< double >( chrono::steady_clock::now() - grab.mTriggerTime ).count();
+			mStats.mNumGrabs++;
+			mStats.mLastTriggerLatency = latency;
+			mStats.mMaxTriggerLatency = std::max( mStats.mMaxTriggerLatency, latency );
+			if ( --grab.mNumFrames == 0 )
+				mPendingGrabs.pop_front();
+		}
+	}
+
+	if ( mFrameFn )
+		mFrameFn( frameInfo );
+	// the buffer is the latest frame, it is not reused before the next frame is published after this returns
+	if ( grabFn )
+		( *grabFn )( surfaceId, frameInfo );
+}
+
+dc1394error_t Capture1394::Obj::startTransmission()
+{
+	dc1394camera_t *camera = mDevice->getNative();
+	dc1394error_t err;
+	switch ( mOptions.getTrigger() )
+	{
+		case TRIGGER_ONE_SHOT:
+			// one-shot and multi-shot requests are only served with the continuous transmission off
+			if ( mTriggerArmed )
+				dc1394_external_trigger_set_power( camera, DC1394_OFF );
+			mTriggerArmed = false;
+			return dc1394_video_set_transmission( camera, DC1394_OFF );
+
+		case TRIGGER_SOFTWARE:
+		case TRIGGER_EXTERNAL:
+			err = dc1394_external_trigger_set_mode( camera, mOptions.getTriggerMode() );
+			if ( err != DC1394_SUCCESS )
+				return err;
+			err = dc1394_external_trigger_set_source( camera, ( mOptions.getTrigger() == TRIGGER_SOFTWARE ) ?
+					DC1394_TRIGGER_SOURCE_SOFTWARE : mOptions.getTriggerSource() );
+			if ( err != DC1394_SUCCESS )
+				return err;
+			err = dc1394_external_trigger_set_power( camera, DC1394_ON );
+			if ( err != DC1394_SUCCESS )
+				return err;
+			mTriggerArmed = true;
+			return dc1394_video_set_transmission( camera, DC1394_ON );
+
+		default:
+			if ( mTriggerArmed )
+				dc1394_external_trigger_set_power( camera, DC1394_OFF );
+			mTriggerArmed = false;
+			return dc1394_video_set_transmission( camera, DC1394_ON );
+	}
+}
+
+ci::Surface8u Capture1394::Obj::grab( double timeout )
+{
+	// shared with the callback, which might still run after a timeout
+	struct GrabState
+	{
+		GrabState() : mDone( false ), mCancelled( false ), mSurfaceId( -1 ) {}
+
+		mutex mMutex;
+		condition_variable mCond;
+		bool mDone;
+		bool mCancelled;
+		int mSurfaceId;
+	};
+	shared_ptr< GrabState > state( new GrabState );
+
+	// the capture thread only retains the buffer, the surface owning it is built here
+	shared_ptr< SurfaceCache > surfaceCache = mSurfaceCache;
+	uint64_t id = grabSurfaceAsync( shared_ptr< SurfaceGrabFn >( new SurfaceGrabFn(
+			[ state, surfaceCache ]( int surfaceId, const FrameInfo & )
+			{
+				lock_guard< mutex > lock( state->mMutex );
+				if ( state->mCancelled || state->mDone )
+					return;
+				if ( surfaceId >= 0 )
+					surfaceCache->retain( surfaceId );
+				state->mSurfaceId = surfaceId;
+				state->mDone = true;
+				state->mCond.notify_all();
+			} ) ), 1 );
+
+	unique_lock< mutex > lock( state->mMutex );
+	if ( !state->mCond.wait_for( lock, chrono::duration< double >( timeout ), [ & ]() { return state->mDone; } ) )
+	{
+		state->mCancelled = true;
+		lock.unlock();
+		cancelGrab( id );
+		{
+			lock_guard< mutex > statsLock( mMutex );
+			mStats.mNumGrabTimeouts++;
+		}
+		throw Capture1394Exc( "Timed out waiting for the triggered frame." );
+	}
+	if ( state->mSurfaceId < 0 )
+		return ci::Surface8u();
+
+	ci::Surface8u surface = surfaceCache->getNewSurface( state->mSurfaceId );
+	surfaceCache->release( state->mSurfaceId );
+	return surface;
+}
+
+uint64_t Capture1394::Obj::grabAsync( const GrabFn &grabFn, uint32_t numFrames )
+{
+	// wrapped once here, the capture thread hands the pooled surface of the buffer to the callback
+	shared_ptr< SurfaceCache > surfaceCache = mSurfaceCache;
+	return grabSurfaceAsync( shared_ptr< SurfaceGrabFn >( new SurfaceGrabFn(
+			[ grabFn, surfaceCache ]( int surfaceId, const FrameInfo &frameInfo )
+			{
+				grabFn( ( surfaceId >= 0 ) ? surfaceCache->getSurface( surfaceId ) : ci::Surface8u(), frameInfo );
+			} ) ), numFrames );
+}
+
+uint64_t Capture1394::Obj::grabSurfaceAsync( const shared_ptr< SurfaceGrabFn > &grabFn, uint32_t numFrames )
+{
+	Trigger trigger = mOptions.getTrigger();
+	if ( ( !mIsCapturing ) || ( trigger == TRIGGER_NONE ) )
+		throw Capture1394Exc( "Grabbing needs a started capture with a trigger." );
+	if ( ( numFrames == 0 ) || ( ( numFrames > 1 ) && ( trigger != TRIGGER_ONE_SHOT ) ) )
+		throw Capture1394Exc( "Only one-shot triggering grabs more than one frame at once." );
+
+	// registered before firing, so the frame cannot arrive unclaimed
+	PendingGrab grab;
+	grab.mGrabFn = grabFn;
+	grab.mNumFrames = numFrames;
+	grab.mTriggerTime = chrono::steady_clock::now();
+	{
+		lock_guard< mutex > lock( mMutex );
+		grab.mId = mNextGrabId++;
+		mPendingGrabs.push_back( grab );
+	}
+
+	// fired from the calling thread while the capture thread might reconnect the camera
+	dc1394error_t err = DC1394_SUCCESS;
+	{
+		Device::NativeLock nativeLock = mDevice->lockNative();
+		dc1394camera_t *camera = mDevice->getNative();
+		if ( trigger == TRIGGER_ONE_SHOT )
+		{
+			err = ( numFrames == 1 ) ? dc1394_video_set_one_shot( camera, DC1394_ON ) :
+									   dc1394_video_set_multi_shot( camera, numFrames, DC1394_ON );
+		}
+		else if ( trigger == TRIGGER_SOFTWARE )
+		{
+			err = dc1394_software_trigger_set_power( camera, DC1394_ON );
+		}
+	}
+
+	if ( err != DC1394_SUCCESS )
+	{
+		cancelGrab( grab.mId );
+		Capture1394::checkError( err );
+	}
+	return grab.mId;
+}
+
+void Capture1394::Obj::cancelGrab( uint64_t id )
+{
+	lock_guard< mutex > lock( mMutex );
+	for ( auto it = mPendingGrabs.begin(); it != mPendingGrabs.end(); ++it )
+	{
+		if ( it->mId == id )
+		{
+			mPendingGrabs.erase( it );
+			return;
+		}
+	}
+}
+
+void Capture1394::Obj::setTrigger( Trigger trigger )
+{
+	bool wasCapturing = mIsCapturing;
+	if ( mIsCapturing )
+		stop();
+
+	mOptions.setTrigger( trigger );
+
+	if ( wasCapturing )
+		start();
+}
+
+bool Capture1394::Obj::recover()
+{
+	mLostTime = chrono::steady_clock::now();
+	setState( STATE_LOST );
+	dc1394_capture_stop( mDevice->getNative() );
+	setRingAllocated( false );
+
+	setState( STATE_RECONNECTING );
+	const chrono::duration< double > timeout( mOptions.getReconnectTimeout() );
+	const chrono::duration< double > interval( mOptions.getReconnectInterval() );
+	while ( ( !mThreadShouldQuit ) && ( !mParkRequested ) && ( chrono::steady_clock::now() - mLostTime < timeout ) )
+	{
+		if ( reconnect() )
+		{
 			{
 				lock_guard< mutex > lock( mMutex );
-				ci::Surface8u surface = mSurfaceCache->getNewSurface();
-				dc1394video_mode_t videoMode = mOptions.getVideoMode().getVideoMode();
-				if ( ( DC1394_VIDEO_MODE_FORMAT7_MIN <= videoMode ) &&
-						( videoMode <= DC1394_VIDEO_MODE_FORMAT7_MAX ) )
-				{
-					Capture1394::checkError( dc1394_bayer_decoding_8bit(
-								frame->image, surface.getData(), mWidth, mHeight,
-								DC1394_COLOR_FILTER_RGGB, DC1394_BAYER_METHOD_BILINEAR ) );
-				}
-				else
-				{
-					dc1394color_coding_t colorCoding = mOptions.getVideoMode().getColorCoding();
-					uint32_t bits; // TODO: is this calculation correct?
-					switch ( colorCoding )
-					{
-						case DC1394_COLOR_CODING_RGB16:
-						case DC1394_COLOR_CODING_MONO16:
-						case DC1394_COLOR_CODING_RAW16:
-							bits = 16;
-							break;
-
-						default:
-							bits = 8;
-							break;
-					}
-					Capture1394::checkError( dc1394_convert_to_RGB8(
-								frame->image, surface.getData(), mWidth, mHeight,
-								frame->yuv_byte_order, colorCoding, bits ) );
-				}
-				mCurrentSurface = surface;
-				mHasNewFrame = true;
+				mStats.mNumReconnects++;
+				mMeasureReconnect = true;
+			}
+			setState( STATE_CAPTURING );
+			return true;
+		}
+		wait( -1, interval.count() );
+	}
+
+	if ( ( !mThreadShouldQuit ) && ( !mParkRequested ) )
+		setState( STATE_FAILED );
+	return false;
+}
+
+bool Capture1394::Obj::reconnect()
+{
+	if ( !mDevice->reconnect() )
+		return false;
+
+	if ( applyIsoSettings() != DC1394_SUCCESS )
+		return false;
+	ci::Vec2i roiPosition;
+	{
+		lock_guard< mutex > lock( mMutex );
+		roiPosition = mRoiPosition;
+	}
+	if ( applyVideoMode( roiPosition ) != DC1394_SUCCESS )
+		return false;
+	if ( mFeatureSetValid )
+		applyFeatureSet();
+
+	// the camera might have come back on another bus with another cycle timer
+	mClockModel.reset();
+	mLastClockSample = chrono::steady_clock::time_point();
+
+	// reserved iso resources were released with the old camera handle, let the capture allocate them
+	mCaptureFlags = DC1394_CAPTURE_FLAGS_DEFAULT;
+	dc1394camera_t *camera = mDevice->getNative();
+	if ( dc1394_capture_setup( camera, kNumDmaBuffers, mCaptureFlags ) != DC1394_SUCCESS )
+		return false;
+	setRingAllocated( true );
+	mRingLayout = getRingLayout();
+	return startTransmission() == DC1394_SUCCESS;
+}
+
+void Capture1394::Obj::applyFeatureSet()
+{
+	// best effort, a feature that cannot be restored should not keep the capture down
+	dc1394camera_t *camera = mDevice->getNative();
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		const dc1394feature_info_t &feature = mFeatureSet.feature[ i ];
+		if ( ( !feature.available ) ||
+			 ( feature.id == DC1394_FEATURE_TRIGGER ) ||
+			 ( feature.id == DC1394_FEATURE_TRIGGER_DELAY ) )
+			continue;
+
+		if ( feature.on_off_capable )
+			dc1394_feature_set_power( camera, feature.id, feature.is_on );
+		dc1394_feature_set_mode( camera, feature.id, feature.current_mode );
+		if ( feature.current_mode != DC1394_FEATURE_MODE_MANUAL )
+			continue;
+
+		if ( feature.id == DC1394_FEATURE_WHITE_BALANCE )
+			dc1394_feature_whitebalance_set_value( camera, feature.BU_value, feature.RV_value );
+		else
+			dc1394_feature_set_value( camera, feature.id, feature.value );
+	}
+}
+
+dc1394error_t Capture1394::Obj::convertFrame( dc1394video_frame_t *frame, uint8_t *dst, int32_t rowBytes, dc1394color_coding_t coding )
+{
+	const int32_t packedRowBytes = mWidth * ( ( coding == DC1394_COLOR_CODING_MONO8 ) ? 1 : 3 );
+
+	dc1394color_coding_t colorCoding = mOptions.getVideoMode().getColorCoding();
+	dc1394video_mode_t videoMode = mOptions.getVideoMode().getVideoMode();
+	bool format7 = ( DC1394_VIDEO_MODE_FORMAT7_MIN <= videoMode ) && ( videoMode <= DC1394_VIDEO_MODE_FORMAT7_MAX );
+	bool mono = ( colorCoding == DC1394_COLOR_CODING_MONO8 ) || ( colorCoding == DC1394_COLOR_CODING_MONO16 );
+	bool hasFilter = ( DC1394_COLOR_FILTER_MIN <= frame->color_filter ) && ( frame->color_filter <= DC1394_COLOR_FILTER_MAX );
+
+	if ( ( colorCoding == DC1394_COLOR_CODING_RAW8 ) || ( colorCoding == DC1394_COLOR_CODING_RAW16 ) ||
+		 ( format7 && mono && ( hasFilter || mMonoIsBayer ) ) )
+	{
+		dc1394color_filter_t filter = hasFilter ? frame->color_filter : DC1394_COLOR_FILTER_RGGB;
+
+		// 16 bit mosaics are scaled down to 8 bits before debayering into the 8 bit output
+		uint8_t *mosaic = frame->image;
+		if ( ( colorCoding == DC1394_COLOR_CODING_RAW16 ) || ( colorCoding == DC1394_COLOR_CODING_MONO16 ) )
+		{
+			dc1394error_t err = dc1394_convert_to_MONO8( frame->image, &mMosaicBuffer[ 0 ], mWidth, mHeight,
+					frame->yuv_byte_order, DC1394_COLOR_CODING_MONO16, frame->data_depth ? frame->data_depth : 16 );
+			if ( err != DC1394_SUCCESS )
+				return err;
+			mosaic = &mMosaicBuffer[ 0 ];
+		}
+
+		if ( coding == DC1394_COLOR_CODING_MONO8 )
+		{
+			for ( int32_t y = 0; y < mHeight; y++ )
+				memcpy( dst + y * rowBytes, mosaic + y * mWidth, mWidth );
+			return DC1394_SUCCESS;
+		}
+
+		if ( rowBytes == packedRowBytes )
+		{
+			return dc1394_bayer_decoding_8bit( mosaic, dst, mWidth, mHeight,
+					filter, DC1394_BAYER_METHOD_BILINEAR );
+		}
+
+		// debayering needs the neighbouring rows, so padded destinations go through the scratch buffer
+		dc1394error_t err = dc1394_bayer_decoding_8bit( mosaic, &mScratchBuffer[ 0 ], mWidth, mHeight,
+				filter, DC1394_BAYER_METHOD_BILINEAR );
+		if ( err != DC1394_SUCCESS )
+			return err;
+		for ( int32_t y = 0; y < mHeight; y++ )
+			memcpy( dst + y * rowBytes, &mScratchBuffer[ y * packedRowBytes ], packedRowBytes );
+		return DC1394_SUCCESS;
+	}
+	else
+	{
+		// the conversions only use the depth of the 16 bit codings, to shift their significant bits down to 8 bits,
+		// so cameras sending fewer than 16 significant bits need the depth of the frame instead of the coding size
+		uint32_t bits = frame->data_depth;
+		if ( bits == 0 )
+		{
+			switch ( colorCoding )
+			{
+				case DC1394_COLOR_CODING_RGB16:
+				case DC1394_COLOR_CODING_MONO16:
+				case DC1394_COLOR_CODING_RAW16:
+					bits = 16;
+					break;
+
+				default:
+					bits = 8;
+					break;
 			}
-			Capture1394::checkError( dc1394_capture_enqueue( camera, frame ) );
 		}
+
+		dc1394error_t ( *convert )( uint8_t *, uint8_t *, uint32_t, uint32_t, uint32_t, dc1394color_coding_t, uint32_t ) =
+			( coding == DC1394_COLOR_CODING_MONO8 ) ? dc1394_convert_to_MONO8 : dc1394_convert_to_RGB8;
+
+		if ( rowBytes == packedRowBytes )
+		{
+			return convert( frame->image, dst, mWidth, mHeight,
+					frame->yuv_byte_order, colorCoding, bits );
+		}
+
+		// the other codings are packed, padded destinations can be converted row by row
+		const uint32_t srcRowBytes = frame->image_bytes / mHeight;
+		for ( int32_t y = 0; y < mHeight; y++ )
+		{
+			dc1394error_t err = convert( frame->image + y * srcRowBytes, dst + y * rowBytes, mWidth, 1,
+					frame->yuv_byte_order, colorCoding, bits );
+			if ( err != DC1394_SUCCESS )
+				return err;
+		}
+		return DC1394_SUCCESS;
 	}
 }
 
+void Capture1394::Obj::setOutputBufferProvider( const AcquireBufferFn &acquireFn, const ReleaseBufferFn &releaseFn, dc1394color_coding_t coding )
+{
+	if ( ( coding != DC1394_COLOR_CODING_RGB8 ) && ( coding != DC1394_COLOR_CODING_MONO8 ) )
+		throw Capture1394Exc( "Output buffers support RGB8 and MONO8 color coding only." );
+	if ( acquireFn && ( !isOutputColorCodingSupported( coding ) ) )
+		throw Capture1394Exc( "MONO8 output buffers need a mono or raw video mode." );
+
+	// the capture thread reads the provider without locking, swap it while stopped
+	bool wasCapturing = mIsCapturing;
+	if ( mIsCapturing )
+		stop();
+
+	mAcquireBufferFn = acquireFn;
+	mReleaseBufferFn = releaseFn;
+	mOutputColorCoding = coding;
+
+	if ( wasCapturing )
+		start();
+}
+
+bool Capture1394::Obj::isOutputColorCodingSupported( dc1394color_coding_t coding ) const
+{
+	// dc1394_convert_to_MONO8() only narrows mono images, color modes have no mono output
+	if ( coding != DC1394_COLOR_CODING_MONO8 )
+		return true;
+	dc1394color_coding_t colorCoding = mOptions.getVideoMode().getColorCoding();
+	return ( colorCoding == DC1394_COLOR_CODING_MONO8 ) || ( colorCoding == DC1394_COLOR_CODING_MONO16 ) ||
+		   ( colorCoding == DC1394_COLOR_CODING_RAW8 ) || ( colorCoding == DC1394_COLOR_CODING_RAW16 );
+}
+
 bool Capture1394::Obj::checkNewFrame() const
 {
 	lock_guard< mutex > lock( mMutex );
@@ -360,10 +1531,49 @@ bool Capture1394::Obj::checkNewFrame() const
 ci::Surface8u Capture1394::Obj::getSurface() const
 {
 	lock_guard< mutex > lock( mMutex );
-	mHasNewFrame = false;
+	if ( mHasNewFrame )
+	{
+		mCurrentSurface = mSurfaceCache->getNewSurface();
+		mCurrentFrameInfo = mLatestFrameInfo;
+		mHasNewFrame = false;
+	}
 	return mCurrentSurface;
 }
 
+Capture1394::VideoMode Capture1394::getVideoMode() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	VideoMode videoMode = mObj->mOptions.getVideoMode();
+	videoMode.setPosition( mObj->mRoiPosition );
+	return videoMode;
+}
+
+ci::Area Capture1394::getRoi() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	const ci::Vec2i &size = mObj->mOptions.getVideoMode().getResolution();
+	return ci::Area( mObj->mRoiPosition, mObj->mRoiPosition + size );
+}
+
+Capture1394::FrameInfo Capture1394::Obj::getFrameInfo() const
+{
+	lock_guard< mutex > lock( mMutex );
+	return mCurrentFrameInfo;
+}
+
+void Capture1394::Obj::setFrameCallback( const FrameFn &frameFn )
+{
+	// the capture thread calls the function without locking, swap it while stopped
+	bool wasCapturing = mIsCapturing;
+	if ( mIsCapturing )
+		stop();
+
+	mFrameFn = frameFn;
+
+	if ( wasCapturing )
+		start();
+}
+
 Capture1394Exc::Capture1394Exc( dc1394error_t err ) throw()
 {
 	strcpy( mMessage, "Capture1394: " );
@@ -17,7 +17,11 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <exception>
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -27,6 +31,8 @@
 
 #include <dc1394/dc1394.h>
 
+#include "ClockModel.h"
+
 namespace mndl {
 
 typedef std::shared_ptr< class Capture1394 > Capture1394Ref;
@@ -43,14 +49,16 @@ class Capture1394
 		{
 			public:
 				//! Default constructor for choosing the video mode automatically.
-				VideoMode() : mAutoVideoMode( true ) {}
+				VideoMode() : mPosition( 0, 0 ), mTargetFrameRate( 0.f ), mPacketSize( 0 ), mAutoVideoMode( true ) {}
 
 				VideoMode( const ci::Vec2i &res, dc1394video_mode_t videoMode,
 						   dc1394color_coding_t coding, dc1394framerate_t frameRate = (dc1394framerate_t)0 ) :
 					mResolution( res ), mVideoMode( videoMode ), mColorCoding( coding ),
-					mFrameRate( frameRate ), mAutoVideoMode( false ) {}
+					mFrameRate( frameRate ), mPosition( 0, 0 ), mTargetFrameRate( 0.f ), mPacketSize( 0 ), mAutoVideoMode( false ) {}
 
-				//! TODO: the resolution is set by the videomode, this has no effect yet
+				/** Sets the resolution. For Format7 modes it is the size of the region of interest, rounded down to the unit size
+				 *  of the mode, the other modes have a fixed resolution.
+				 */
 				VideoMode & resolution( const ci::Vec2i &resolution ) { mResolution = resolution; return *this; }
 				void setResolution( const ci::Vec2i &resolution ) { mResolution = resolution; }
 				const ci::Vec2i & getResolution() const { return mResolution; }
@@ -84,6 +92,23 @@ class Capture1394
 				void setFrameRate( dc1394framerate_t frameRate ) { mFrameRate = frameRate; }
 				dc1394framerate_t getFrameRate() const { return mFrameRate; }
 
+				//! Sets the Format7 position of the region of interest, rounded down to the unit position of the mode. Default is 0, 0.
+				VideoMode & position( const ci::Vec2i &position ) { mPosition = position; return *this; }
+				void setPosition( const ci::Vec2i &position ) { mPosition = position; }
+				const ci::Vec2i & getPosition() const { return mPosition; }
+
+				/** Sets the Format7 frame rate to aim for. The smallest packet size reaching it is used to keep the bus load down,
+				 *  unless packetSize() is set. 0 uses the maximum available packet size, which is the default.
+				 */
+				VideoMode & targetFrameRate( float fps ) { mTargetFrameRate = fps; return *this; }
+				void setTargetFrameRate( float fps ) { mTargetFrameRate = fps; }
+				float getTargetFrameRate() const { return mTargetFrameRate; }
+
+				//! Sets the Format7 packet size in bytes. 0 uses the maximum available packet size, which is the default.
+				VideoMode & packetSize( uint32_t bytes ) { mPacketSize = bytes; return *this; }
+				void setPacketSize( uint32_t bytes ) { mPacketSize = bytes; }
+				uint32_t getPacketSize() const { return mPacketSize; }
+
 				VideoMode & autoVideoMode( bool autoMode ) { mAutoVideoMode = autoMode; return *this; };
 				void setAutoVideoMode( bool autoMode ) { mAutoVideoMode = autoMode; }
 				bool getAutoVideoMode() const { return mAutoVideoMode; }
@@ -93,6 +118,9 @@ class Capture1394
 				dc1394video_mode_t mVideoMode;
 				dc1394color_coding_t mColorCoding;
 				dc1394framerate_t mFrameRate;
+				ci::Vec2i mPosition;
+				float mTargetFrameRate;
+				uint32_t mPacketSize;
 				bool mAutoVideoMode;
 
 			public:
@@ -129,35 +157,230 @@ class Capture1394
 				}
 		};
 
+		//! Requirements for choosing the video mode automatically.
+		struct VideoModeConstraints
+		{
+			VideoModeConstraints() : mMinResolution( 0, 0 ), mMinFrameRate( 0.f ), mCpuBudget( 0.0 ) {}
+
+			//! Smallest acceptable resolution, Format7 modes are cropped to it.
+			ci::Vec2i mMinResolution;
+			float mMinFrameRate;
+			//! Color codings in order of preference, they decide between modes of the same throughput.
+			std::vector< dc1394color_coding_t > mPreferredCodings;
+			//! Share of a cpu core the conversion of the frames may take, 0 is unlimited.
+			double mCpuBudget;
+		};
+
+		//! Trigger modes.
+		enum Trigger
+		{
+			//! Free-running capture.
+			TRIGGER_NONE,
+			//! grab() requests frames with dc1394_video_set_one_shot() or dc1394_video_set_multi_shot(), the transmission is off.
+			TRIGGER_ONE_SHOT,
+			//! grab() fires the software trigger.
+			TRIGGER_SOFTWARE,
+			//! The frames are triggered by the external trigger input, grab() waits for the next one.
+			TRIGGER_EXTERNAL
+		};
+
 		//! Options for specifying Capture1394 parameters.
 		class Options
 		{
 			public:
-				Options() : mOperationMode( DC1394_OPERATION_MODE_LEGACY ), mDiscardFrames( true ) {}
+				Options() : mAutoIsoSpeed( true ), mOperationMode( DC1394_OPERATION_MODE_LEGACY ), mIsoSpeed( DC1394_ISO_SPEED_400 ),
+							mDiscardFrames( true ),
+							mReconnectTimeout( 10.0 ), mReconnectInterval( 0.25 ),
+							mMaxRetries( 3 ), mRetryBackoff( 0.005 ), mStallTimeout( 5.0 ),
+							mTrigger( TRIGGER_NONE ), mTriggerMode( DC1394_TRIGGER_MODE_0 ), mTriggerSource( DC1394_TRIGGER_SOURCE_0 ),
+							mWarmRestart( false ) {}
 
 				//! Sets video mode. Default is automatic.
 				Options &videoMode( const VideoMode &videoMode ) { mVideoMode = videoMode; return *this; }
 				void setVideoMode( const VideoMode &videoMode ) { mVideoMode = videoMode; }
 				const VideoMode & getVideoMode() const { return mVideoMode; }
 
+				//! Sets the requirements of the automatic video mode, the mode with the highest throughput satisfying them is chosen.
+				Options &videoModeConstraints( const VideoModeConstraints &constraints ) { mVideoModeConstraints = constraints; return *this; }
+				void setVideoModeConstraints( const VideoModeConstraints &constraints ) { mVideoModeConstraints = constraints; }
+				const VideoModeConstraints & getVideoModeConstraints() const { return mVideoModeConstraints; }
+
+				/** Enables negotiating the isochronous settings. 1394B capable cameras are switched to
+				 *  DC1394_OPERATION_MODE_1394B with the highest speed they accept, the others fall back to legacy S400.
+				 *  When disabled, operationMode() and isoSpeed() are used. Default is on.
+				 */
+				Options &autoIsoSpeed( bool autoSpeed ) { mAutoIsoSpeed = autoSpeed; return *this; }
+				void setAutoIsoSpeed( bool autoSpeed ) { mAutoIsoSpeed = autoSpeed; }
+				bool getAutoIsoSpeed() const { return mAutoIsoSpeed; }
+
 				/** Sets operation mode, \a operationMode is one of DC1394_OPERATION_MODE_LEGACY, DC1394_OPERATION_MODE_1394B.
-				 *  Default is DC1394_OPERATION_MODE_LEGACY
+				 *  Only used if autoIsoSpeed() is off. Default is DC1394_OPERATION_MODE_LEGACY
 				 */
 				Options &operationMode( dc1394operation_mode_t operationMode ) { mOperationMode = operationMode; return *this; }
 				void setOperationMode( dc1394operation_mode_t operationMode ) { mOperationMode = operationMode; }
 				dc1394operation_mode_t getOperationMode() { return mOperationMode; }
 
+				/** Sets the isochronous speed, \a speed is one of DC1394_ISO_SPEED_100, DC1394_ISO_SPEED_200, DC1394_ISO_SPEED_400,
+				 *  DC1394_ISO_SPEED_800, DC1394_ISO_SPEED_1600, DC1394_ISO_SPEED_3200. Speeds above 400 need
+				 *  DC1394_OPERATION_MODE_1394B. Only used if autoIsoSpeed() is off. Default is DC1394_ISO_SPEED_400.
+				 */
+				Options &isoSpeed( dc1394speed_t speed ) { mIsoSpeed = speed; return *this; }
+				void setIsoSpeed( dc1394speed_t speed ) { mIsoSpeed = speed; }
+				dc1394speed_t getIsoSpeed() const { return mIsoSpeed; }
+
 				//! Enables frame discarding. Default is on.
 				Options &discardFrames( bool discard ) { mDiscardFrames = discard; return *this; }
 				void setDiscardFrames( bool discard ) { mDiscardFrames = discard; }
 				bool getDiscardFrames() { return mDiscardFrames; }
 
+				//! Sets how long a lost camera is searched for before giving up in seconds. Default is 10.
+				Options &reconnectTimeout( double seconds ) { mReconnectTimeout = seconds; return *this; }
+				void setReconnectTimeout( double seconds ) { mReconnectTimeout = seconds; }
+				double getReconnectTimeout() const { return mReconnectTimeout; }
+
+				//! Sets the delay between two reconnection attempts in seconds. Default is 0.25.
+				Options &reconnectInterval( double seconds ) { mReconnectInterval = seconds; return *this; }
+				void setReconnectInterval( double seconds ) { mReconnectInterval = seconds; }
+				double getReconnectInterval() const { return mReconnectInterval; }
+
+				//! Sets how many times a failing capture call is retried before the camera is considered lost. Default is 3.
+				Options &maxRetries( int retries ) { mMaxRetries = retries; return *this; }
+				void setMaxRetries( int retries ) { mMaxRetries = retries; }
+				int getMaxRetries() const { return mMaxRetries; }
+
+				//! Sets the delay before the first retry in seconds, it doubles with every further retry. Default is 0.005.
+				Options &retryBackoff( double seconds ) { mRetryBackoff = seconds; return *this; }
+				void setRetryBackoff( double seconds ) { mRetryBackoff = seconds; }
+				double getRetryBackoff() const { return mRetryBackoff; }
+
+				/** Sets how long the camera can stay silent before it is considered lost in seconds, 0 disables the check.
+				 *  Triggered captures are not checked. Default is 5.
+				 */
+				Options &stallTimeout( double seconds ) { mStallTimeout = seconds; return *this; }
+				void setStallTimeout( double seconds ) { mStallTimeout = seconds; }
+				double getStallTimeout() const { return mStallTimeout; }
+
+				//! Sets the trigger, grab() only works with triggered captures. Default is TRIGGER_NONE.
+				Options &trigger( Trigger trigger ) { mTrigger = trigger; return *this; }
+				void setTrigger( Trigger trigger ) { mTrigger = trigger; }
+				Trigger getTrigger() const { return mTrigger; }
+
+				//! Sets the IIDC trigger mode of TRIGGER_SOFTWARE and TRIGGER_EXTERNAL. Default is DC1394_TRIGGER_MODE_0.
+				Options &triggerMode( dc1394trigger_mode_t mode ) { mTriggerMode = mode; return *this; }
+				void setTriggerMode( dc1394trigger_mode_t mode ) { mTriggerMode = mode; }
+				dc1394trigger_mode_t getTriggerMode() const { return mTriggerMode; }
+
+				//! Sets the input of TRIGGER_EXTERNAL. Default is DC1394_TRIGGER_SOURCE_0.
+				Options &triggerSource( dc1394trigger_source_t source ) { mTriggerSource = source; return *this; }
+				void setTriggerSource( dc1394trigger_source_t source ) { mTriggerSource = source; }
+				dc1394trigger_source_t getTriggerSource() const { return mTriggerSource; }
+
+				/** Enables warm restarts. stop() parks the capture thread and keeps the dma ring allocated, so start() and
+				 *  setVideoMode() only switch the transmission, unless the layout of the frames changes. Default is off.
+				 */
+				Options &warmRestart( bool warm ) { mWarmRestart = warm; return *this; }
+				void setWarmRestart( bool warm ) { mWarmRestart = warm; }
+				bool getWarmRestart() const { return mWarmRestart; }
+
 			private:
 				VideoMode mVideoMode;
+				VideoModeConstraints mVideoModeConstraints;
+				bool mAutoIsoSpeed;
 				dc1394operation_mode_t mOperationMode;
+				dc1394speed_t mIsoSpeed;
 				bool mDiscardFrames;
+				double mReconnectTimeout;
+				double mReconnectInterval;
+				int mMaxRetries;
+				double mRetryBackoff;
+				double mStallTimeout;
+				Trigger mTrigger;
+				dc1394trigger_mode_t mTriggerMode;
+				dc1394trigger_source_t mTriggerSource;
+				bool mWarmRestart;
 		};
 
+		//! Capture states.
+		enum State
+		{
+			STATE_STOPPED,
+			STATE_CAPTURING,
+			//! The camera stopped transmitting, it was unplugged or the bus has been reset.
+			STATE_LOST,
+			//! The capture thread is searching for the camera to restore the video mode and the features.
+			STATE_RECONNECTING,
+			//! The camera could not be reconnected within the reconnect timeout, capturing has stopped.
+			STATE_FAILED
+		};
+
+		//! Capture statistics.
+		struct Stats
+		{
+			Stats() : mNumFrames( 0 ), mNumDroppedFrames( 0 ), mNumCorruptFrames( 0 ),
+					  mNumErrors( 0 ), mLastError( DC1394_SUCCESS ),
+					  mNumReconnects( 0 ), mLastReconnectLatency( 0.0 ), mLastStopLatency( 0.0 ),
+					  mLastModeSwitchTime( 0.0 ), mNumGrabs( 0 ), mNumGrabTimeouts( 0 ),
+					  mLastTriggerLatency( 0.0 ), mMaxTriggerLatency( 0.0 ) {}
+
+			uint64_t mNumFrames;
+			//! Frames dropped because every output buffer was in use.
+			uint64_t mNumDroppedFrames;
+			uint64_t mNumCorruptFrames;
+			//! Failed libdc1394 calls on the capture thread, including the retried ones.
+			uint64_t mNumErrors;
+			dc1394error_t mLastError;
+			uint32_t mNumReconnects;
+			//! Time from losing the camera to the first frame after reconnecting in seconds.
+			double mLastReconnectLatency;
+			//! Time the last stop() waited for the capture thread in seconds.
+			double mLastStopLatency;
+			//! Duration of the last setVideoMode() call in seconds.
+			double mLastModeSwitchTime;
+			//! Frames delivered to grab() and grabAsync().
+			uint64_t mNumGrabs;
+			uint64_t mNumGrabTimeouts;
+			//! Time from firing the trigger to delivering the frame in seconds.
+			double mLastTriggerLatency;
+			double mMaxTriggerLatency;
+		};
+
+		//! Metadata of a captured frame.
+		struct FrameInfo
+		{
+			FrameInfo() : mTimestamp( 0 ), mFramesBehind( 0 ), mFrameNumber( 0 ), mData( NULL ), mRowBytes( 0 ) {}
+
+			//! Host time when the frame was completed in the dma ring, in microseconds since the epoch.
+			uint64_t mTimestamp;
+			/** Estimated end of the exposure, when the camera started to transmit the frame. Mapped through the bus
+			 *  cycle timer once a few clock samples are taken. Without a trigger the frames are smoothed against the
+			 *  frame period, which removes most of the latency jitter of \a mTimestamp, triggered frames keep it.
+			 */
+			std::chrono::steady_clock::time_point mExposureTime;
+			//! Frames waiting in the dma ring behind this one.
+			uint32_t mFramesBehind;
+			//! Number of frames delivered before this one including it.
+			uint64_t mFrameNumber;
+			/** The buffer the frame was converted into, the output buffer or the RGB8 buffer of the surface, its row size and
+			 *  the size of the frame. Only set in the frame callback, the surface buffers are reused once it returns.
+			 */
+			uint8_t *mData;
+			int32_t mRowBytes;
+			ci::Vec2i mSize;
+		};
+
+		//! Called on the capture thread after a frame has been delivered to the surface or the output buffer.
+		typedef std::function< void ( const FrameInfo &frameInfo ) > FrameFn;
+
+		/** Called on the capture thread with a grabbed frame. The surface is empty if an output buffer provider is set.
+		 *  It wraps a buffer of the capture and is only valid during the call, clone it to keep the frame.
+		 */
+		typedef std::function< void ( const ci::Surface8u &surface, const FrameInfo &frameInfo ) > GrabFn;
+
+		//! Called on the capture thread when the capture state changes.
+		typedef std::function< void ( State state ) > StateChangedFn;
+		//! Called on the capture thread when a libdc1394 call fails during capture.
+		typedef std::function< void ( dc1394error_t err ) > ErrorFn;
+
 
 		static Capture1394Ref create( const Options &options = Options(), const DeviceRef device = DeviceRef() ) { return Capture1394Ref( new Capture1394( options, device ) ); }
 
@@ -171,8 +394,45 @@ class Capture1394
 		//! Is the device capturing video
 		bool isCapturing() const { return mObj->mIsCapturing; }
 
+		//! Returns the capture state. A lost camera is reconnected automatically.
+		State getState() const { return mObj->getState(); }
+		//! Sets the function called on the capture thread when the capture state changes.
+		void setStateChangedCallback( const StateChangedFn &stateChangedFn ) { mObj->setStateChangedCallback( stateChangedFn ); }
+		//! Sets the function called on the capture thread for capture errors, which are not thrown as exceptions.
+		void setErrorCallback( const ErrorFn &errorFn ) { mObj->setErrorCallback( errorFn ); }
+		//! Returns the capture statistics.
+		Stats getStats() const { return mObj->getStats(); }
+
 		//! Sets video mode
 		void setVideoMode( const VideoMode &videoMode ) { mObj->setVideoMode( videoMode ); }
+		//! Returns the current video mode with the current region of interest.
+		VideoMode getVideoMode() const;
+
+		/** Returns the frame interval of the current video mode in seconds. For Format7 modes it is reported by the camera
+		 *  or computed from the packets per frame.
+		 */
+		double getFrameInterval() const { return mObj->mFrameInterval; }
+
+		/** Sets the region of interest of the current Format7 mode, rounded to the unit size and position of the mode.
+		 *  Moving the region without resizing it does not interrupt capturing. Throws Capture1394Exc for other modes.
+		 */
+		void setRoi( const ci::Area &roi ) { mObj->setRoi( roi ); }
+		//! Returns the region of interest, the whole image for non-Format7 modes.
+		ci::Area getRoi() const;
+
+		/** Sets the isochronous speed and turns off the negotiation, switching to DC1394_OPERATION_MODE_1394B
+		 *  for speeds above 400 and to DC1394_OPERATION_MODE_LEGACY otherwise. Capturing is restarted if it is in progress.
+		 */
+		void setIsoSpeed( dc1394speed_t speed ) { mObj->setIsoSpeed( speed ); }
+		//! Returns the isochronous speed in effect, the negotiated one if Options::autoIsoSpeed() is on.
+		dc1394speed_t getIsoSpeed() const { return mObj->mIsoSpeed; }
+		//! Returns the operation mode in effect, the negotiated one if Options::autoIsoSpeed() is on.
+		dc1394operation_mode_t getOperationMode() const { return mObj->mOperationMode; }
+
+		/** Tells the capture that the isochronous channel and bandwidth of the camera have been allocated already,
+		 *  for example by BandwidthPlanner::reserve(), so they are not allocated when capturing starts. Takes effect on the next start().
+		 */
+		void setIsoResourcesReserved( bool reserved ) { mObj->mCaptureFlags = reserved ? 0 : DC1394_CAPTURE_FLAGS_DEFAULT; }
 
 		//! Returns the width of the captured image in pixels.
 		int32_t getWidth() const { return mObj->getWidth(); }
@@ -190,17 +450,60 @@ class Capture1394
 
 		//! Returns a Surface representing the current captured frame.
 		ci::Surface8u getSurface() const { return mObj->getSurface(); }
+		//! Returns the metadata of the frame last returned by getSurface().
+		FrameInfo getFrameInfo() const { return mObj->getFrameInfo(); }
+		//! Sets the function called on the capture thread for every delivered frame.
+		void setFrameCallback( const FrameFn &frameFn ) { mObj->setFrameCallback( frameFn ); }
+
+		/** Triggers a frame and returns it, waiting at most \a timeout seconds. Frames exposed before the trigger are not returned.
+		 *  Needs a started capture with a trigger. Throws Capture1394Exc on failure or timeout.
+		 */
+		ci::Surface8u grab( double timeout = 1.0 ) { return mObj->grab( timeout ); }
+		/** Triggers \a numFrames frames and calls \a grabFn on the capture thread with each of them. More than one frame
+		 *  needs TRIGGER_ONE_SHOT, which uses the multi-shot. Throws Capture1394Exc if the trigger fails.
+		 */
+		void grabAsync( const GrabFn &grabFn, uint32_t numFrames = 1 ) { mObj->grabAsync( grabFn, numFrames ); }
+		//! Sets the trigger, capturing is restarted if it is in progress.
+		void setTrigger( Trigger trigger ) { mObj->setTrigger( trigger ); }
+
+		/** Called on the capture thread for every frame, returns a buffer of at least \a height * \a rowBytes bytes
+		 *  or NULL to skip the frame. \a rowBytes holds the packed row size and can be changed to the stride of the buffer.
+		 */
+		typedef std::function< uint8_t * ( int32_t width, int32_t height, int32_t *rowBytes ) > AcquireBufferFn;
+		/** Called on the capture thread once the buffer is no longer used, after the frame callback and the grabs saw it.
+		 *  \a filled is false if the conversion failed, the frame is not delivered then.
+		 */
+		typedef std::function< void ( uint8_t *data, bool filled ) > ReleaseBufferFn;
+
+		/** Converts the captured frames directly into application owned buffers instead of the surfaces returned by getSurface().
+		 *  \a coding is the format of the destination, DC1394_COLOR_CODING_RGB8 or DC1394_COLOR_CODING_MONO8.
+		 *  Format7 modes are debayered for RGB8, MONO8 returns the raw sensor data. MONO8 needs a mono or raw video mode,
+		 *  Capture1394Exc is thrown for the others, also by start(). Passing empty functions restores the surface output.
+		 */
+		void setOutputBufferProvider( const AcquireBufferFn &acquireFn, const ReleaseBufferFn &releaseFn,
+									  dc1394color_coding_t coding = DC1394_COLOR_CODING_RGB8 )
+		{ mObj->setOutputBufferProvider( acquireFn, releaseFn, coding ); }
+		//! Returns whether the frames are converted into the buffers of an output buffer provider.
+		bool hasOutputBufferProvider() const { return static_cast< bool >( mObj->mAcquireBufferFn ); }
 
 		//! Returns the associated Device for this instance of Capture1394
 		const DeviceRef getDevice() const { return mObj->mDevice; }
 
-		//! Returns a vector of all Devices connected to the system. If \a forceRefresh then the system will be polled for connected devices.
+		/** Returns a vector of all Devices connected to the system ordered by their GUIDs. If \a forceRefresh then the system will be polled for connected devices.
+		 *  The devices are created one after the other, then their capabilities are probed concurrently.
+		 */
 		static const std::vector< DeviceRef > & getDevices( bool forceRefresh = false );
 		//! Finds a particular device based on its name
 		static DeviceRef findDeviceByName( const std::string &name );
 		//! Finds the first device whose name contains the string \a nameFragment
 		static DeviceRef findDeviceByNameContains( const std::string &nameFragment );
 
+		/** Sets the directory of the on-disk capability cache. When set, the video modes, Format7 limits and feature
+		 *  boundaries of the devices are stored per GUID and reused on the next enumeration after validating them
+		 *  with a single register read. An empty path disables the cache, which is the default.
+		 */
+		static void setCapabilityCacheDirectory( const ci::fs::path &directory );
+
 		//! Class for implementing libdc1394 devices.
 		class Device
 		{
@@ -208,27 +511,83 @@ class Capture1394
 				Device( uint64_t guid );
 				~Device();
 
+				//! Format7 mode limits.
+				struct Format7Info
+				{
+					dc1394video_mode_t mVideoMode;
+					ci::Vec2i mMaxSize;
+					ci::Vec2i mUnitSize;
+					ci::Vec2i mUnitPosition;
+					uint32_t mUnitBytes;
+					uint32_t mMaxBytes;
+				};
+
+				//! Value ranges of a feature.
+				struct FeatureInfo
+				{
+					dc1394feature_t mId;
+					uint32_t mMin, mMax;
+					bool mAbsoluteCapable;
+					float mAbsoluteMin, mAbsoluteMax;
+				};
+
 				//! Returns the human-readable name of the device.
-				const std::string getName() const { return mCamera->model; }
+				const std::string getName() const { return mName; }
 				//! Returns whether the device is available for use.
 				bool checkAvailable();
 				//! Returns whether the device is currently connected.
 				bool isConnected();
 				//! Returns the unique identifier.
-				DeviceIdentifier getUniqueId() { return mCamera->guid; };
+				DeviceIdentifier getUniqueId() const { return mGuid; };
+
+				//! Returns a vector of \a VideoMode's the device supports. The capabilities are probed on first access.
+				const std::vector< VideoMode > & getSupportedVideoModes() const { probeCapabilities(); return mSupportedVideoModes; }
+				//! Returns the limits of the Format7 modes the device supports.
+				const std::vector< Format7Info > & getFormat7Info() const { probeCapabilities(); return mFormat7Info; }
+				//! Returns the limits of Format7 mode \a videoMode or NULL if it is not supported.
+				const Format7Info * findFormat7Info( dc1394video_mode_t videoMode ) const;
+				//! Returns the value ranges of the available features.
+				const std::vector< FeatureInfo > & getFeatureInfo() const { probeCapabilities(); return mFeatureInfo; }
+
+				/** Returns a pointer to the libdc1394 device. The capture thread replaces it when it reconnects a lost camera,
+				 *  other threads have to hold lockNative() while they use it.
+				 */
+				dc1394camera_t * getNative() { return mCamera; }
 
-				//! Returns a vector of \a VideoMode's the device supports.
-				const std::vector< VideoMode > & getSupportedVideoModes() const { return mSupportedVideoModes; }
+				typedef std::unique_lock< std::recursive_mutex > NativeLock;
+				//! Keeps the handle returned by getNative() from being replaced by a reconnect while the returned lock is held.
+				NativeLock lockNative() const { return NativeLock( mNativeMutex ); }
 
-				//! Returns a pointer to the libdc1394 device.
-				dc1394camera_t * getNative() { return mCamera; }
+				//! Returns whether a Capture1394 has set up the dma ring of the device, which is laid out for the current video mode.
+				bool isCaptureSetUp() const { return mCaptureSetUp; }
 
 			protected:
-				Device() {}
+				Device() : mCamera( NULL ), mGuid( 0 ), mCaptureSetUp( false ), mCapabilitiesProbed( false ) {}
+				/** Queries the supported video modes, Format7 limits and features from the camera or the capability cache.
+				 *  Only the first successful call touches the bus, it is safe to call from multiple threads.
+				 */
+				void probeCapabilities() const;
+				/** Recreates the camera handle after the camera was lost, returns false if the camera is not on the bus.
+				 *  Invalidates getNative(), the handle is swapped under lockNative().
+				 */
+				bool reconnect();
+
 				dc1394camera_t *mCamera;
-				std::vector< VideoMode > mSupportedVideoModes;
+				//! Guards the replacement of mCamera, recursive so a holder can call functions taking it again.
+				mutable std::recursive_mutex mNativeMutex;
+				//! Copied from the handle, so they can be read without locking it.
+				std::string mName;
+				DeviceIdentifier mGuid;
+				std::atomic< bool > mCaptureSetUp;
+
+				mutable std::mutex mCapabilitiesMutex;
+				mutable std::atomic< bool > mCapabilitiesProbed;
+				mutable std::vector< VideoMode > mSupportedVideoModes;
+				mutable std::vector< Format7Info > mFormat7Info;
+				mutable std::vector< FeatureInfo > mFeatureInfo;
 
 				friend class Capture1394;
+				friend class CapabilityCache;
 		};
 
 		static void checkError( dc1394error_t err );
@@ -238,6 +597,7 @@ class Capture1394
 
 		static bool sDevicesEnumerated;
 		static std::vector< Capture1394::DeviceRef > sDevices;
+		static std::shared_ptr< class CapabilityCache > sCapabilityCache;
 
 		struct Obj
 		{
@@ -246,6 +606,8 @@ class Capture1394
 
 			void start();
 			void stop();
+			//! Stops capturing, a \a warm stop parks the capture thread and keeps the dma ring for the next start().
+			void halt( bool warm );
 
 			int32_t getWidth() const { return mWidth; };
 			int32_t getHeight() const { return mHeight; };
@@ -259,14 +621,153 @@ class Capture1394
 
 			std::shared_ptr< std::thread > mThread;
 			mutable std::mutex mMutex;
-			bool mThreadShouldQuit;
+			std::atomic< bool > mThreadShouldQuit;
+			std::atomic< bool > mThreadRunning;
+			std::atomic< bool > mParkRequested;
+			bool mParked;
+			std::condition_variable mParkCond;
+			void wakeThread();
+			//! Parks the capture thread while a warm stop is in effect, returns false if the thread should quit.
+			bool parkThread();
+
+			//! Flags of dc1394_capture_setup().
+			uint32_t mCaptureFlags;
+			bool mRingAllocated;
+			//! Sets \a mRingAllocated and tells the device whether its capture is set up.
+			void setRingAllocated( bool allocated );
+			//! Layout of the frames in the dma ring, the ring is set up again if any of it changes.
+			struct RingLayout
+			{
+				RingLayout() : mVideoMode( DC1394_VIDEO_MODE_MIN ), mColorCoding( DC1394_COLOR_CODING_MIN ),
+							   mFrameRate( (dc1394framerate_t)0 ), mFrameBytes( 0 ), mPacketBytes( 0 ), mPacketsPerFrame( 0 ) {}
+
+				bool operator==( const RingLayout &rhs ) const
+				{
+					return ( mVideoMode == rhs.mVideoMode ) && ( mColorCoding == rhs.mColorCoding ) &&
+						   ( mFrameRate == rhs.mFrameRate ) && ( mFrameBytes == rhs.mFrameBytes ) &&
+						   ( mPacketBytes == rhs.mPacketBytes ) && ( mPacketsPerFrame == rhs.mPacketsPerFrame );
+				}
+				bool operator!=( const RingLayout &rhs ) const { return !( *this == rhs ); }
+
+				dc1394video_mode_t mVideoMode;
+				dc1394color_coding_t mColorCoding;
+				dc1394framerate_t mFrameRate;
+				uint64_t mFrameBytes;
+				uint32_t mPacketBytes;
+				uint32_t mPacketsPerFrame;
+			};
+			RingLayout mRingLayout;
+			//! Returns the layout of the current video mode as applied to the camera.
+			RingLayout getRingLayout();
+			//! Written by stop() to wake up the capture thread.
+			int mWakeupPipe[ 2 ];
+
+			enum WaitResult { WAIT_FRAME, WAIT_WAKEUP, WAIT_TIMEOUT };
+			//! Waits for a frame on the capture descriptor \a fd or a wakeup for at most \a seconds. \a fd can be -1.
+			WaitResult wait( int fd, double seconds );
 
 			void threadedFunc();
+			dc1394error_t convertFrame( dc1394video_frame_t *frame, uint8_t *dst, int32_t rowBytes, dc1394color_coding_t coding );
+
+			void setOutputBufferProvider( const AcquireBufferFn &acquireFn, const ReleaseBufferFn &releaseFn, dc1394color_coding_t coding );
+			//! Returns whether the frames of the current video mode can be converted to output buffers of \a coding.
+			bool isOutputColorCodingSupported( dc1394color_coding_t coding ) const;
+			AcquireBufferFn mAcquireBufferFn;
+			ReleaseBufferFn mReleaseBufferFn;
+			dc1394color_coding_t mOutputColorCoding;
+			std::vector< uint8_t > mScratchBuffer;
+			//! 8 bit copy of 16 bit bayer mosaics.
+			std::vector< uint8_t > mMosaicBuffer;
+			//! Whether Format7 mono images of the current mode are bayer mosaics.
+			bool mMonoIsBayer;
+			/** Position of the Format7 region of interest, guarded by mMutex. setRoi() moves it while capturing,
+			 *  the options themselves only change while the capture thread is stopped.
+			 */
+			ci::Vec2i mRoiPosition;
 
 			void setVideoMode( const VideoMode &videoMode );
+			void setRoi( const ci::Area &roi );
+			//! Returns \a videoMode with its Format7 region of interest rounded to the units and clamped to the maximum size.
+			VideoMode alignRoi( const VideoMode &videoMode ) const;
+			void setIsoSpeed( dc1394speed_t speed );
+			//! Sets the operation mode and the isochronous speed from the options or negotiates them.
+			dc1394error_t applyIsoSettings();
+			//! The operation mode and the isochronous speed in effect.
+			std::atomic< dc1394operation_mode_t > mOperationMode;
+			std::atomic< dc1394speed_t > mIsoSpeed;
+			//! Applies the video mode of the options with the region of interest at \a roiPosition.
+			dc1394error_t applyVideoMode( const ci::Vec2i &roiPosition );
+			//! Arms the trigger of the options and starts the transmission unless one-shots are requested.
+			dc1394error_t startTransmission();
+			bool mTriggerArmed;
+
+			ci::Surface8u grab( double timeout );
+			uint64_t grabAsync( const GrabFn &grabFn, uint32_t numFrames );
+			//! Called on the capture thread with the surface cache buffer of a grabbed frame, -1 with an output buffer provider.
+			typedef std::function< void ( int surfaceId, const FrameInfo &frameInfo ) > SurfaceGrabFn;
+			//! Returns the id of the grab for cancelGrab().
+			uint64_t grabSurfaceAsync( const std::shared_ptr< SurfaceGrabFn > &grabFn, uint32_t numFrames );
+			void cancelGrab( uint64_t id );
+			void setTrigger( Trigger trigger );
+			//! A grab waiting for its frames, guarded by mMutex.
+			struct PendingGrab
+			{
+				uint64_t mId;
+				//! Shared, so handing it to the capture thread does not copy the function.
+				std::shared_ptr< SurfaceGrabFn > mGrabFn;
+				std::chrono::steady_clock::time_point mTriggerTime;
+				uint32_t mNumFrames;
+			};
+			std::deque< PendingGrab > mPendingGrabs;
+			uint64_t mNextGrabId;
+
+			//! Updates the frame interval after the video mode has been applied.
+			void updateFrameInterval();
+			std::atomic< double > mFrameInterval;
+
+			dc1394error_t processFrame( dc1394video_frame_t *frame );
+			//! Publishes the surface \a surfaceId, or -1 for output buffers, and updates the frame info. \a data is the converted frame.
+			void frameDelivered( dc1394video_frame_t *frame, int surfaceId, uint8_t *data, int32_t rowBytes );
+
+			FrameInfo getFrameInfo() const;
+			void setFrameCallback( const FrameFn &frameFn );
+			FrameFn mFrameFn;
+			//! Samples the bus cycle timer for the clock model if it is due.
+			void sampleClock();
+			//! Returns the estimated exposure time of \a frame, smoothed against the frame period while free running.
+			std::chrono::steady_clock::time_point getExposureTime( const dc1394video_frame_t *frame );
+			ClockModel mClockModel;
+			std::chrono::steady_clock::time_point mLastClockSample;
+
+			FrameInfo mLatestFrameInfo;
+			mutable FrameInfo mCurrentFrameInfo;
+
+			//! Calls \a op until it succeeds or the retry budget is spent, returns the last error.
+			template< typename Op > dc1394error_t retry( Op op );
+			void reportError( dc1394error_t err );
+			void setErrorCallback( const ErrorFn &errorFn );
+			ErrorFn mErrorFn;
+
+			State getState() const;
+			void setState( State state );
+			void setStateChangedCallback( const StateChangedFn &stateChangedFn );
+			Stats getStats() const;
+
+			//! Waits for the lost camera to come back and restores its settings. Returns false on timeout or stop.
+			bool recover();
+			bool reconnect();
+			void applyFeatureSet();
+
+			State mState;
+			StateChangedFn mStateChangedFn;
+			Stats mStats;
+			dc1394featureset_t mFeatureSet;
+			bool mFeatureSetValid;
+			std::chrono::steady_clock::time_point mLostTime;
+			bool mMeasureReconnect;
 
 			std::shared_ptr< class SurfaceCache > mSurfaceCache;
-			ci::Surface8u mCurrentSurface;
+			mutable ci::Surface8u mCurrentSurface;
 			mutable bool mHasNewFrame;
 			bool mIsCapturing;
 		};
@@ -15,6 +15,8 @@
  along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 
 #include "cinder/app/App.h"
@@ -26,6 +28,32 @@ using namespace std;
 
 namespace mndl {
 
+//! Presets kept on the host for cameras without memory channels.
+static const int kNumHostPresets = 4;
+//! Longest time a config or memory channel load is waited for in seconds, a config load is reported as timed out after it.
+static const double kConfigTimeout = 2.0;
+
+/** Returns the index in \a videoModes of the mode stored in \a xml by its video mode and color coding, 0 if the camera does
+ *  not have it. Configs written before store the index, which only holds if the list of modes has not changed since.
+ */
+static int findVideoMode( const vector< Capture1394::VideoMode > &videoModes, const ci::XmlTree &xml )
+{
+	if ( !xml.hasAttribute( "mode" ) )
+	{
+		int index = xml.getAttributeValue( "id", 0 );
+		return ( ( index >= 0 ) && ( index < static_cast< int >( videoModes.size() ) ) ) ? index : 0;
+	}
+
+	int mode = xml.getAttributeValue( "mode", 0 );
+	int colorCoding = xml.getAttributeValue( "colorCoding", 0 );
+	for ( size_t i = 0; i < videoModes.size(); i++ )
+	{
+		if ( ( videoModes[ i ].getVideoMode() == mode ) && ( videoModes[ i ].getColorCoding() == colorCoding ) )
+			return static_cast< int >( i );
+	}
+	return 0;
+}
+
 Capture1394Params::Capture1394Params() :
 	mObj( shared_ptr< Obj >( new Capture1394Params::Obj( ci::app::App::get()->getWindow() ) ) )
 {}
@@ -36,30 +64,103 @@ Capture1394Params::Capture1394Params( const ci::app::WindowRef &window ) :
 
 void Capture1394Params::read( const ci::DataSourceRef &source )
 {
+	chrono::steady_clock::time_point startTime = chrono::steady_clock::now();
 	ci::XmlTree doc = ci::XmlTree( source );
 
+	// the capture and the video mode first, they reset the features
 	ci::XmlTree cameraId = doc.getChild( "cameraId" );
-	mObj->mCurrentCapture = cameraId.getAttributeValue( "id", 0 );
-	ci::XmlTree videoMode = doc.getChild( "videoMode" );
-	mObj->mVideoMode = videoMode.getAttributeValue( "id", 0 );
-
-	ci::XmlTree features = doc.getChild( "features" );
-	for ( ci::XmlTree::ConstIter child = features.begin(); child != features.end(); ++child )
+	int capture = cameraId.getAttributeValue( "id", 0 );
+	if ( ( capture >= 0 ) && ( capture < static_cast< int >( mObj->mCaptures.size() ) ) )
+		mObj->mCurrentCapture = capture;
+	if ( mObj->mCaptures[ mObj->mCurrentCapture ] )
+		mObj->mVideoMode = findVideoMode( mObj->mCaptures[ mObj->mCurrentCapture ]->getDevice()->getSupportedVideoModes(),
+				doc.getChild( "videoMode" ) );
+	mObj->updateCapture();
+
+	Feature features[ DC1394_FEATURE_NUM ];
+	// configs written before the absolute control leave it as it is
+	bool hasAbsolute[ DC1394_FEATURE_NUM ] = { false };
+	ci::XmlTree featuresXml = doc.getChild( "features" );
+	for ( ci::XmlTree::ConstIter child = featuresXml.begin(); child != featuresXml.end(); ++child )
 	{
 		int id = child->getAttributeValue( "id", 0 );
-		if ( id == 0 )
+		if ( ( id < DC1394_FEATURE_MIN ) || ( id > DC1394_FEATURE_MAX ) )
 		{
 			continue;
 		}
 		int i = id - DC1394_FEATURE_MIN;
-		mObj->mFeatures[ i ].mId = (dc1394feature_t)id;
-		mObj->mFeatures[ i ].mName = child->getAttributeValue( "name", std::string() );
-		mObj->mFeatures[ i ].mIsOn = child->getAttributeValue( "isOn", false );
-		mObj->mFeatures[ i ].mMode = child->getAttributeValue( "mode", 0 );
-		mObj->mFeatures[ i ].mValue = child->getAttributeValue( "value", 0 );
-		mObj->mFeatures[ i ].mBUValue = child->getAttributeValue( "BUValue", 0 );
-		mObj->mFeatures[ i ].mRVValue = child->getAttributeValue( "RVValue", 0 );
+		features[ i ].mId = (dc1394feature_t)id;
+		features[ i ].mName = child->getAttributeValue( "name", std::string() );
+		features[ i ].mIsOn = child->getAttributeValue( "isOn", false );
+		features[ i ].mMode = child->getAttributeValue( "mode", 0 );
+		features[ i ].mValue = child->getAttributeValue( "value", 0 );
+		features[ i ].mBUValue = child->getAttributeValue( "BUValue", 0 );
+		features[ i ].mRVValue = child->getAttributeValue( "RVValue", 0 );
+		// absolute values are stored in IIDC units, so the file does not depend on the display units
+		hasAbsolute[ i ] = child->hasAttribute( "absolute" );
+		if ( hasAbsolute[ i ] )
+		{
+			float scale;
+			getAbsoluteUnit( (dc1394feature_t)id, &scale );
+			features[ i ].mIsAbsolute = child->getAttributeValue( "absolute", false );
+			features[ i ].mAbsValue = child->getAttributeValue( "absValue", 0.0f ) * scale;
+		}
+	}
+
+	if ( !mObj->mCaptures[ mObj->mCurrentCapture ] )
+		return;
+
+	// the features the camera has, compared to its state and written as one batch on the control thread
+	FeatureControl::Snapshot snapshot;
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		const dc1394feature_info_t &info = mObj->mFeatureSet.feature[ i ];
+		if ( ( features[ i ].mId == 0 ) || ( mObj->mFeatures[ i ].mId != features[ i ].mId ) ||
+			 ( features[ i ].mMode < 0 ) || ( features[ i ].mMode >= static_cast< int >( info.modes.num ) ) )
+			continue;
+
+		float scale;
+		getAbsoluteUnit( features[ i ].mId, &scale );
+		FeatureControl::FeatureValue &value = snapshot.mFeatures[ i ];
+		value.mValid = true;
+		// features without power control are always on
+		value.mIsOn = info.on_off_capable ? features[ i ].mIsOn : ( info.is_on == DC1394_ON );
+		value.mMode = info.modes.modes[ features[ i ].mMode ];
+		value.mValue = static_cast< uint32_t >( features[ i ].mValue );
+		value.mBUValue = static_cast< uint32_t >( features[ i ].mBUValue );
+		value.mRVValue = static_cast< uint32_t >( features[ i ].mRVValue );
+		value.mHasAbsolute = hasAbsolute[ i ];
+		value.mIsAbsolute = features[ i ].mIsAbsolute;
+		value.mAbsValue = features[ i ].mAbsValue / scale;
+
+		if ( !hasAbsolute[ i ] )
+		{
+			features[ i ].mIsAbsolute = mObj->mFeatures[ i ].mIsAbsolute;
+			features[ i ].mAbsValue = mObj->mFeatures[ i ].mAbsValue;
+		}
+		features[ i ].mName = mObj->mFeatures[ i ].mName;
+		features[ i ].mIsOn = value.mIsOn;
+		mObj->mFeatures[ i ] = mObj->mPrevFeatures[ i ] = features[ i ];
+		mObj->updateReadonly( i );
 	}
+
+	// the result is reported by update() once the feature control has written the config
+	mObj->mFeatureControl->applyFeatures( snapshot );
+	mObj->mConfigFeatureControl = mObj->mFeatureControl;
+	mObj->mConfigStartTime = startTime;
+	mObj->mConfigStatus = "loading";
+}
+
+void Capture1394Params::savePreset( uint32_t channel )
+{
+	if ( mObj->mFeatureControl )
+		mObj->mFeatureControl->savePreset( channel );
+}
+
+void Capture1394Params::loadPreset( uint32_t channel )
+{
+	if ( mObj->mFeatureControl )
+		mObj->loadPreset( channel );
 }
 
 void Capture1394Params::write( const ci::DataTargetRef &target )
@@ -70,8 +171,18 @@ void Capture1394Params::write( const ci::DataTargetRef &target )
 	cameraId.setAttribute( "id", mObj->mCurrentCapture );
 	doc.push_back( cameraId );
 
+	// stored by the mode itself, the order of the supported modes may change
 	ci::XmlTree videoMode = ci::XmlTree( "videoMode", "" );
-	videoMode.setAttribute( "id", mObj->mVideoMode );
+	if ( mObj->mCaptures[ mObj->mCurrentCapture ] )
+	{
+		const vector< Capture1394::VideoMode > &videoModes =
+			mObj->mCaptures[ mObj->mCurrentCapture ]->getDevice()->getSupportedVideoModes();
+		if ( mObj->mVideoMode < static_cast< int >( videoModes.size() ) )
+		{
+			videoMode.setAttribute( "mode", static_cast< int >( videoModes[ mObj->mVideoMode ].getVideoMode() ) );
+			videoMode.setAttribute( "colorCoding", static_cast< int >( videoModes[ mObj->mVideoMode ].getColorCoding() ) );
+		}
+	}
 	doc.push_back( videoMode );
 
 	ci::XmlTree features = ci::XmlTree( "features", "" );
@@ -90,6 +201,10 @@ void Capture1394Params::write( const ci::DataTargetRef &target )
 		feature.setAttribute( "value", mObj->mFeatures[ i ].mValue );
 		feature.setAttribute( "BUValue", mObj->mFeatures[ i ].mBUValue );
 		feature.setAttribute( "RVValue", mObj->mFeatures[ i ].mRVValue );
+		float scale;
+		getAbsoluteUnit( mObj->mFeatures[ i ].mId, &scale );
+		feature.setAttribute( "absolute", mObj->mFeatures[ i ].mIsAbsolute );
+		feature.setAttribute( "absValue", mObj->mFeatures[ i ].mAbsValue / scale );
 
 		features.push_back( feature );
 	}
@@ -97,8 +212,45 @@ void Capture1394Params::write( const ci::DataTargetRef &target )
 	doc.write( target );
 }
 
+string Capture1394Params::getAbsoluteUnit( dc1394feature_t feature, float *scale )
+{
+	*scale = 1.0f;
+	switch ( feature )
+	{
+		case DC1394_FEATURE_BRIGHTNESS:
+		case DC1394_FEATURE_SATURATION:
+			return "%";
+		case DC1394_FEATURE_EXPOSURE:
+			return "EV";
+		case DC1394_FEATURE_WHITE_BALANCE:
+		case DC1394_FEATURE_TEMPERATURE:
+			return "K";
+		case DC1394_FEATURE_HUE:
+		case DC1394_FEATURE_PAN:
+		case DC1394_FEATURE_TILT:
+			return "deg";
+		case DC1394_FEATURE_SHUTTER:
+		case DC1394_FEATURE_TRIGGER_DELAY:
+			*scale = 1e6f;
+			return "us";
+		case DC1394_FEATURE_GAIN:
+			return "dB";
+		case DC1394_FEATURE_IRIS:
+			return "F";
+		case DC1394_FEATURE_FOCUS:
+			return "m";
+		case DC1394_FEATURE_FRAME_RATE:
+			return "fps";
+		case DC1394_FEATURE_ZOOM:
+			return "power";
+		default:
+			return "";
+	}
+}
+
 Capture1394Params::Obj::Obj( const ci::app::WindowRef &window ) :
-	mCurrentCapture( 0 ), mVideoMode( 0 )
+	mCurrentCapture( 0 ), mVideoMode( 0 ), mPrevCapture( -1 ), mPrevVideoMode( 0 ),
+	mSnapshotSequence( 0 ), mNumPresetLoads( 0 ), mPreset( 1 ), mPresetRestart( false )
 {
 	const vector< Capture1394::DeviceRef > &devices = Capture1394::getDevices();
 	for ( auto it = devices.cbegin(); it != devices.end(); ++it )
@@ -154,17 +306,42 @@ void Capture1394Params::Obj::setupParams()
 	}
 
 	// features
-	dc1394camera_t *camera = mCaptures[ mCurrentCapture ]->getDevice()->getNative();
-	Capture1394::checkError( dc1394_feature_get_all( camera, &mFeatureSet ) );
+	const Capture1394::DeviceRef &device = mCaptures[ mCurrentCapture ]->getDevice();
+	// one feature control per device, so the host presets survive switching between the captures
+	FeatureControlRef &featureControl = mFeatureControls[ device->getUniqueId() ];
+	if ( !featureControl )
+		featureControl = FeatureControl::create( device );
+	mFeatureControl = featureControl;
+	mFeatureStatus = "";
+	mParams->addParam( "Feature writes", &mFeatureStatus, true );
+	mParams->addParam( "Config load", &mConfigStatus, true );
+
+	// presets in the memory channels of the camera or on the host
+	int numPresets = static_cast< int >( mFeatureControl->getNumMemoryChannels() );
+	if ( numPresets == 0 )
+		numPresets = kNumHostPresets;
+	mPreset = std::max( 1, std::min( mPreset, numPresets ) );
+	mParams->addParam( "Preset", &mPreset ).min( 1 ).max( numPresets );
+	mParams->addButton( "Save preset", [ this ]() { mFeatureControl->savePreset( mPreset ); } );
+	mParams->addButton( "Load preset", [ this ]() { loadPreset( mPreset ); } );
+
+	{
+		// the capture might be reconnecting the camera on its thread
+		Capture1394::Device::NativeLock nativeLock = device->lockNative();
+		Capture1394::checkError( dc1394_feature_get_all( device->getNative(), &mFeatureSet ) );
+	}
+	mFeatureControl->setFeatureSet( mFeatureSet );
+	const FeatureControl::Snapshot snapshot = mFeatureControl->getSnapshot();
+	mSnapshotSequence = snapshot.mSequence;
+	mNumPresetLoads = snapshot.mNumPresetLoads;
 	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
 	{
 		const dc1394feature_info_t &feature = mFeatureSet.feature[ i ];
 		if ( !feature.available )
 			continue;
 
-		// TODO: support trigger
-		if ( ( feature.id == DC1394_FEATURE_TRIGGER ) ||
-			 ( feature.id == DC1394_FEATURE_TRIGGER_DELAY ) )
+		// the trigger is set up by Capture1394::Options::trigger()
+		if ( feature.id == DC1394_FEATURE_TRIGGER )
 			continue;
 
 		mFeatures[ i ].mId = feature.id;
@@ -203,21 +380,33 @@ void Capture1394Params::Obj::setupParams()
 		{
 			mParams->addParam( name + " value", &mFeatures[ i ].mValue ).min( feature.min ).max( feature.max );
 		}
+
+		// absolute control in physical units
+		if ( feature.absolute_capable )
+		{
+			float scale;
+			string unit = getAbsoluteUnit( feature.id, &scale );
+			mFeatures[ i ].mIsAbsolute = ( feature.abs_control == DC1394_ON );
+			mFeatures[ i ].mAbsValue = feature.abs_value * scale;
+			mParams->addParam( name + " absolute", &mFeatures[ i ].mIsAbsolute );
+			mParams->addParam( name + " absolute value", &mFeatures[ i ].mAbsValue, readonly ).
+				min( feature.abs_min * scale ).max( feature.abs_max * scale ).
+				step( ( feature.abs_max - feature.abs_min ) * scale / 1000.0f );
+			if ( !unit.empty() )
+				mParams->setOptions( name + " absolute value", "label='" + name + " absolute value (" + unit + ")'" );
+		}
 		mPrevFeatures[ i ] = mFeatures[ i ];
 	}
 }
 
-void Capture1394Params::Obj::update()
+void Capture1394Params::Obj::updateCapture()
 {
-	static int prevCapture = -1;
-	static int prevVideoMode = 0;
-
 	// check active capture device
-	if ( prevCapture != mCurrentCapture )
+	if ( mPrevCapture != mCurrentCapture )
 	{
-		if ( ( prevCapture >= 0 ) && mCaptures[ prevCapture ] && mCaptures[ prevCapture ]->isCapturing() )
+		if ( ( mPrevCapture >= 0 ) && mCaptures[ mPrevCapture ] && mCaptures[ mPrevCapture ]->isCapturing() )
 		{
-			mCaptures[ prevCapture ]->stop();
+			mCaptures[ mPrevCapture ]->stop();
 		}
 
 		if ( mCaptures[ mCurrentCapture ] && ( ! mCaptures[ mCurrentCapture ]->isCapturing() ) )
@@ -226,22 +415,90 @@ void Capture1394Params::Obj::update()
 			mCaptures[ mCurrentCapture ]->start();
 		}
 
-		prevCapture = mCurrentCapture;
+		mPrevCapture = mCurrentCapture;
 	}
 
 	if ( !mCaptures[ mCurrentCapture ] )
 		return;
 
-	dc1394camera_t *camera = mCaptures[ mCurrentCapture ]->getDevice()->getNative();
-
 	// video mode
-	if ( prevVideoMode != mVideoMode )
+	if ( mPrevVideoMode != mVideoMode )
 	{
 		const vector< Capture1394::VideoMode > &videoModes = mCaptures[ mCurrentCapture ]->getDevice()->getSupportedVideoModes();
 		mCaptures[ mCurrentCapture ]->setVideoMode( videoModes[ mVideoMode ] );
-		prevVideoMode = mVideoMode;
+		mPrevVideoMode = mVideoMode;
+	}
+}
+
+void Capture1394Params::Obj::loadPreset( uint32_t channel )
+{
+	Capture1394Ref capture = mCaptures[ mCurrentCapture ];
+	if ( ( !capture ) || ( mFeatureControl->getNumMemoryChannels() == 0 ) )
+	{
+		mFeatureControl->loadPreset( channel );
+		return;
 	}
 
+	// a memory channel restores the video mode it was saved with, the capture is set up again with the selected one
+	// once the load is done, see updateRequests()
+	if ( capture->isCapturing() )
+	{
+		capture->stop();
+		mPresetRestart = true;
+	}
+	else if ( mPresetCapture != capture )
+	{
+		mPresetRestart = false;
+	}
+	mFeatureControl->loadPreset( channel );
+	mPresetCapture = capture;
+	mPresetFeatureControl = mFeatureControl;
+	mPresetStartTime = chrono::steady_clock::now();
+}
+
+void Capture1394Params::Obj::updateRequests()
+{
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	chrono::duration< double > timeout( kConfigTimeout );
+
+	if ( mConfigFeatureControl )
+	{
+		bool done = mConfigFeatureControl->flush( 0.0 );
+		double loadTime = chrono::duration< double >( now - mConfigStartTime ).count();
+		if ( done || ( loadTime >= timeout.count() ) )
+		{
+			stringstream status;
+			if ( !done )
+				status << "timed out after " << loadTime * 1000.0 << " ms";
+			else
+				status << mConfigFeatureControl->getNumFeaturesApplied() << " features changed in " << loadTime * 1000.0 << " ms";
+			mConfigStatus = status.str();
+			mConfigFeatureControl.reset();
+		}
+	}
+
+	if ( mPresetCapture )
+	{
+		if ( ( !mPresetFeatureControl->flush( 0.0 ) ) && ( now - mPresetStartTime < timeout ) )
+			return;
+		mPresetCapture->setVideoMode( mPresetCapture->getVideoMode() );
+		if ( mPresetRestart )
+			mPresetCapture->start();
+		mPresetCapture.reset();
+		mPresetFeatureControl.reset();
+		mPresetRestart = false;
+	}
+}
+
+void Capture1394Params::Obj::update()
+{
+	updateRequests();
+	updateCapture();
+	if ( !mCaptures[ mCurrentCapture ] )
+		return;
+
+	updateAutoFeatures();
+
 	// iterate features looking for changes, since params has no change callbacks
 	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
 	{
@@ -250,42 +507,168 @@ void Capture1394Params::Obj::update()
 
 		if ( mFeatures[ i ].mIsOn != mPrevFeatures[ i ].mIsOn )
 		{
-			Capture1394::checkError( dc1394_feature_set_power( camera,
-						mFeatures[ i ].mId, static_cast< dc1394switch_t >( mFeatures[ i ].mIsOn ) ) );
+			mFeatureControl->setPower( mFeatures[ i ].mId, mFeatures[ i ].mIsOn );
 			mPrevFeatures[ i ].mIsOn = mFeatures[ i ].mIsOn;
 		}
 		if ( mFeatures[ i ].mMode != mPrevFeatures[ i ].mMode )
 		{
 			dc1394feature_mode_t mode = mFeatureSet.feature[ i ].modes.modes[ mFeatures[ i ].mMode ];
-			Capture1394::checkError( dc1394_feature_set_mode( camera,
-						mFeatures[ i ].mId, mode ) );
-			string readonly = ( mode == DC1394_FEATURE_MODE_AUTO ) ? "readonly=true" : "readonly=false";
-			if ( mFeatures[ i ].mId == DC1394_FEATURE_WHITE_BALANCE )
-			{
-				mParams->setOptions( mFeatures[ i ].mName + " B/U", readonly );
-				mParams->setOptions( mFeatures[ i ].mName + " R/V", readonly );
-			}
-			else
-			{
-				mParams->setOptions( mFeatures[ i ].mName + " value", readonly );
-			}
+			mFeatureControl->setMode( mFeatures[ i ].mId, mode );
+			mModeTimes[ i ] = chrono::steady_clock::now();
+			updateReadonly( i );
 			mPrevFeatures[ i ].mMode = mFeatures[ i ].mMode;
 		}
 		if ( mFeatures[ i ].mValue != mPrevFeatures[ i ].mValue )
 		{
-			Capture1394::checkError( dc1394_feature_set_value( camera,
-						mFeatures[ i ].mId, static_cast< uint32_t >( mFeatures[ i ].mValue ) ) );
+			mFeatureControl->setValue( mFeatures[ i ].mId, static_cast< uint32_t >( mFeatures[ i ].mValue ) );
 			mPrevFeatures[ i ].mValue = mFeatures[ i ].mValue;
 		}
 		if ( ( mFeatures[ i ].mBUValue != mPrevFeatures[ i ].mBUValue ) ||
 			 ( mFeatures[ i ].mRVValue != mPrevFeatures[ i ].mRVValue ) )
 		{
-			Capture1394::checkError( dc1394_feature_whitebalance_set_value( camera,
-					static_cast< uint32_t >( mFeatures[ i ].mBUValue ),
-					static_cast< uint32_t >( mFeatures[ i ].mRVValue ) ) );
+			mFeatureControl->setWhiteBalance( static_cast< uint32_t >( mFeatures[ i ].mBUValue ),
+					static_cast< uint32_t >( mFeatures[ i ].mRVValue ) );
 			mPrevFeatures[ i ].mBUValue = mFeatures[ i ].mBUValue;
 			mPrevFeatures[ i ].mRVValue = mFeatures[ i ].mRVValue;
 		}
+		if ( mFeatures[ i ].mIsAbsolute != mPrevFeatures[ i ].mIsAbsolute )
+		{
+			mFeatureControl->setAbsoluteControl( mFeatures[ i ].mId, mFeatures[ i ].mIsAbsolute );
+			mPrevFeatures[ i ].mIsAbsolute = mFeatures[ i ].mIsAbsolute;
+		}
+		if ( mFeatures[ i ].mAbsValue != mPrevFeatures[ i ].mAbsValue )
+		{
+			float scale;
+			getAbsoluteUnit( mFeatures[ i ].mId, &scale );
+			mFeatureControl->setAbsoluteValue( mFeatures[ i ].mId, mFeatures[ i ].mAbsValue / scale );
+			mPrevFeatures[ i ].mAbsValue = mFeatures[ i ].mAbsValue;
+		}
+	}
+
+	updateFeatureStatus();
+}
+
+void Capture1394Params::Obj::updateReadonly( int i )
+{
+	dc1394feature_mode_t mode = mFeatureSet.feature[ i ].modes.modes[ mFeatures[ i ].mMode ];
+	string readonly = ( mode == DC1394_FEATURE_MODE_AUTO ) ? "readonly=true" : "readonly=false";
+	if ( mFeatures[ i ].mId == DC1394_FEATURE_WHITE_BALANCE )
+	{
+		mParams->setOptions( mFeatures[ i ].mName + " B/U", readonly );
+		mParams->setOptions( mFeatures[ i ].mName + " R/V", readonly );
+	}
+	else
+	{
+		mParams->setOptions( mFeatures[ i ].mName + " value", readonly );
+	}
+	if ( mFeatureSet.feature[ i ].absolute_capable )
+		mParams->setOptions( mFeatures[ i ].mName + " absolute value", readonly );
+}
+
+void Capture1394Params::Obj::updateAutoFeatures()
+{
+	const FeatureControl::Snapshot snapshot = mFeatureControl->getSnapshot();
+	if ( ( snapshot.mSequence == 0 ) || ( snapshot.mSequence == mSnapshotSequence ) )
+		return;
+	mSnapshotSequence = snapshot.mSequence;
+	bool presetLoaded = ( snapshot.mNumPresetLoads != mNumPresetLoads );
+	mNumPresetLoads = snapshot.mNumPresetLoads;
+
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		const FeatureControl::FeatureValue &value = snapshot.mFeatures[ i ];
+		if ( ( mFeatures[ i ].mId == 0 ) || ( !value.mValid ) )
+			continue;
+
+		// a preset replaces every feature including the ones edited meanwhile
+		if ( presetLoaded )
+		{
+			const dc1394feature_modes_t &modes = mFeatureSet.feature[ i ].modes;
+			for ( uint32_t j = 0; j < modes.num; j++ )
+			{
+				if ( modes.modes[ j ] == value.mMode )
+					mFeatures[ i ].mMode = j;
+			}
+			mFeatures[ i ].mIsOn = value.mIsOn;
+			mFeatures[ i ].mValue = value.mValue;
+			mFeatures[ i ].mBUValue = value.mBUValue;
+			mFeatures[ i ].mRVValue = value.mRVValue;
+			mFeatures[ i ].mIsAbsolute = value.mIsAbsolute;
+			float scale;
+			getAbsoluteUnit( mFeatures[ i ].mId, &scale );
+			mFeatures[ i ].mAbsValue = value.mAbsValue * scale;
+			mPrevFeatures[ i ] = mFeatures[ i ];
+			updateReadonly( i );
+			continue;
+		}
+
+		// only the values the camera controls, edits not written yet win
+		const dc1394feature_modes_t &modes = mFeatureSet.feature[ i ].modes;
+		dc1394feature_mode_t mode = modes.modes[ mFeatures[ i ].mMode ];
+		if ( ( mode == DC1394_FEATURE_MODE_MANUAL ) || ( !( mFeatures[ i ] == mPrevFeatures[ i ] ) ) )
+			continue;
+
+		// the camera clears one-push auto when it is done, values read before the mode was set are older than that
+		if ( ( mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO ) && ( value.mMode == DC1394_FEATURE_MODE_MANUAL ) )
+		{
+			if ( value.mTime <= mModeTimes[ i ] )
+				continue;
+			for ( uint32_t j = 0; j < modes.num; j++ )
+			{
+				if ( modes.modes[ j ] == DC1394_FEATURE_MODE_MANUAL )
+					mFeatures[ i ].mMode = mPrevFeatures[ i ].mMode = j;
+			}
+			updateReadonly( i );
+		}
+
+		mFeatures[ i ].mValue = mPrevFeatures[ i ].mValue = value.mValue;
+		mFeatures[ i ].mBUValue = mPrevFeatures[ i ].mBUValue = value.mBUValue;
+		mFeatures[ i ].mRVValue = mPrevFeatures[ i ].mRVValue = value.mRVValue;
+		if ( value.mIsAbsolute )
+		{
+			float scale;
+			getAbsoluteUnit( mFeatures[ i ].mId, &scale );
+			mFeatures[ i ].mAbsValue = mPrevFeatures[ i ].mAbsValue = value.mAbsValue * scale;
+		}
+	}
+}
+
+void Capture1394Params::Obj::updateFeatureStatus()
+{
+	// failures are kept until the feature is written successfully
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		if ( ( mFeatures[ i ].mId != 0 ) &&
+			 ( mFeatureControl->getStatus( mFeatures[ i ].mId ) == FeatureControl::STATUS_FAILED ) )
+		{
+			mFeatureStatus = mFeatures[ i ].mName + " failed: " +
+				dc1394_error_get_string( mFeatureControl->getError( mFeatures[ i ].mId ) );
+			return;
+		}
+	}
+
+	switch ( mFeatureControl->getRequestStatus() )
+	{
+		case FeatureControl::STATUS_PENDING:
+			mFeatureStatus = "preset or config pending";
+			return;
+		case FeatureControl::STATUS_FAILED:
+			mFeatureStatus = string( "preset or config failed: " ) + dc1394_error_get_string( mFeatureControl->getRequestError() );
+			return;
+		default:
+			break;
+	}
+
+	size_t numPending = mFeatureControl->getNumPending();
+	if ( numPending > 0 )
+	{
+		stringstream status;
+		status << numPending << " pending";
+		mFeatureStatus = status.str();
+	}
+	else
+	{
+		mFeatureStatus = "done";
 	}
 }
 
@@ -17,6 +17,8 @@
 
 #pragma once
 
+#include <chrono>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -25,6 +27,7 @@
 #include "cinder/params/Params.h"
 
 #include "Capture1394.h"
+#include "FeatureControl.h"
 
 namespace cinder { namespace app {
 	class Window;
@@ -47,9 +50,23 @@ class Capture1394Params
 
 		ci::params::InterfaceGlRef getParams() const { return mObj->mParams; }
 
+		/** Reads a config written by write(). The capture and the video mode are switched first, then the features are
+		 *  compared to the state of the camera and only the differences are written, in one register batch. Returns
+		 *  without waiting for the camera, update() shows the number of features changed and the load time in the params
+		 *  once the camera has the config. Features without the absolute attributes, as written before they existed, keep
+		 *  their absolute control and value.
+		 */
 		void read( const ci::DataSourceRef &source );
+
 		void write( const ci::DataTargetRef &target );
 
+		//! Saves the features of the current capture to preset \a channel, see FeatureControl::savePreset().
+		void savePreset( uint32_t channel );
+		/** Loads preset \a channel of the current capture in a single command if the camera has memory channels. The capture
+		 *  is stopped for the load, update() starts it again with the video mode selected in the params when the load is done.
+		 */
+		void loadPreset( uint32_t channel );
+
 	protected:
 		Capture1394Params();
 		Capture1394Params( const cinder::app::WindowRef &window );
@@ -57,7 +74,7 @@ class Capture1394Params
 		struct Feature
 		{
 			Feature() : mId( (dc1394feature_t)0 ), mIsOn( false ), mMode( 0 ), mValue( 0 ),
-						mBUValue( 0 ), mRVValue( 0 )
+						mBUValue( 0 ), mRVValue( 0 ), mIsAbsolute( false ), mAbsValue( 0.0f )
 			{}
 
 			std::string mName;
@@ -67,6 +84,9 @@ class Capture1394Params
 			int mValue;
 			int mBUValue;
 			int mRVValue;
+			bool mIsAbsolute;
+			//! The absolute value in the units of getAbsoluteUnit().
+			float mAbsValue;
 
 			bool operator==( const Feature &rhs )
 			{
@@ -75,21 +95,34 @@ class Capture1394Params
 					   ( mMode == rhs.mMode ) &&
 					   ( mValue == rhs.mValue ) &&
 					   ( mBUValue == rhs.mBUValue ) &&
-					   ( mRVValue == rhs.mRVValue );
+					   ( mRVValue == rhs.mRVValue ) &&
+					   ( mIsAbsolute == rhs.mIsAbsolute ) &&
+					   ( mAbsValue == rhs.mAbsValue );
 			}
 		};
 
+		/** Returns the unit the absolute value of \a feature is shown in and the \a scale from the IIDC unit to it. The shutter
+		 *  and the trigger delay are shown in microseconds instead of seconds, the rest in their IIDC units.
+		 */
+		static std::string getAbsoluteUnit( dc1394feature_t feature, float *scale );
+
 		struct Obj
 		{
 			Obj( const cinder::app::WindowRef &window );
 			~Obj();
 
 			void update();
+			//! Switches to the current capture and video mode if they changed.
+			void updateCapture();
+			//! Loads preset \a channel, stopping the capture around memory channel loads.
+			void loadPreset( uint32_t channel );
 
 			std::vector< Capture1394Ref > mCaptures;
 			std::vector< std::string > mDeviceNames;
 			int mCurrentCapture;
 			int mVideoMode;
+			int mPrevCapture;
+			int mPrevVideoMode;
 
 			void setupParams();
 			ci::params::InterfaceGlRef mParams;
@@ -97,6 +130,39 @@ class Capture1394Params
 			dc1394featureset_t mFeatureSet;
 			Capture1394Params::Feature mFeatures[ DC1394_FEATURE_NUM ];
 			Capture1394Params::Feature mPrevFeatures[ DC1394_FEATURE_NUM ];
+
+			//! Writes the features of the current capture off the ui thread.
+			FeatureControlRef mFeatureControl;
+			//! The feature controls of the devices shown so far by their GUIDs, they keep the host presets.
+			std::map< Capture1394::DeviceIdentifier, FeatureControlRef > mFeatureControls;
+			//! Progress or the last error of the feature writes shown in the params.
+			std::string mFeatureStatus;
+			//! Result and duration of the last read().
+			std::string mConfigStatus;
+			//! Feature control still writing the config of the last read(), null once its result is shown.
+			FeatureControlRef mConfigFeatureControl;
+			std::chrono::steady_clock::time_point mConfigStartTime;
+			void updateFeatureStatus();
+			/** Copies the auto and one-push auto mode values read back by the feature control into the params, and every feature
+			 *  after a preset load. A finished one-push auto returns the feature to manual mode.
+			 */
+			void updateAutoFeatures();
+			//! When the mode of each feature was last changed in the params, older read backs do not change it.
+			std::chrono::steady_clock::time_point mModeTimes[ DC1394_FEATURE_NUM ];
+			uint64_t mSnapshotSequence;
+			uint64_t mNumPresetLoads;
+			//! Makes the values of feature \a i readonly in auto mode.
+			void updateReadonly( int i );
+
+			int mPreset;
+			//! Capture stopped for a memory channel load until the load is done, null without a pending load.
+			Capture1394Ref mPresetCapture;
+			FeatureControlRef mPresetFeatureControl;
+			std::chrono::steady_clock::time_point mPresetStartTime;
+			//! Whether the capture is started again after the load.
+			bool mPresetRestart;
+			//! Shows the result of the config load and finishes the memory channel load once they are done or timed out.
+			void updateRequests();
 		};
 
 		std::shared_ptr< Obj > mObj;
@@ -0,0 +1,412 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "CaptureGroup.h"
+#include "RegisterBatch.h"
+
+using namespace std;
+
+namespace mndl {
+
+//! Offset of the software trigger register, see IIDC 1.31 chapter 4.11.
+static const uint64_t kSoftwareTriggerOffset = 0x62c;
+
+//! Returns the IIDC number of \a mode in the trigger mode register, the vendor specific modes are 14 and 15.
+static uint32_t getTriggerModeNumber( dc1394trigger_mode_t mode )
+{
+	if ( mode >= DC1394_TRIGGER_MODE_14 )
+		return 14 + ( mode - DC1394_TRIGGER_MODE_14 );
+	return mode - DC1394_TRIGGER_MODE_MIN;
+}
+
+//! Returns the IIDC number of \a source in the trigger mode register, the software trigger is 7.
+static uint32_t getTriggerSourceNumber( dc1394trigger_source_t source )
+{
+	if ( source == DC1394_TRIGGER_SOURCE_SOFTWARE )
+		return 7;
+	return source - DC1394_TRIGGER_SOURCE_MIN;
+}
+
+FrameSetAssembler::FrameSetAssembler( size_t numCameras, uint64_t tolerance, size_t maxPending ) :
+	mPending( numCameras ), mTolerance( tolerance ), mMaxPending( maxPending ),
+	mNumFrameSets( 0 ), mNumIncompleteFrameSets( 0 )
+{}
+
+void FrameSetAssembler::reset()
+{
+	for ( auto it = mPending.begin(); it != mPending.end(); ++it )
+		it->clear();
+	mNumFrameSets = 0;
+	mNumIncompleteFrameSets = 0;
+}
+
+int64_t FrameSetAssembler::getTime( const Frame &frame )
+{
+	return chrono::duration_cast< chrono::microseconds >( frame.mFrameInfo.mExposureTime.time_since_epoch() ).count();
+}
+
+bool FrameSetAssembler::push( size_t camera, const Frame &frame, vector< Frame > *frameSet )
+{
+	mPending[ camera ].push_back( frame );
+	while ( mPending[ camera ].size() > mMaxPending )
+		expireOldest();
+
+	for ( ;; )
+	{
+		int64_t oldest = numeric_limits< int64_t >::max();
+		int64_t newest = numeric_limits< int64_t >::min();
+		for ( auto it = mPending.cbegin(); it != mPending.cend(); ++it )
+		{
+			if ( it->empty() )
+				return false;
+			int64_t time = getTime( it->front() );
+			oldest = min( oldest, time );
+			newest = max( newest, time );
+		}
+
+		// a camera has moved past the oldest set, it will not be completed anymore
+		if ( newest - oldest > static_cast< int64_t >( mTolerance ) )
+		{
+			expireOldest();
+			continue;
+		}
+
+		frameSet->clear();
+		for ( auto it = mPending.begin(); it != mPending.end(); ++it )
+		{
+			frameSet->push_back( it->front() );
+			it->pop_front();
+		}
+		mNumFrameSets++;
+		return true;
+	}
+}
+
+void FrameSetAssembler::expireOldest()
+{
+	int64_t oldest = numeric_limits< int64_t >::max();
+	for ( auto it = mPending.cbegin(); it != mPending.cend(); ++it )
+	{
+		if ( !it->empty() )
+			oldest = min( oldest, getTime( it->front() ) );
+	}
+	if ( oldest == numeric_limits< int64_t >::max() )
+		return;
+
+	// the frames of the other cameras belonging to the same set go with it
+	for ( auto it = mPending.begin(); it != mPending.end(); ++it )
+	{
+		if ( ( !it->empty() ) && ( getTime( it->front() ) - oldest <= static_cast< int64_t >( mTolerance ) ) )
+			it->pop_front();
+	}
+	mNumIncompleteFrameSets++;
+}
+
+CaptureGroup::CaptureGroup( const vector< Capture1394Ref > &captures, double tolerance ) :
+	mObj( shared_ptr< Obj >( new Obj( captures, tolerance ) ) )
+{}
+
+uint64_t CaptureGroup::getNumFrameSets() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mAssembler.getNumFrameSets();
+}
+
+uint64_t CaptureGroup::getNumIncompleteFrameSets() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mAssembler.getNumIncompleteFrameSets();
+}
+
+// the encodings change the same bits as dc1394_feature_set_value(), _set_mode() and dc1394_external_trigger_set_*()
+
+bool CaptureGroup::setFeatureValue( dc1394feature_t feature, uint32_t value )
+{
+	return mObj->control( RegisterBatch::getFeatureValueOffset( feature ), [ feature, value ]( uint32_t reg )
+			{
+				if ( feature == DC1394_FEATURE_TEMPERATURE )
+					return ( reg & ~0x00fff000 ) | ( ( value & 0xfff ) << 12 );
+				return ( reg & ~0x00000fff ) | ( value & 0xfff );
+			} );
+}
+
+bool CaptureGroup::setFeatureMode( dc1394feature_t feature, dc1394feature_mode_t mode )
+{
+	return mObj->control( RegisterBatch::getFeatureValueOffset( feature ), [ mode ]( uint32_t reg )
+			{
+				reg &= ~( 0x01000000 | 0x04000000 );
+				if ( mode == DC1394_FEATURE_MODE_AUTO )
+					reg |= 0x01000000;
+				else if ( mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO )
+					reg |= 0x04000000;
+				return reg;
+			} );
+}
+
+bool CaptureGroup::setTriggerPower( bool on )
+{
+	return mObj->control( RegisterBatch::getFeatureValueOffset( DC1394_FEATURE_TRIGGER ), [ on ]( uint32_t reg )
+			{ return on ? ( reg | 0x02000000 ) : ( reg & ~0x02000000 ); } );
+}
+
+bool CaptureGroup::setTriggerMode( dc1394trigger_mode_t mode )
+{
+	uint32_t number = getTriggerModeNumber( mode );
+	return mObj->control( RegisterBatch::getFeatureValueOffset( DC1394_FEATURE_TRIGGER ), [ number ]( uint32_t reg )
+			{ return ( reg & ~0x000f0000 ) | ( number << 16 ); } );
+}
+
+bool CaptureGroup::setTriggerSource( dc1394trigger_source_t source )
+{
+	uint32_t number = getTriggerSourceNumber( source );
+	return mObj->control( RegisterBatch::getFeatureValueOffset( DC1394_FEATURE_TRIGGER ), [ number ]( uint32_t reg )
+			{ return ( reg & ~0x00e00000 ) | ( number << 21 ); } );
+}
+
+bool CaptureGroup::softwareTrigger()
+{
+	// a write only register, the trigger fires on writing 1 to its top bit
+	return mObj->control( kSoftwareTriggerOffset, []( uint32_t ) { return 0x80000000u; }, false );
+}
+
+CaptureGroup::Obj::Obj( const vector< Capture1394Ref > &captures, double tolerance ) :
+	mCaptures( captures ),
+	mAssembler( captures.size(), static_cast< uint64_t >( tolerance * 1000000.0 ) )
+{
+	mBroadcastEnabled = true;
+	if ( mCaptures.empty() )
+		throw Capture1394Exc( "Capture group without cameras." );
+}
+
+CaptureGroup::Obj::~Obj()
+{
+	try
+	{
+		stop();
+	}
+	catch ( const Capture1394Exc & )
+	{
+	}
+}
+
+void CaptureGroup::Obj::start()
+{
+	{
+		lock_guard< mutex > lock( mMutex );
+		mAssembler.reset();
+		mBuffers.assign( mCaptures.size(), vector< ci::Surface8u >() );
+		mDeliveries.assign( mCaptures.size(), vector< int >() );
+	}
+
+	for ( size_t i = 0; i < mCaptures.size(); i++ )
+	{
+		if ( mCaptures[ i ]->isCapturing() )
+			mCaptures[ i ]->stop();
+		mCaptures[ i ]->setFrameCallback( bind( &CaptureGroup::Obj::frameCallback, this, i, placeholders::_1 ) );
+	}
+
+	// the cameras are started back to back after setting up the callbacks to keep the skew between them small
+	for ( auto it = mCaptures.begin(); it != mCaptures.end(); ++it )
+		( *it )->start();
+}
+
+void CaptureGroup::Obj::stop()
+{
+	for ( auto it = mCaptures.begin(); it != mCaptures.end(); ++it )
+	{
+		if ( ( *it )->isCapturing() )
+			( *it )->stop();
+		( *it )->setFrameCallback( Capture1394::FrameFn() );
+	}
+
+	lock_guard< mutex > lock( mMutex );
+	mAssembler.reset();
+}
+
+void CaptureGroup::Obj::setFrameSetCallback( const FrameSetFn &frameSetFn )
+{
+	lock_guard< mutex > lock( mMutex );
+	mFrameSetFn = frameSetFn;
+}
+
+int CaptureGroup::Obj::findFreeBuffer( size_t camera ) const
+{
+	const vector< ci::Surface8u > &buffers = mBuffers[ camera ];
+	const deque< FrameSetAssembler::Frame > &pending = mAssembler.getPending( camera );
+	for ( size_t i = 0; i < buffers.size(); i++ )
+	{
+		if ( mDeliveries[ camera ][ i ] > 0 )
+			continue;
+
+		bool isPending = false;
+		for ( auto it = pending.cbegin(); it != pending.cend(); ++it )
+			isPending = isPending || ( it->mSurface.getData() == buffers[ i ].getData() );
+		if ( !isPending )
+			return static_cast< int >( i );
+	}
+	return -1;
+}
+
+void CaptureGroup::Obj::frameCallback( size_t camera, const Capture1394::FrameInfo &frameInfo )
+{
+	FrameSetAssembler::Frame frame;
+	frame.mFrameInfo = frameInfo;
+
+	FrameSet frameSet;
+	FrameSetFn frameSetFn;
+	vector< pair< size_t, const uint8_t * > > delivered;
+	{
+		lock_guard< mutex > lock( mMutex );
+
+		// output buffers belong to the application, surface buffers are reused by the capture once this returns
+		if ( !mCaptures[ camera ]->hasOutputBufferProvider() )
+		{
+			vector< ci::Surface8u > &buffers = mBuffers[ camera ];
+			if ( buffers.empty() || ( buffers[ 0 ].getSize() != frameInfo.mSize ) )
+			{
+				// at most every pending frame and a frame of each camera being delivered are held
+				buffers.clear();
+				for ( size_t i = 0; i < mAssembler.getMaxPending() + mCaptures.size() + 1; i++ )
+					buffers.push_back( ci::Surface8u( frameInfo.mSize.x, frameInfo.mSize.y, false, ci::SurfaceChannelOrder::RGB ) );
+				mDeliveries[ camera ].assign( buffers.size(), 0 );
+			}
+
+			int id = findFreeBuffer( camera );
+			if ( id < 0 )
+				return;
+
+			ci::Surface8u &buffer = buffers[ id ];
+			size_t rowBytes = min( static_cast< size_t >( buffer.getRowBytes() ), static_cast< size_t >( frameInfo.mRowBytes ) );
+			for ( int32_t y = 0; y < frameInfo.mSize.y; y++ )
+				memcpy( buffer.getData() + y * buffer.getRowBytes(), frameInfo.mData + y * frameInfo.mRowBytes, rowBytes );
+			frame.mSurface = buffer;
+			frame.mFrameInfo.mData = buffer.getData();
+			frame.mFrameInfo.mRowBytes = buffer.getRowBytes();
+		}
+
+		vector< FrameSetAssembler::Frame > frames;
+		if ( !mAssembler.push( camera, frame, &frames ) )
+			return;
+
+		for ( size_t i = 0; i < frames.size(); i++ )
+		{
+			frameSet.mSurfaces.push_back( frames[ i ].mSurface );
+			frameSet.mFrameInfos.push_back( frames[ i ].mFrameInfo );
+			if ( !frames[ i ].mSurface )
+				continue;
+
+			// the buffers stay reserved until the callback returns
+			for ( size_t j = 0; j < mBuffers[ i ].size(); j++ )
+			{
+				if ( mBuffers[ i ][ j ].getData() == frames[ i ].mSurface.getData() )
+					mDeliveries[ i ][ j ]++;
+			}
+			delivered.push_back( make_pair( i, frames[ i ].mSurface.getData() ) );
+		}
+		frameSetFn = mFrameSetFn;
+	}
+
+	if ( frameSetFn )
+		frameSetFn( frameSet );
+
+	if ( !delivered.empty() )
+	{
+		lock_guard< mutex > lock( mMutex );
+		for ( auto it = delivered.cbegin(); it != delivered.cend(); ++it )
+		{
+			// the pool is reallocated when the frame size changes, the old buffers are freed with their last surface
+			const vector< ci::Surface8u > &buffers = mBuffers[ it->first ];
+			for ( size_t j = 0; j < buffers.size(); j++ )
+			{
+				if ( buffers[ j ].getData() == it->second )
+					mDeliveries[ it->first ][ j ]--;
+			}
+		}
+	}
+}
+
+bool CaptureGroup::Obj::canBroadcast() const
+{
+	if ( ( !mBroadcastEnabled ) || ( mCaptures.size() < 2 ) )
+		return false;
+
+	// every node on the bus executes a broadcast, so the group has to be the whole bus
+	if ( Capture1394::getDevices().size() != mCaptures.size() )
+		return false;
+
+	// the command is written to the register offsets of the first camera
+	Capture1394::Device::NativeLock firstLock = mCaptures[ 0 ]->getDevice()->lockNative();
+	const dc1394camera_t *first = mCaptures[ 0 ]->getDevice()->getNative();
+	for ( auto it = mCaptures.cbegin() + 1; it != mCaptures.cend(); ++it )
+	{
+		Capture1394::Device::NativeLock cameraLock = ( *it )->getDevice()->lockNative();
+		const dc1394camera_t *camera = ( *it )->getDevice()->getNative();
+		if ( ( camera->vendor_id != first->vendor_id ) || ( camera->model_id != first->model_id ) ||
+			 ( camera->command_registers_base != first->command_registers_base ) )
+			return false;
+	}
+	return true;
+}
+
+bool CaptureGroup::Obj::control( uint64_t offset, const EncodeFn &encodeFn, bool readRegister )
+{
+	lock_guard< mutex > lock( mControlMutex );
+
+	// checked before locking the handles, the enumeration of the devices may wait for a reconnect
+	bool broadcast = canBroadcast();
+
+	// a reconnect replacing a handle waits until the command went out to every camera
+	vector< Capture1394::Device::NativeLock > nativeLocks;
+	for ( auto it = mCaptures.begin(); it != mCaptures.end(); ++it )
+		nativeLocks.push_back( ( *it )->getDevice()->lockNative() );
+
+	if ( broadcast )
+	{
+		// reads get no response while broadcasting, the register is read from the first camera before turning it on
+		dc1394camera_t *camera = mCaptures[ 0 ]->getDevice()->getNative();
+		uint32_t reg = 0;
+		if ( ( ( !readRegister ) || ( dc1394_get_control_register( camera, offset, &reg ) == DC1394_SUCCESS ) ) &&
+			 ( dc1394_camera_set_broadcast( camera, DC1394_TRUE ) == DC1394_SUCCESS ) )
+		{
+			dc1394error_t err = dc1394_set_control_register( camera, offset, encodeFn( reg ) );
+			dc1394_camera_set_broadcast( camera, DC1394_FALSE );
+			if ( err == DC1394_SUCCESS )
+				return true;
+		}
+	}
+
+	// one by one, a failing camera does not keep the others from being updated
+	dc1394error_t firstErr = DC1394_SUCCESS;
+	for ( auto it = mCaptures.begin(); it != mCaptures.end(); ++it )
+	{
+		dc1394camera_t *camera = ( *it )->getDevice()->getNative();
+		uint32_t reg = 0;
+		dc1394error_t err = readRegister ? dc1394_get_control_register( camera, offset, &reg ) : DC1394_SUCCESS;
+		if ( err == DC1394_SUCCESS )
+			err = dc1394_set_control_register( camera, offset, encodeFn( reg ) );
+		if ( firstErr == DC1394_SUCCESS )
+			firstErr = err;
+	}
+	Capture1394::checkError( firstErr );
+	return false;
+}
+
+} // namespace mndl
@@ -0,0 +1,186 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "cinder/Cinder.h"
+#include "cinder/Surface.h"
+#include "cinder/Thread.h"
+
+#include "Capture1394.h"
+
+namespace mndl {
+
+/** Matches the frames of several cameras into sets by their estimated exposure times, see Capture1394::FrameInfo::mExposureTime.
+ *  Not thread-safe, independent of the cameras.
+ */
+class FrameSetAssembler
+{
+	public:
+		struct Frame
+		{
+			ci::Surface8u mSurface;
+			Capture1394::FrameInfo mFrameInfo;
+		};
+
+		//! Frames of \a numCameras cameras are matched if their exposure times are within \a tolerance microseconds.
+		FrameSetAssembler( size_t numCameras = 0, uint64_t tolerance = 2000, size_t maxPending = 4 );
+
+		//! Drops the pending frames and resets the counters.
+		void reset();
+
+		/** Adds a frame of camera \a camera. Returns true and fills \a frameSet with one frame per camera if it completed a set.
+		 *  A set is given up once a camera has moved past it or a camera has more than the maximum pending frames, its frames
+		 *  are dropped and it is counted as one incomplete set.
+		 */
+		bool push( size_t camera, const Frame &frame, std::vector< Frame > *frameSet );
+
+		uint64_t getNumFrameSets() const { return mNumFrameSets; }
+		uint64_t getNumIncompleteFrameSets() const { return mNumIncompleteFrameSets; }
+
+		size_t getMaxPending() const { return mMaxPending; }
+		//! Returns the frames of \a camera waiting for the other cameras.
+		const std::deque< Frame > & getPending( size_t camera ) const { return mPending[ camera ]; }
+
+		//! Returns the exposure time of \a frame in microseconds, the time the frames are matched by.
+		static int64_t getTime( const Frame &frame );
+
+	protected:
+		//! Drops the oldest pending set, the frames within the tolerance of the oldest pending frame.
+		void expireOldest();
+
+		std::vector< std::deque< Frame > > mPending;
+		uint64_t mTolerance;
+		size_t mMaxPending;
+		uint64_t mNumFrameSets;
+		uint64_t mNumIncompleteFrameSets;
+};
+
+typedef std::shared_ptr< class CaptureGroup > CaptureGroupRef;
+
+//! Captures from several cameras together and delivers their frames in timestamp-aligned sets.
+class CaptureGroup
+{
+	public:
+		/** One frame per camera, in the order of the captures of the group. The surfaces are copies in buffers of the group,
+		 *  which are reused once the callback returns. With an output buffer provider the surfaces are empty and the
+		 *  \a mData of the frame infos point to the output buffers, which must not be reused before their set is delivered.
+		 */
+		struct FrameSet
+		{
+			std::vector< ci::Surface8u > mSurfaces;
+			std::vector< Capture1394::FrameInfo > mFrameInfos;
+		};
+
+		//! Called on the capture thread of the camera completing the set.
+		typedef std::function< void ( const FrameSet &frameSet ) > FrameSetFn;
+
+		//! Frames are grouped if their estimated exposure times are within \a tolerance seconds.
+		static CaptureGroupRef create( const std::vector< Capture1394Ref > &captures, double tolerance = 0.002 )
+		{ return CaptureGroupRef( new CaptureGroup( captures, tolerance ) ); }
+
+		~CaptureGroup() {}
+
+		//! Starts capturing on all cameras. The frames of the captures should only be accessed through the group.
+		void start() { mObj->start(); }
+		//! Stops capturing on all cameras.
+		void stop() { mObj->stop(); }
+
+		void setFrameSetCallback( const FrameSetFn &frameSetFn ) { mObj->setFrameSetCallback( frameSetFn ); }
+
+		const std::vector< Capture1394Ref > & getCaptures() const { return mObj->mCaptures; }
+
+		/** Enables broadcasting the control commands below, so all cameras change in one bus transaction. Broadcast is only used
+		 *  if the group contains every camera found and they are the same model, otherwise the cameras are written one by one.
+		 *  A broadcast writes the whole register as read from the first camera, so the settings sharing it, like the mode and
+		 *  the value of a feature, are copied from the first camera. Turn it off if the cameras are on more than one bus.
+		 *  Default is on.
+		 */
+		void setBroadcastEnabled( bool enable ) { mObj->mBroadcastEnabled = enable; }
+		bool getBroadcastEnabled() const { return mObj->mBroadcastEnabled; }
+
+		//! Sets \a feature to \a value on all cameras. Returns true if the command was broadcast. Throws Capture1394Exc on failure.
+		bool setFeatureValue( dc1394feature_t feature, uint32_t value );
+		//! Sets the mode of \a feature on all cameras. Returns true if the command was broadcast.
+		bool setFeatureMode( dc1394feature_t feature, dc1394feature_mode_t mode );
+		//! Turns the external trigger on or off on all cameras. Returns true if the command was broadcast.
+		bool setTriggerPower( bool on );
+		//! Sets the trigger mode of all cameras. Returns true if the command was broadcast.
+		bool setTriggerMode( dc1394trigger_mode_t mode );
+		//! Sets the trigger source of all cameras. Returns true if the command was broadcast.
+		bool setTriggerSource( dc1394trigger_source_t source );
+		//! Fires the software trigger of all cameras. Returns true if the command was broadcast.
+		bool softwareTrigger();
+
+		//! Returns the number of complete frame sets delivered since start().
+		uint64_t getNumFrameSets() const;
+		//! Returns the number of sets given up for not having a frame from every camera since start().
+		uint64_t getNumIncompleteFrameSets() const;
+
+	protected:
+		CaptureGroup( const std::vector< Capture1394Ref > &captures, double tolerance );
+
+		struct Obj
+		{
+			Obj( const std::vector< Capture1394Ref > &captures, double tolerance );
+			~Obj();
+
+			void start();
+			void stop();
+
+			void setFrameSetCallback( const FrameSetFn &frameSetFn );
+			void frameCallback( size_t camera, const Capture1394::FrameInfo &frameInfo );
+
+			//! Returns whether a broadcast from the first camera reaches exactly the cameras of the group.
+			bool canBroadcast() const;
+			//! Returns the new value of a control register from its current value.
+			typedef std::function< uint32_t ( uint32_t reg ) > EncodeFn;
+			/** Writes the register at \a offset once with broadcast on or for every camera if broadcasting is not possible or fails.
+			 *  The value is encoded from the register of the first camera when broadcasting, from the register of each camera
+			 *  otherwise and from 0 without \a readRegister.
+			 */
+			bool control( uint64_t offset, const EncodeFn &encodeFn, bool readRegister = true );
+
+			/** Returns the index of a buffer of \a camera neither pending nor being delivered, or -1. Needs mMutex. Only the capture
+			 *  thread of \a camera takes its buffers, so the buffer stays free until it is pushed.
+			 */
+			int findFreeBuffer( size_t camera ) const;
+
+			std::vector< Capture1394Ref > mCaptures;
+			FrameSetAssembler mAssembler;
+			//! Copies of the pending frames of each camera, allocated with the first frame and whenever the frame size changes.
+			std::vector< std::vector< ci::Surface8u > > mBuffers;
+			//! Number of sets being delivered with each buffer.
+			std::vector< std::vector< int > > mDeliveries;
+			FrameSetFn mFrameSetFn;
+			mutable std::mutex mMutex;
+
+			std::atomic< bool > mBroadcastEnabled;
+			//! Serializes the control commands, the broadcast flag is a state of the camera handle.
+			std::mutex mControlMutex;
+		};
+
+		std::shared_ptr< Obj > mObj;
+};
+
+} // namespace mndl
@@ -0,0 +1,181 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "ClockModel.h"
+
+using namespace std;
+
+namespace mndl {
+
+//! The seconds field of the cycle timer counts to 128.
+static const double kCycleTimerPeriod = 128.0;
+//! Steady state gains of the frame time filter, the period gain is the Benedict-Bordner choice for the phase gain.
+static const double kFramePhaseGain = 0.05;
+static const double kFramePeriodGain = kFramePhaseGain * kFramePhaseGain / ( 2.0 - kFramePhaseGain );
+//! Frames off the period in a row that start tracking again.
+static const size_t kMaxOffPeriodFrames = 3;
+
+ClockModel::ClockModel( size_t maxSamples ) :
+	mSamples( std::max< size_t >( maxSamples, 2 ) ), mMaxSamples( std::max< size_t >( maxSamples, 2 ) )
+{
+	reset();
+}
+
+void ClockModel::reset()
+{
+	mNextSample = 0;
+	mNumSamples = 0;
+	mLastBus = 0.0;
+	mBusWraps = 0.0;
+	mHostOrigin = 0;
+	mHostFit = Fit();
+	mSteadyFit = Fit();
+	mFramePhase = 0.0;
+	mFramePeriod = 0.0;
+	mNumTrackedFrames = 0;
+	mNumOffPeriodFrames = 0;
+}
+
+double ClockModel::cycleTimerToSeconds( uint32_t cycleTimer )
+{
+	// 7 bits seconds, 13 bits of 8000 cycles per second, 12 bits of 3072 offset ticks per cycle
+	uint32_t seconds = cycleTimer >> 25;
+	uint32_t cycles = ( cycleTimer >> 12 ) & 0x1fff;
+	uint32_t offset = cycleTimer & 0xfff;
+	return seconds + cycles / 8000.0 + offset / ( 8000.0 * 3072.0 );
+}
+
+void ClockModel::addSample( uint32_t cycleTimer, uint64_t localTime, chrono::steady_clock::time_point steadyTime )
+{
+	if ( mNumSamples == 0 )
+	{
+		mHostOrigin = localTime;
+		mSteadyOrigin = steadyTime;
+		mBusWraps = -cycleTimerToSeconds( cycleTimer );
+	}
+
+	// unwrap the cycle timer, the samples are expected to be less than half a period apart
+	double bus = cycleTimerToSeconds( cycleTimer ) + mBusWraps;
+	if ( ( mNumSamples > 0 ) && ( bus < mLastBus - kCycleTimerPeriod / 2 ) )
+	{
+		mBusWraps += kCycleTimerPeriod;
+		bus += kCycleTimerPeriod;
+	}
+	mLastBus = bus;
+
+	Sample sample;
+	sample.mBus = bus;
+	sample.mHost = ( static_cast< int64_t >( localTime - mHostOrigin ) ) / 1000000.0;
+	sample.mSteady = chrono::duration< double >( steadyTime - mSteadyOrigin ).count();
+	mSamples[ mNextSample ] = sample;
+	mNextSample = ( mNextSample + 1 ) % mMaxSamples;
+	mNumSamples = std::min( mNumSamples + 1, mMaxSamples );
+
+	fit();
+}
+
+void ClockModel::fit()
+{
+	if ( !isValid() )
+		return;
+
+	double meanBus = 0.0, meanHost = 0.0, meanSteady = 0.0;
+	// the order of the samples does not matter for the fit
+	auto end = mSamples.cbegin() + mNumSamples;
+	for ( auto it = mSamples.cbegin(); it != end; ++it )
+	{
+		meanBus += it->mBus;
+		meanHost += it->mHost;
+		meanSteady += it->mSteady;
+	}
+	meanBus /= mNumSamples;
+	meanHost /= mNumSamples;
+	meanSteady /= mNumSamples;
+
+	double varBus = 0.0, covHost = 0.0, covSteady = 0.0;
+	for ( auto it = mSamples.cbegin(); it != end; ++it )
+	{
+		double dBus = it->mBus - meanBus;
+		varBus += dBus * dBus;
+		covHost += dBus * ( it->mHost - meanHost );
+		covSteady += dBus * ( it->mSteady - meanSteady );
+	}
+
+	// samples from the same bus time do not tell the rate, assume the clocks run at the same speed
+	mHostFit.mSlope = ( varBus > 0.0 ) ? covHost / varBus : 1.0;
+	mHostFit.mOffset = meanHost - mHostFit.mSlope * meanBus;
+	mSteadyFit.mSlope = ( varBus > 0.0 ) ? covSteady / varBus : 1.0;
+	mSteadyFit.mOffset = meanSteady - mSteadyFit.mSlope * meanBus;
+}
+
+double ClockModel::hostToBus( uint64_t localTime ) const
+{
+	double host = ( static_cast< int64_t >( localTime - mHostOrigin ) ) / 1000000.0;
+	return ( host - mHostFit.mOffset ) / mHostFit.mSlope;
+}
+
+chrono::steady_clock::time_point ClockModel::busToSteady( double busTime ) const
+{
+	double steady = mSteadyFit.mOffset + mSteadyFit.mSlope * busTime;
+	return mSteadyOrigin + chrono::duration_cast< chrono::steady_clock::duration >( chrono::duration< double >( steady ) );
+}
+
+double ClockModel::smoothFrameTime( double busTime )
+{
+	if ( ( mNumTrackedFrames == 1 ) && ( busTime > mFramePhase ) )
+	{
+		// a frame dropped between the first two doubles the period, the next frames are off it and tracking starts again
+		mFramePeriod = busTime - mFramePhase;
+		mFramePhase = busTime;
+		mNumTrackedFrames = 2;
+		return busTime;
+	}
+	if ( mNumTrackedFrames < 2 )
+	{
+		mFramePhase = busTime;
+		mNumTrackedFrames = 1;
+		return busTime;
+	}
+
+	double frames = std::max( 1.0, std::floor( ( busTime - mFramePhase ) / mFramePeriod + 0.5 ) );
+	double predicted = mFramePhase + frames * mFramePeriod;
+	double residual = busTime - predicted;
+	if ( std::abs( residual ) > mFramePeriod / 4 )
+	{
+		if ( ++mNumOffPeriodFrames >= kMaxOffPeriodFrames )
+		{
+			mFramePhase = busTime;
+			mNumTrackedFrames = 1;
+			mNumOffPeriodFrames = 0;
+		}
+		return busTime;
+	}
+	mNumOffPeriodFrames = 0;
+
+	// the gains of a least squares fit of the frames so far, until they fall to the steady state ones
+	double n = static_cast< double >( ++mNumTrackedFrames );
+	double phaseGain = std::max( kFramePhaseGain, 2.0 * ( 2.0 * n - 1.0 ) / ( n * ( n + 1.0 ) ) );
+	double periodGain = std::max( kFramePeriodGain, 6.0 / ( n * ( n + 1.0 ) ) );
+	mFramePhase = predicted + phaseGain * residual;
+	mFramePeriod += periodGain * residual / frames;
+	return mFramePhase;
+}
+
+} // namespace mndl
@@ -0,0 +1,101 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+
+#include "cinder/Cinder.h"
+
+namespace mndl {
+
+/** Linear model of the 1394 bus clock against the host clock of the frame timestamps and the steady clock,
+ *  fitted to dc1394_read_cycle_timer() samples. The model maps the clocks, it does not remove the latency jitter of
+ *  single timestamps, smoothFrameTime() does that for periodic frames. Not thread-safe, independent of the cameras.
+ */
+class ClockModel
+{
+	public:
+		//! The fit uses the last \a maxSamples samples, their storage is allocated up front, adding a sample never allocates.
+		ClockModel( size_t maxSamples = 32 );
+
+		void reset();
+
+		//! Adds a \a cycleTimer and \a localTime pair read by dc1394_read_cycle_timer() at \a steadyTime.
+		void addSample( uint32_t cycleTimer, uint64_t localTime, std::chrono::steady_clock::time_point steadyTime );
+
+		//! Returns whether there are enough samples for the conversions.
+		bool isValid() const { return mNumSamples >= 2; }
+
+		//! Returns the bus time in seconds of the host time \a localTime in microseconds.
+		double hostToBus( uint64_t localTime ) const;
+		//! Returns the steady clock time of the bus time \a busTime in seconds.
+		std::chrono::steady_clock::time_point busToSteady( double busTime ) const;
+
+		/** Returns the bus time \a busTime of the next frame of a free running capture smoothed against the frame period,
+		 *  which the model tracks from the frames. Dropped frames keep the period, frames off the period are returned
+		 *  unchanged and a few of them in a row start tracking again.
+		 */
+		double smoothFrameTime( double busTime );
+
+		//! Returns the time of the cycle timer register in seconds, it wraps around every 128 seconds.
+		static double cycleTimerToSeconds( uint32_t cycleTimer );
+
+	protected:
+		//! Times relative to the first sample in seconds.
+		struct Sample
+		{
+			double mBus;
+			double mHost;
+			double mSteady;
+		};
+
+		//! y = mOffset + mSlope * bus
+		struct Fit
+		{
+			Fit() : mOffset( 0.0 ), mSlope( 1.0 ) {}
+
+			double mOffset;
+			double mSlope;
+		};
+
+		void fit();
+
+		//! Ring of mMaxSamples samples, the oldest is overwritten at mNextSample once it is full.
+		std::vector< Sample > mSamples;
+		size_t mMaxSamples;
+		size_t mNextSample;
+		size_t mNumSamples;
+
+		double mLastBus;
+		double mBusWraps;
+		uint64_t mHostOrigin;
+		std::chrono::steady_clock::time_point mSteadyOrigin;
+
+		Fit mHostFit;
+		Fit mSteadyFit;
+
+		//! Smoothed bus time of the last frame and the frame period, tracked by an alpha-beta filter.
+		double mFramePhase;
+		double mFramePeriod;
+		//! Frames since tracking started, the first two set the phase and the period.
+		size_t mNumTrackedFrames;
+		size_t mNumOffPeriodFrames;
+};
+
+} // namespace mndl
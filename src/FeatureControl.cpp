@@ -0,0 +1,876 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+#include "FeatureControl.h"
+#include "RegisterBatch.h"
+
+using namespace std;
+
+namespace mndl {
+
+//! Default interval of reading back the auto mode features in seconds.
+static const double kPollInterval = 0.5;
+//! Longest time a memory channel save or load may keep the camera busy in seconds.
+static const double kMemoryTimeout = 2.0;
+//! Interval of checking the memory busy flag in milliseconds.
+static const int kMemoryPollInterval = 5;
+
+//! Relative difference below which two absolute values are the same, the camera rounds them to its register steps.
+static const float kAbsoluteValueTolerance = 1e-4f;
+
+//! Returns whether the absolute values \a a and \a b are the same after the rounding of the camera.
+static bool isSameAbsoluteValue( float a, float b )
+{
+	return std::abs( a - b ) <= kAbsoluteValueTolerance * std::max( std::abs( a ), std::abs( b ) );
+}
+
+//! Decodes the value register \a reg of \a feature.
+static FeatureControl::FeatureValue decodeValueRegister( dc1394feature_t feature, uint32_t reg )
+{
+	FeatureControl::FeatureValue value;
+	// presence inquiry
+	value.mValid = ( reg & 0x80000000 ) != 0;
+	value.mIsOn = ( reg & 0x02000000 ) != 0;
+	value.mIsAbsolute = ( reg & 0x40000000 ) != 0;
+	if ( reg & 0x01000000 )
+		value.mMode = DC1394_FEATURE_MODE_AUTO;
+	else if ( reg & 0x04000000 )
+		value.mMode = DC1394_FEATURE_MODE_ONE_PUSH_AUTO;
+	else
+		value.mMode = DC1394_FEATURE_MODE_MANUAL;
+	if ( feature == DC1394_FEATURE_WHITE_BALANCE )
+	{
+		value.mBUValue = ( reg >> 12 ) & 0xfff;
+		value.mRVValue = reg & 0xfff;
+	}
+	// the temperature register holds the target value in the upper half
+	value.mValue = ( feature == DC1394_FEATURE_TEMPERATURE ) ? ( ( reg >> 12 ) & 0xfff ) : ( reg & 0xfff );
+	return value;
+}
+
+FeatureControl::FeatureControl( const Capture1394::DeviceRef &device, double minInterval ) :
+	mObj( shared_ptr< Obj >( new FeatureControl::Obj( device, minInterval ) ) )
+{}
+
+void FeatureControl::setPower( dc1394feature_t feature, bool on )
+{
+	Write write;
+	write.mFlags = WRITE_POWER;
+	write.mIsOn = on;
+	mObj->queue( feature, write );
+}
+
+void FeatureControl::setMode( dc1394feature_t feature, dc1394feature_mode_t mode )
+{
+	Write write;
+	write.mFlags = WRITE_MODE;
+	write.mMode = mode;
+	mObj->queue( feature, write );
+}
+
+void FeatureControl::setValue( dc1394feature_t feature, uint32_t value )
+{
+	Write write;
+	write.mFlags = WRITE_VALUE;
+	write.mValue = value;
+	mObj->queue( feature, write );
+}
+
+void FeatureControl::setWhiteBalance( uint32_t buValue, uint32_t rvValue )
+{
+	Write write;
+	write.mFlags = WRITE_WHITE_BALANCE;
+	write.mBUValue = buValue;
+	write.mRVValue = rvValue;
+	mObj->queue( DC1394_FEATURE_WHITE_BALANCE, write );
+}
+
+void FeatureControl::setAbsoluteControl( dc1394feature_t feature, bool on )
+{
+	Write write;
+	write.mFlags = WRITE_ABSOLUTE_CONTROL;
+	write.mIsAbsolute = on;
+	mObj->queue( feature, write );
+}
+
+void FeatureControl::setAbsoluteValue( dc1394feature_t feature, float value )
+{
+	Write write;
+	write.mFlags = WRITE_ABSOLUTE_VALUE;
+	write.mAbsValue = value;
+	mObj->queue( feature, write );
+}
+
+FeatureControl::Status FeatureControl::getStatus( dc1394feature_t feature ) const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mFeatures[ feature - DC1394_FEATURE_MIN ].mStatus;
+}
+
+dc1394error_t FeatureControl::getError( dc1394feature_t feature ) const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mFeatures[ feature - DC1394_FEATURE_MIN ].mError;
+}
+
+size_t FeatureControl::getNumPending() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	size_t numPending = 0;
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		if ( mObj->mFeatures[ i ].mStatus == STATUS_PENDING )
+			numPending++;
+	}
+	return numPending;
+}
+
+bool FeatureControl::flush( double timeout )
+{
+	unique_lock< mutex > lock( mObj->mMutex );
+	return mObj->mDoneCond.wait_for( lock, chrono::duration< double >( timeout ), [ this ]()
+			{
+				if ( mObj->mRequestStatus == STATUS_PENDING )
+					return false;
+				for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+				{
+					if ( mObj->mFeatures[ i ].mStatus == STATUS_PENDING )
+						return false;
+				}
+				return true;
+			} );
+}
+
+void FeatureControl::setFeatures( const Snapshot &snapshot )
+{
+	{
+		lock_guard< mutex > lock( mObj->mMutex );
+		for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+		{
+			if ( snapshot.mFeatures[ i ].mValid )
+				mObj->merge( (dc1394feature_t)( i + DC1394_FEATURE_MIN ), mObj->getWrite( i, snapshot.mFeatures[ i ] ) );
+		}
+	}
+	mObj->mCond.notify_all();
+}
+
+uint32_t FeatureControl::getNumMemoryChannels() const
+{
+	Capture1394::Device::NativeLock nativeLock = mObj->mDevice->lockNative();
+	return static_cast< uint32_t >( std::max( mObj->mDevice->getNative()->max_mem_channel, 0 ) );
+}
+
+void FeatureControl::savePreset( uint32_t channel )
+{
+	Obj::Request request;
+	request.mType = Obj::Request::SAVE_PRESET;
+	request.mChannel = channel;
+	mObj->queueRequest( request );
+}
+
+void FeatureControl::loadPreset( uint32_t channel )
+{
+	Obj::Request request;
+	request.mType = Obj::Request::LOAD_PRESET;
+	request.mChannel = channel;
+	mObj->queueRequest( request );
+}
+
+void FeatureControl::applyFeatures( const Snapshot &snapshot )
+{
+	Obj::Request request;
+	request.mType = Obj::Request::APPLY_FEATURES;
+	request.mChannel = 0;
+	request.mSnapshot = shared_ptr< const Snapshot >( new Snapshot( snapshot ) );
+	mObj->queueRequest( request );
+}
+
+size_t FeatureControl::getNumFeaturesApplied() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mNumFeaturesApplied;
+}
+
+FeatureControl::Status FeatureControl::getRequestStatus() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mRequestStatus;
+}
+
+dc1394error_t FeatureControl::getRequestError() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mRequestError;
+}
+
+void FeatureControl::setFeatureSet( const dc1394featureset_t &featureSet )
+{
+	Snapshot snapshot;
+	snapshot.mTime = chrono::steady_clock::now();
+	{
+		lock_guard< mutex > lock( mObj->mMutex );
+		snapshot.mNumPresetLoads = mObj->mSnapshot.mNumPresetLoads;
+		for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+		{
+			const dc1394feature_info_t &feature = featureSet.feature[ i ];
+			mObj->mAvailable[ i ] = ( feature.available == DC1394_TRUE );
+			mObj->mAbsoluteCapable[ i ] = mObj->mAvailable[ i ] && ( feature.absolute_capable == DC1394_TRUE );
+			if ( !feature.available )
+				continue;
+
+			mObj->mModes[ i ] = feature.current_mode;
+			FeatureValue &value = snapshot.mFeatures[ i ];
+			value.mValid = true;
+			value.mIsOn = ( feature.is_on == DC1394_ON );
+			value.mMode = feature.current_mode;
+			value.mValue = feature.value;
+			value.mBUValue = feature.BU_value;
+			value.mRVValue = feature.RV_value;
+			value.mIsAbsolute = ( feature.abs_control == DC1394_ON );
+			value.mAbsValue = feature.abs_value;
+			value.mTime = snapshot.mTime;
+		}
+		mObj->publish( &snapshot );
+	}
+	mObj->mCond.notify_all();
+}
+
+void FeatureControl::setPollInterval( double interval )
+{
+	{
+		lock_guard< mutex > lock( mObj->mMutex );
+		mObj->mPollInterval = chrono::duration_cast< chrono::steady_clock::duration >( chrono::duration< double >( interval ) );
+	}
+	mObj->mCond.notify_all();
+}
+
+uint64_t FeatureControl::getNumPolls() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mNumPolls;
+}
+
+uint64_t FeatureControl::getNumWrites() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mNumWrites;
+}
+
+uint64_t FeatureControl::getNumCoalesced() const
+{
+	lock_guard< mutex > lock( mObj->mMutex );
+	return mObj->mNumCoalesced;
+}
+
+FeatureControl::Obj::Obj( const Capture1394::DeviceRef &device, double minInterval ) :
+	mDevice( device ),
+	mMinInterval( chrono::duration_cast< chrono::steady_clock::duration >( chrono::duration< double >( minInterval ) ) ),
+	mNumWrites( 0 ), mNumCoalesced( 0 ), mQuit( false ),
+	mPollInterval( chrono::duration_cast< chrono::steady_clock::duration >( chrono::duration< double >( kPollInterval ) ) ),
+	mNumPolls( 0 ), mSnapshotVersion( 0 ), mRequestStatus( STATUS_IDLE ), mRequestError( DC1394_SUCCESS ),
+	mNumFeaturesApplied( 0 )
+{
+	store( mSnapshot );
+
+	// nothing is polled until setFeatureSet()
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		mAvailable[ i ] = false;
+		mAbsoluteCapable[ i ] = false;
+		mModes[ i ] = DC1394_FEATURE_MODE_MANUAL;
+	}
+
+	mThread = shared_ptr< thread >( new thread( bind( &FeatureControl::Obj::threadedFunc, this ) ) );
+}
+
+FeatureControl::Obj::~Obj()
+{
+	{
+		lock_guard< mutex > lock( mMutex );
+		mQuit = true;
+	}
+	mCond.notify_all();
+	mThread->join();
+}
+
+void FeatureControl::Obj::queue( dc1394feature_t feature, const Write &write )
+{
+	{
+		lock_guard< mutex > lock( mMutex );
+		merge( feature, write );
+	}
+	mCond.notify_all();
+}
+
+void FeatureControl::Obj::queueRequest( const Request &request )
+{
+	{
+		lock_guard< mutex > lock( mMutex );
+		if ( mRequestStatus != STATUS_PENDING )
+			mRequestError = DC1394_SUCCESS;
+		mRequests.push_back( request );
+		mRequestStatus = STATUS_PENDING;
+	}
+	mCond.notify_all();
+}
+
+void FeatureControl::Obj::merge( dc1394feature_t feature, const Write &write )
+{
+	FeatureState &state = mFeatures[ feature - DC1394_FEATURE_MIN ];
+	Write &pending = state.mPending;
+	if ( pending.mFlags & write.mFlags )
+		mNumCoalesced++;
+	pending.mFlags |= write.mFlags;
+	if ( write.mFlags & WRITE_POWER )
+		pending.mIsOn = write.mIsOn;
+	if ( write.mFlags & WRITE_MODE )
+		pending.mMode = write.mMode;
+	if ( write.mFlags & WRITE_VALUE )
+		pending.mValue = write.mValue;
+	if ( write.mFlags & WRITE_WHITE_BALANCE )
+	{
+		pending.mBUValue = write.mBUValue;
+		pending.mRVValue = write.mRVValue;
+	}
+	if ( write.mFlags & WRITE_ABSOLUTE_CONTROL )
+		pending.mIsAbsolute = write.mIsAbsolute;
+	if ( write.mFlags & WRITE_ABSOLUTE_VALUE )
+		pending.mAbsValue = write.mAbsValue;
+	state.mStatus = STATUS_PENDING;
+}
+
+uint32_t FeatureControl::Obj::encode( dc1394feature_t feature, uint32_t reg, const Write &write )
+{
+	// the same bits dc1394_feature_set_power(), _set_mode(), _set_value() and _whitebalance_set_value() change
+	if ( write.mFlags & WRITE_POWER )
+		reg = write.mIsOn ? ( reg | 0x02000000 ) : ( reg & ~0x02000000 );
+	if ( write.mFlags & WRITE_MODE )
+	{
+		reg &= ~( 0x01000000 | 0x04000000 );
+		if ( write.mMode == DC1394_FEATURE_MODE_AUTO )
+			reg |= 0x01000000;
+		else if ( write.mMode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO )
+			reg |= 0x04000000;
+	}
+	if ( write.mFlags & WRITE_VALUE )
+	{
+		if ( feature == DC1394_FEATURE_TEMPERATURE )
+			reg = ( reg & ~0x00fff000 ) | ( ( write.mValue & 0xfff ) << 12 );
+		else
+			reg = ( reg & ~0x00000fff ) | ( write.mValue & 0xfff );
+	}
+	if ( write.mFlags & WRITE_WHITE_BALANCE )
+		reg = ( reg & 0xff000000 ) | ( ( write.mBUValue & 0xfff ) << 12 ) | ( write.mRVValue & 0xfff );
+	if ( write.mFlags & WRITE_ABSOLUTE_CONTROL )
+		reg = write.mIsAbsolute ? ( reg | 0x40000000 ) : ( reg & ~0x40000000 );
+	return reg;
+}
+
+void FeatureControl::Obj::apply( const vector< pair< int, Write > > &writes, vector< dc1394error_t > *errors )
+{
+	// power, mode and value share the value register, so every feature is one read-modify-write,
+	// with the registers of all the features read in one batch and written in another
+	Capture1394::Device::NativeLock nativeLock = mDevice->lockNative();
+	RegisterBatch batch( mDevice->getNative() );
+	for ( auto it = writes.cbegin(); it != writes.cend(); ++it )
+		batch.read( RegisterBatch::getFeatureValueOffset( (dc1394feature_t)( it->first + DC1394_FEATURE_MIN ) ) );
+	batch.execute();
+	write( &batch, writes, errors );
+}
+
+void FeatureControl::Obj::write( RegisterBatch *batch, const vector< pair< int, Write > > &writes, vector< dc1394error_t > *errors )
+{
+	errors->assign( writes.size(), DC1394_SUCCESS );
+	vector< uint64_t > offsets;
+	for ( size_t i = 0; i < writes.size(); i++ )
+	{
+		dc1394feature_t feature = (dc1394feature_t)( writes[ i ].first + DC1394_FEATURE_MIN );
+		uint64_t offset = RegisterBatch::getFeatureValueOffset( feature );
+		uint32_t reg;
+		if ( !batch->getValue( offset, &reg ) )
+		{
+			( *errors )[ i ] = batch->getError( offset );
+			continue;
+		}
+		batch->write( offset, encode( feature, reg, writes[ i ].second ) );
+		offsets.push_back( offset );
+	}
+	batch->execute();
+
+	for ( size_t i = 0, j = 0; i < writes.size(); i++ )
+	{
+		if ( ( *errors )[ i ] == DC1394_SUCCESS )
+			( *errors )[ i ] = batch->getError( offsets[ j++ ] );
+	}
+
+	// the absolute values live in their own register space, one write each once the absolute control is on
+	for ( size_t i = 0; i < writes.size(); i++ )
+	{
+		if ( ( writes[ i ].second.mFlags & WRITE_ABSOLUTE_VALUE ) && ( ( *errors )[ i ] == DC1394_SUCCESS ) )
+			( *errors )[ i ] = dc1394_feature_set_absolute_value( mDevice->getNative(),
+					(dc1394feature_t)( writes[ i ].first + DC1394_FEATURE_MIN ), writes[ i ].second.mAbsValue );
+	}
+}
+
+FeatureControl::Write FeatureControl::Obj::getWrite( int i, const FeatureValue &value ) const
+{
+	Write write;
+	write.mFlags = WRITE_POWER | WRITE_MODE;
+	write.mIsOn = value.mIsOn;
+	write.mMode = value.mMode;
+	if ( i + DC1394_FEATURE_MIN == DC1394_FEATURE_WHITE_BALANCE )
+	{
+		write.mFlags |= WRITE_WHITE_BALANCE;
+		write.mBUValue = value.mBUValue;
+		write.mRVValue = value.mRVValue;
+	}
+	else
+	{
+		write.mFlags |= WRITE_VALUE;
+		write.mValue = value.mValue;
+	}
+	if ( mAbsoluteCapable[ i ] && value.mHasAbsolute )
+	{
+		write.mFlags |= WRITE_ABSOLUTE_CONTROL;
+		write.mIsAbsolute = value.mIsAbsolute;
+		if ( value.mIsAbsolute )
+		{
+			write.mFlags |= WRITE_ABSOLUTE_VALUE;
+			write.mAbsValue = value.mAbsValue;
+		}
+	}
+	return write;
+}
+
+void FeatureControl::Obj::read( const vector< dc1394feature_t > &features, vector< FeatureValue > *values )
+{
+	// neighbouring value registers are read in one block transaction
+	Capture1394::Device::NativeLock nativeLock = mDevice->lockNative();
+	RegisterBatch batch( mDevice->getNative() );
+	for ( auto it = features.cbegin(); it != features.cend(); ++it )
+		batch.read( RegisterBatch::getFeatureValueOffset( *it ) );
+	batch.execute();
+	chrono::steady_clock::time_point readTime = chrono::steady_clock::now();
+
+	values->clear();
+	for ( auto it = features.cbegin(); it != features.cend(); ++it )
+	{
+		uint32_t reg;
+		FeatureValue value;
+		if ( batch.getValue( RegisterBatch::getFeatureValueOffset( *it ), &reg ) )
+			value = decodeValueRegister( *it, reg );
+		value.mTime = readTime;
+		// the absolute value registers are not contiguous, they are read one by one
+		if ( value.mValid && value.mIsAbsolute &&
+			 ( dc1394_feature_get_absolute_value( mDevice->getNative(), *it, &value.mAbsValue ) != DC1394_SUCCESS ) )
+			value.mValid = false;
+		values->push_back( value );
+	}
+}
+
+void FeatureControl::Obj::poll( const vector< dc1394feature_t > &features, bool presetLoaded )
+{
+	vector< FeatureValue > values;
+	read( features, &values );
+
+	lock_guard< mutex > lock( mMutex );
+	mNumPolls++;
+
+	Snapshot snapshot( mSnapshot );
+	snapshot.mTime = chrono::steady_clock::now();
+	bool changed = false;
+	for ( size_t j = 0; j < features.size(); j++ )
+	{
+		int i = features[ j ] - DC1394_FEATURE_MIN;
+		const FeatureValue &value = values[ j ];
+		if ( !value.mValid )
+			continue;
+
+		// a feature written meanwhile keeps the mode of the write, the next poll catches up
+		if ( mFeatures[ i ].mPending.mFlags == 0 )
+			mModes[ i ] = value.mMode;
+		snapshot.mFeatures[ i ] = value;
+		changed = true;
+	}
+	if ( presetLoaded )
+		snapshot.mNumPresetLoads++;
+	if ( changed || presetLoaded )
+		publish( &snapshot );
+}
+
+vector< dc1394feature_t > FeatureControl::Obj::getAvailableFeatures() const
+{
+	vector< dc1394feature_t > features;
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		if ( mAvailable[ i ] )
+			features.push_back( (dc1394feature_t)( i + DC1394_FEATURE_MIN ) );
+	}
+	return features;
+}
+
+dc1394error_t FeatureControl::Obj::runPreset( const Request &request )
+{
+	Capture1394::Device::NativeLock nativeLock = mDevice->lockNative();
+	dc1394camera_t *camera = mDevice->getNative();
+	vector< dc1394feature_t > features;
+	{
+		lock_guard< mutex > lock( mMutex );
+		features = getAvailableFeatures();
+	}
+
+	// memory channel 0 holds the factory defaults
+	if ( ( request.mChannel > 0 ) && ( static_cast< int >( request.mChannel ) <= camera->max_mem_channel ) )
+	{
+		bool save = ( request.mType == Request::SAVE_PRESET );
+		// a memory channel restores the video mode and the isochronous settings too, which would break the dma ring
+		if ( ( !save ) && mDevice->isCaptureSetUp() )
+			return DC1394_CAPTURE_IS_RUNNING;
+		dc1394error_t err = save ? dc1394_memory_save( camera, request.mChannel ) :
+								   dc1394_memory_load( camera, request.mChannel );
+		if ( err == DC1394_SUCCESS )
+			err = waitForMemory();
+		if ( ( err == DC1394_SUCCESS ) && ( !save ) )
+			poll( features, true );
+		return err;
+	}
+	else if ( camera->max_mem_channel > 0 )
+	{
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	}
+
+	// host presets of cameras without memory channels
+	vector< FeatureValue > values;
+	if ( request.mType == Request::SAVE_PRESET )
+	{
+		read( features, &values );
+		for ( auto it = values.cbegin(); it != values.cend(); ++it )
+		{
+			if ( !it->mValid )
+				return DC1394_FAILURE;
+		}
+		lock_guard< mutex > lock( mMutex );
+		mHostPresets[ request.mChannel ] = values;
+		return DC1394_SUCCESS;
+	}
+
+	vector< pair< int, Write > > writes;
+	{
+		lock_guard< mutex > lock( mMutex );
+		auto it = mHostPresets.find( request.mChannel );
+		if ( ( it == mHostPresets.cend() ) || ( it->second.size() != features.size() ) )
+			return DC1394_INVALID_ARGUMENT_VALUE;
+		for ( size_t i = 0; i < features.size(); i++ )
+		{
+			int j = features[ i ] - DC1394_FEATURE_MIN;
+			writes.push_back( make_pair( j, getWrite( j, it->second[ i ] ) ) );
+		}
+	}
+
+	vector< dc1394error_t > errors;
+	apply( writes, &errors );
+	poll( features, true );
+	for ( auto it = errors.cbegin(); it != errors.cend(); ++it )
+	{
+		if ( *it != DC1394_SUCCESS )
+			return *it;
+	}
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t FeatureControl::Obj::runApplyFeatures( const Snapshot &snapshot )
+{
+	vector< dc1394feature_t > features;
+	vector< bool > absoluteCapable;
+	{
+		lock_guard< mutex > lock( mMutex );
+		for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+		{
+			if ( mAvailable[ i ] && snapshot.mFeatures[ i ].mValid )
+			{
+				features.push_back( (dc1394feature_t)( i + DC1394_FEATURE_MIN ) );
+				absoluteCapable.push_back( mAbsoluteCapable[ i ] );
+			}
+		}
+	}
+
+	// the current state in one batch, the same registers are patched with the differences
+	Capture1394::Device::NativeLock nativeLock = mDevice->lockNative();
+	RegisterBatch batch( mDevice->getNative() );
+	for ( auto it = features.cbegin(); it != features.cend(); ++it )
+		batch.read( RegisterBatch::getFeatureValueOffset( *it ) );
+	dc1394error_t err = batch.execute();
+
+	vector< pair< int, Write > > writes;
+	for ( size_t j = 0; j < features.size(); j++ )
+	{
+		int i = features[ j ] - DC1394_FEATURE_MIN;
+		uint32_t reg;
+		if ( !batch.getValue( RegisterBatch::getFeatureValueOffset( features[ j ] ), &reg ) )
+			continue;
+
+		const FeatureValue &target = snapshot.mFeatures[ i ];
+		FeatureValue current = decodeValueRegister( features[ j ], reg );
+		Write write;
+		if ( current.mIsOn != target.mIsOn )
+		{
+			write.mFlags |= WRITE_POWER;
+			write.mIsOn = target.mIsOn;
+		}
+		if ( current.mMode != target.mMode )
+		{
+			write.mFlags |= WRITE_MODE;
+			write.mMode = target.mMode;
+		}
+		// values of auto mode features belong to the camera
+		if ( target.mMode == DC1394_FEATURE_MODE_MANUAL )
+		{
+			if ( features[ j ] == DC1394_FEATURE_WHITE_BALANCE )
+			{
+				if ( ( current.mBUValue != target.mBUValue ) || ( current.mRVValue != target.mRVValue ) )
+				{
+					write.mFlags |= WRITE_WHITE_BALANCE;
+					write.mBUValue = target.mBUValue;
+					write.mRVValue = target.mRVValue;
+				}
+			}
+			else if ( current.mValue != target.mValue )
+			{
+				write.mFlags |= WRITE_VALUE;
+				write.mValue = target.mValue;
+			}
+		}
+		if ( absoluteCapable[ j ] && target.mHasAbsolute )
+		{
+			if ( current.mIsAbsolute != target.mIsAbsolute )
+			{
+				write.mFlags |= WRITE_ABSOLUTE_CONTROL;
+				write.mIsAbsolute = target.mIsAbsolute;
+			}
+			// the absolute value is not in the batch, it is read on its own when it is in control already
+			if ( target.mIsAbsolute && ( target.mMode == DC1394_FEATURE_MODE_MANUAL ) )
+			{
+				float absValue;
+				if ( ( !current.mIsAbsolute ) ||
+					 ( dc1394_feature_get_absolute_value( mDevice->getNative(), features[ j ], &absValue ) != DC1394_SUCCESS ) ||
+					 ( !isSameAbsoluteValue( absValue, target.mAbsValue ) ) )
+				{
+					write.mFlags |= WRITE_ABSOLUTE_VALUE;
+					write.mAbsValue = target.mAbsValue;
+				}
+			}
+		}
+		if ( write.mFlags != 0 )
+			writes.push_back( make_pair( i, write ) );
+	}
+
+	vector< dc1394error_t > errors;
+	if ( !writes.empty() )
+		write( &batch, writes, &errors );
+	{
+		lock_guard< mutex > lock( mMutex );
+		mNumFeaturesApplied = writes.size();
+		for ( size_t i = 0; i < writes.size(); i++ )
+		{
+			if ( ( errors[ i ] == DC1394_SUCCESS ) && ( writes[ i ].second.mFlags & WRITE_MODE ) )
+				mModes[ writes[ i ].first ] = writes[ i ].second.mMode;
+		}
+	}
+
+	for ( auto it = errors.cbegin(); it != errors.cend(); ++it )
+	{
+		if ( ( *it != DC1394_SUCCESS ) && ( err == DC1394_SUCCESS ) )
+			err = *it;
+	}
+	return err;
+}
+
+dc1394error_t FeatureControl::Obj::waitForMemory()
+{
+	chrono::steady_clock::time_point deadline = chrono::steady_clock::now() +
+		chrono::duration_cast< chrono::steady_clock::duration >( chrono::duration< double >( kMemoryTimeout ) );
+	for ( ;; )
+	{
+		dc1394bool_t busy;
+		dc1394error_t err = dc1394_memory_busy( mDevice->getNative(), &busy );
+		if ( ( err != DC1394_SUCCESS ) || ( !busy ) )
+			return err;
+		if ( chrono::steady_clock::now() > deadline )
+			return DC1394_FAILURE;
+		this_thread::sleep_for( chrono::milliseconds( kMemoryPollInterval ) );
+	}
+}
+
+void FeatureControl::Obj::publish( Snapshot *snapshot )
+{
+	snapshot->mSequence = mSnapshot.mSequence + 1;
+	mSnapshot = *snapshot;
+	store( mSnapshot );
+}
+
+void FeatureControl::Obj::store( const Snapshot &snapshot )
+{
+	static_assert( std::is_trivially_copyable< Snapshot >::value, "snapshots are copied word by word" );
+	uint32_t words[ kNumSnapshotWords ] = { 0 };
+	memcpy( words, &snapshot, sizeof( Snapshot ) );
+
+	// the only writer, it holds mMutex. A reader acquiring a new word also sees the odd version stored before it
+	uint32_t version = mSnapshotVersion.load( memory_order_relaxed );
+	mSnapshotVersion.store( version + 1, memory_order_relaxed );
+	for ( size_t i = 0; i < kNumSnapshotWords; i++ )
+		mSnapshotWords[ i ].store( words[ i ], memory_order_release );
+	mSnapshotVersion.store( version + 2, memory_order_release );
+}
+
+FeatureControl::Snapshot FeatureControl::getSnapshot() const
+{
+	uint32_t words[ Obj::kNumSnapshotWords ];
+	for ( ;; )
+	{
+		uint32_t version = mObj->mSnapshotVersion.load( memory_order_acquire );
+		if ( version & 1 )
+		{
+			this_thread::yield();
+			continue;
+		}
+		// the acquiring loads keep the version from being read again before the words, unchanged it means none was overwritten
+		for ( size_t i = 0; i < Obj::kNumSnapshotWords; i++ )
+			words[ i ] = mObj->mSnapshotWords[ i ].load( memory_order_acquire );
+		if ( mObj->mSnapshotVersion.load( memory_order_relaxed ) == version )
+			break;
+	}
+
+	Snapshot snapshot;
+	memcpy( &snapshot, words, sizeof( Snapshot ) );
+	return snapshot;
+}
+
+void FeatureControl::Obj::threadedFunc()
+{
+	unique_lock< mutex > lock( mMutex );
+	for ( ;; )
+	{
+		// pick the features out of their interval, the rest waits for the earliest due time
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		chrono::steady_clock::time_point wakeTime = chrono::steady_clock::time_point::max();
+		vector< pair< int, Write > > writes;
+		for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+		{
+			FeatureState &state = mFeatures[ i ];
+			if ( state.mPending.mFlags == 0 )
+				continue;
+
+			chrono::steady_clock::time_point dueTime = state.mLastWrite + mMinInterval;
+			// the remaining writes are not held back on quit or by a request waiting for them
+			if ( mQuit || ( !mRequests.empty() ) || ( dueTime <= now ) )
+			{
+				writes.push_back( make_pair( i, state.mPending ) );
+				state.mPending = Write();
+			}
+			else
+			{
+				wakeTime = std::min( wakeTime, dueTime );
+			}
+		}
+
+		if ( writes.empty() && ( !mRequests.empty() ) )
+		{
+			Request request = mRequests.front();
+			mRequests.pop_front();
+			lock.unlock();
+			dc1394error_t err = ( request.mType == Request::APPLY_FEATURES ) ? runApplyFeatures( *request.mSnapshot ) :
+																			   runPreset( request );
+			lock.lock();
+
+			// a failure is kept until the last queued request is done
+			if ( err != DC1394_SUCCESS )
+				mRequestError = err;
+			if ( mRequests.empty() )
+				mRequestStatus = ( mRequestError == DC1394_SUCCESS ) ? STATUS_DONE : STATUS_FAILED;
+			mDoneCond.notify_all();
+			continue;
+		}
+
+		// a one-push feature is polled until it returns to manual mode with its final value
+		vector< dc1394feature_t > polled;
+		if ( writes.empty() && ( !mQuit ) && ( mPollInterval.count() > 0 ) )
+		{
+			chrono::steady_clock::time_point pollTime = mLastPoll + mPollInterval;
+			bool isDue = ( pollTime <= now );
+			for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+			{
+				if ( mAvailable[ i ] &&
+					 ( ( mModes[ i ] == DC1394_FEATURE_MODE_AUTO ) || ( mModes[ i ] == DC1394_FEATURE_MODE_ONE_PUSH_AUTO ) ) )
+				{
+					if ( isDue )
+						polled.push_back( (dc1394feature_t)( i + DC1394_FEATURE_MIN ) );
+					else
+						wakeTime = std::min( wakeTime, pollTime );
+				}
+			}
+		}
+
+		if ( !polled.empty() )
+		{
+			mLastPoll = now;
+			lock.unlock();
+			poll( polled );
+			lock.lock();
+			continue;
+		}
+
+		if ( writes.empty() )
+		{
+			if ( mQuit )
+				return;
+			if ( wakeTime == chrono::steady_clock::time_point::max() )
+				mCond.wait( lock );
+			else
+				mCond.wait_until( lock, wakeTime );
+			continue;
+		}
+
+		lock.unlock();
+		vector< dc1394error_t > errors;
+		apply( writes, &errors );
+		lock.lock();
+
+		now = chrono::steady_clock::now();
+		for ( size_t i = 0; i < writes.size(); i++ )
+		{
+			FeatureState &state = mFeatures[ writes[ i ].first ];
+			state.mLastWrite = now;
+			mNumWrites++;
+			if ( errors[ i ] != DC1394_SUCCESS )
+				state.mError = errors[ i ];
+			else if ( writes[ i ].second.mFlags & WRITE_MODE )
+				mModes[ writes[ i ].first ] = writes[ i ].second.mMode;
+			// newer values queued during the write keep it pending
+			if ( state.mPending.mFlags == 0 )
+				state.mStatus = ( errors[ i ] == DC1394_SUCCESS ) ? STATUS_DONE : STATUS_FAILED;
+		}
+		mDoneCond.notify_all();
+	}
+}
+
+} // namespace mndl
@@ -0,0 +1,304 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "cinder/Cinder.h"
+#include "cinder/Thread.h"
+
+#include "Capture1394.h"
+
+namespace mndl {
+
+class RegisterBatch;
+
+typedef std::shared_ptr< class FeatureControl > FeatureControlRef;
+
+/** Writes the features of a camera on a control thread, so the caller never waits for the bus. The writes of each feature
+ *  are coalesced to its latest value and a feature is written at most once per minimum interval. The same thread reads back
+ *  the features in auto mode at a low rate and publishes them in snapshots. The bus accesses hold Device::lockNative(),
+ *  so a capture reconnecting the camera does not free the handle under them.
+ */
+class FeatureControl
+{
+	public:
+		enum Status
+		{
+			//! The feature has not been written yet.
+			STATUS_IDLE,
+			//! A write is queued or on the bus.
+			STATUS_PENDING,
+			//! The last write succeeded.
+			STATUS_DONE,
+			//! The last write failed, getError() returns the reason.
+			STATUS_FAILED
+		};
+
+		//! A feature read back from the camera.
+		struct FeatureValue
+		{
+			FeatureValue() : mValid( false ), mIsOn( false ), mMode( DC1394_FEATURE_MODE_MANUAL ), mValue( 0 ),
+							 mBUValue( 0 ), mRVValue( 0 ), mHasAbsolute( true ), mIsAbsolute( false ), mAbsValue( 0.0f )
+			{}
+
+			//! False if the feature is not available or has not been read yet.
+			bool mValid;
+			bool mIsOn;
+			dc1394feature_mode_t mMode;
+			uint32_t mValue;
+			uint32_t mBUValue;
+			uint32_t mRVValue;
+			//! False leaves the absolute control and value of the camera as they are when the feature is written.
+			bool mHasAbsolute;
+			//! The feature is controlled by its absolute value in the units of IIDC 1.31 chapter 4.13.
+			bool mIsAbsolute;
+			float mAbsValue;
+			//! When the value was read, a snapshot keeps the older values of the features not read since.
+			std::chrono::steady_clock::time_point mTime;
+		};
+
+		//! The features of the camera, indexed by the feature id - DC1394_FEATURE_MIN. Plain data, published by copying.
+		struct Snapshot
+		{
+			Snapshot() : mSequence( 0 ), mNumPresetLoads( 0 ) {}
+
+			//! Incremented with every published snapshot, 0 before the first one.
+			uint64_t mSequence;
+			//! Incremented with every loaded preset, any feature may have changed when it differs from the previous snapshot.
+			uint64_t mNumPresetLoads;
+			std::chrono::steady_clock::time_point mTime;
+			FeatureValue mFeatures[ DC1394_FEATURE_NUM ];
+		};
+
+		//! Writes to each feature of \a device are at least \a minInterval seconds apart.
+		static FeatureControlRef create( const Capture1394::DeviceRef &device, double minInterval = 1.0 / 30.0 )
+		{ return FeatureControlRef( new FeatureControl( device, minInterval ) ); }
+
+		~FeatureControl() {}
+
+		//! Queues turning \a feature on or off.
+		void setPower( dc1394feature_t feature, bool on );
+		//! Queues setting the mode of \a feature.
+		void setMode( dc1394feature_t feature, dc1394feature_mode_t mode );
+		//! Queues setting the value of \a feature.
+		void setValue( dc1394feature_t feature, uint32_t value );
+		//! Queues setting the white balance B/U and R/V values.
+		void setWhiteBalance( uint32_t buValue, uint32_t rvValue );
+		//! Queues turning the absolute control of \a feature on or off.
+		void setAbsoluteControl( dc1394feature_t feature, bool on );
+		//! Queues setting the absolute value of \a feature, it is written after the absolute control.
+		void setAbsoluteValue( dc1394feature_t feature, float value );
+
+		Status getStatus( dc1394feature_t feature ) const;
+		//! Returns the error of the last failed write of \a feature.
+		dc1394error_t getError( dc1394feature_t feature ) const;
+
+		//! Returns the number of features with writes not completed yet.
+		size_t getNumPending() const;
+		//! Blocks until the queued writes are completed or \a timeout seconds passed. Returns false on timeout.
+		bool flush( double timeout = 1.0 );
+
+		//! Queues writing every valid feature of \a snapshot, they reach the bus in the same register batch.
+		void setFeatures( const Snapshot &snapshot );
+
+		//! Returns the number of user memory channels of the camera, 0 if the presets are kept on the host.
+		uint32_t getNumMemoryChannels() const;
+		/** Queues saving the features to preset \a channel, starting from 1. Cameras with memory channels store it with
+		 *  dc1394_memory_save(), which reprograms an EEPROM of limited endurance, others keep a copy on the host for the
+		 *  lifetime of this FeatureControl. The writes queued before are written first.
+		 */
+		void savePreset( uint32_t channel );
+		/** Queues loading preset \a channel with dc1394_memory_load() or by writing the host copy in one register batch.
+		 *  The writes queued before are written first, the snapshot published after the load reflects the preset.
+		 *  A memory channel restores the video mode, frame rate and isochronous settings as well, so it fails with
+		 *  DC1394_CAPTURE_IS_RUNNING while a capture of the device is set up, even if it is stopped warm.
+		 */
+		void loadPreset( uint32_t channel );
+		/** Queues bringing the camera to the valid features of \a snapshot with as few writes as possible. The features are read
+		 *  in one register batch, only the parts differing from \a snapshot are written back in another.
+		 */
+		void applyFeatures( const Snapshot &snapshot );
+		//! Returns the number of features the last applyFeatures() had to write.
+		size_t getNumFeaturesApplied() const;
+
+		//! Returns the status of the last preset save or load or applyFeatures().
+		Status getRequestStatus() const;
+		dc1394error_t getRequestError() const;
+
+		//! Sets the available features and their current state as read by dc1394_feature_get_all() and publishes it as a snapshot.
+		void setFeatureSet( const dc1394featureset_t &featureSet );
+		//! Features in auto or one-push auto mode are read back every \a interval seconds, 0 stops polling. Default is 0.5.
+		void setPollInterval( double interval );
+		/** Returns a copy of the latest snapshot without locking, its mSequence is 0 before setFeatureSet(). The snapshots
+		 *  are published through a sequence lock, a copy overlapping a publish is taken again.
+		 */
+		Snapshot getSnapshot() const;
+		//! Returns the number of polls of the auto mode features.
+		uint64_t getNumPolls() const;
+
+		//! Returns the number of feature writes issued, a write sets every queued part of a feature.
+		uint64_t getNumWrites() const;
+		//! Returns the number of queued writes replaced by a newer value before reaching the bus.
+		uint64_t getNumCoalesced() const;
+
+		const Capture1394::DeviceRef & getDevice() const { return mObj->mDevice; }
+
+	protected:
+		FeatureControl( const Capture1394::DeviceRef &device, double minInterval );
+
+		//! Parts of a feature waiting to be written.
+		enum
+		{
+			WRITE_POWER = 1 << 0,
+			WRITE_MODE = 1 << 1,
+			WRITE_VALUE = 1 << 2,
+			WRITE_WHITE_BALANCE = 1 << 3,
+			WRITE_ABSOLUTE_CONTROL = 1 << 4,
+			WRITE_ABSOLUTE_VALUE = 1 << 5
+		};
+
+		struct Write
+		{
+			Write() : mFlags( 0 ), mIsOn( false ), mMode( DC1394_FEATURE_MODE_MANUAL ), mValue( 0 ),
+					  mBUValue( 0 ), mRVValue( 0 ), mIsAbsolute( false ), mAbsValue( 0.0f )
+			{}
+
+			uint32_t mFlags;
+			bool mIsOn;
+			dc1394feature_mode_t mMode;
+			uint32_t mValue;
+			uint32_t mBUValue;
+			uint32_t mRVValue;
+			bool mIsAbsolute;
+			float mAbsValue;
+		};
+
+		struct FeatureState
+		{
+			FeatureState() : mStatus( STATUS_IDLE ), mError( DC1394_SUCCESS ) {}
+
+			Write mPending;
+			Status mStatus;
+			dc1394error_t mError;
+			std::chrono::steady_clock::time_point mLastWrite;
+		};
+
+		struct Obj
+		{
+			Obj( const Capture1394::DeviceRef &device, double minInterval );
+			~Obj();
+
+			//! Merges \a write into the pending write of \a feature and wakes up the control thread.
+			void queue( dc1394feature_t feature, const Write &write );
+			//! Merges \a write into the pending write of \a feature, needs mMutex.
+			void merge( dc1394feature_t feature, const Write &write );
+			//! Writes the features of \a writes with batched register accesses and fills \a errors for each of them.
+			void apply( const std::vector< std::pair< int, Write > > &writes, std::vector< dc1394error_t > *errors );
+			//! Writes \a writes onto the registers \a batch has just read.
+			void write( RegisterBatch *batch, const std::vector< std::pair< int, Write > > &writes,
+						std::vector< dc1394error_t > *errors );
+			//! Returns the value register \a reg of \a feature with \a write applied.
+			static uint32_t encode( dc1394feature_t feature, uint32_t reg, const Write &write );
+
+			//! Returns the write of every part of \a value of feature \a i.
+			Write getWrite( int i, const FeatureValue &value ) const;
+
+			//! Reads \a features, which are sorted by id, into \a values. Invalid values could not be read.
+			void read( const std::vector< dc1394feature_t > &features, std::vector< FeatureValue > *values );
+			//! Reads back \a features and publishes the new snapshot, which counts a preset load if \a presetLoaded.
+			void poll( const std::vector< dc1394feature_t > &features, bool presetLoaded = false );
+			//! Returns the available features, needs mMutex.
+			std::vector< dc1394feature_t > getAvailableFeatures() const;
+
+			//! A preset or feature set operation waiting for the queued writes.
+			struct Request
+			{
+				enum Type
+				{
+					SAVE_PRESET,
+					LOAD_PRESET,
+					APPLY_FEATURES
+				};
+
+				Type mType;
+				uint32_t mChannel;
+				std::shared_ptr< const Snapshot > mSnapshot;
+			};
+			//! Queues \a request and wakes up the control thread.
+			void queueRequest( const Request &request );
+			//! Saves or loads a preset on the control thread.
+			dc1394error_t runPreset( const Request &request );
+			//! Writes the differences to \a snapshot on the control thread.
+			dc1394error_t runApplyFeatures( const Snapshot &snapshot );
+			//! Waits until the camera finished the memory channel operation.
+			dc1394error_t waitForMemory();
+			//! Publishes \a snapshot with the next sequence number, needs mMutex.
+			void publish( Snapshot *snapshot );
+			//! Copies \a snapshot into the words of the sequence lock, needs mMutex.
+			void store( const Snapshot &snapshot );
+
+			void threadedFunc();
+
+			Capture1394::DeviceRef mDevice;
+			std::chrono::steady_clock::duration mMinInterval;
+
+			FeatureState mFeatures[ DC1394_FEATURE_NUM ];
+			uint64_t mNumWrites;
+			uint64_t mNumCoalesced;
+			bool mQuit;
+
+			bool mAvailable[ DC1394_FEATURE_NUM ];
+			bool mAbsoluteCapable[ DC1394_FEATURE_NUM ];
+			//! Mode of each available feature as last written or read back.
+			dc1394feature_mode_t mModes[ DC1394_FEATURE_NUM ];
+			std::chrono::steady_clock::duration mPollInterval;
+			std::chrono::steady_clock::time_point mLastPoll;
+			uint64_t mNumPolls;
+			//! The latest published snapshot, guarded by mMutex.
+			Snapshot mSnapshot;
+			/** Sequence lock of the snapshot copied in atomic words, which getSnapshot() reads without mMutex.
+			 *  The version is odd while store() writes the words.
+			 */
+			std::atomic< uint32_t > mSnapshotVersion;
+			static const size_t kNumSnapshotWords = ( sizeof( Snapshot ) + sizeof( uint32_t ) - 1 ) / sizeof( uint32_t );
+			std::atomic< uint32_t > mSnapshotWords[ kNumSnapshotWords ];
+
+			std::deque< Request > mRequests;
+			Status mRequestStatus;
+			dc1394error_t mRequestError;
+			size_t mNumFeaturesApplied;
+			//! Presets of cameras without memory channels by channel.
+			std::map< uint32_t, std::vector< FeatureValue > > mHostPresets;
+
+			mutable std::mutex mMutex;
+			std::condition_variable mCond;
+			//! Signaled when writes are completed.
+			std::condition_variable mDoneCond;
+			std::shared_ptr< std::thread > mThread;
+		};
+
+		std::shared_ptr< Obj > mObj;
+};
+
+} // namespace mndl
@@ -0,0 +1,132 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+
+#include "RegisterBatch.h"
+
+using namespace std;
+
+namespace mndl {
+
+//! Registers are quadlets.
+static const uint64_t kRegisterSize = 4;
+
+RegisterBatch::RegisterBatch( dc1394camera_t *camera ) :
+	mCamera( camera ), mNumTransactions( 0 )
+{}
+
+void RegisterBatch::read( uint64_t offset )
+{
+	mReads.insert( offset );
+}
+
+void RegisterBatch::write( uint64_t offset, uint32_t value )
+{
+	mWrites[ offset ] = value;
+}
+
+dc1394error_t RegisterBatch::execute()
+{
+	dc1394error_t result = DC1394_SUCCESS;
+	mNumTransactions = 0;
+	mValues.clear();
+	mErrors.clear();
+
+	// both queues are sorted by offset, a run ends at the first gap
+	for ( auto first = mWrites.cbegin(); first != mWrites.cend(); )
+	{
+		vector< uint32_t > values;
+		auto last = first;
+		do
+		{
+			values.push_back( last->second );
+			++last;
+		} while ( ( last != mWrites.cend() ) && ( last->first == first->first + values.size() * kRegisterSize ) );
+
+		dc1394error_t err = dc1394_set_control_registers( mCamera, first->first, &values[ 0 ],
+				static_cast< uint32_t >( values.size() ) );
+		mNumTransactions++;
+		if ( err != DC1394_SUCCESS )
+		{
+			for ( auto it = first; it != last; ++it )
+				mErrors[ it->first ] = err;
+			if ( result == DC1394_SUCCESS )
+				result = err;
+		}
+		first = last;
+	}
+
+	for ( auto first = mReads.cbegin(); first != mReads.cend(); )
+	{
+		size_t num = 0;
+		auto last = first;
+		do
+		{
+			num++;
+			++last;
+		} while ( ( last != mReads.cend() ) && ( *last == *first + num * kRegisterSize ) );
+
+		vector< uint32_t > values( num );
+		dc1394error_t err = dc1394_get_control_registers( mCamera, *first, &values[ 0 ], static_cast< uint32_t >( num ) );
+		mNumTransactions++;
+		if ( err == DC1394_SUCCESS )
+		{
+			for ( size_t i = 0; i < num; i++ )
+				mValues[ *first + i * kRegisterSize ] = values[ i ];
+		}
+		else
+		{
+			for ( size_t i = 0; i < num; i++ )
+				mErrors[ *first + i * kRegisterSize ] = err;
+			if ( result == DC1394_SUCCESS )
+				result = err;
+		}
+		first = last;
+	}
+
+	mReads.clear();
+	mWrites.clear();
+	return result;
+}
+
+bool RegisterBatch::getValue( uint64_t offset, uint32_t *value ) const
+{
+	auto it = mValues.find( offset );
+	if ( it == mValues.cend() )
+		return false;
+	*value = it->second;
+	return true;
+}
+
+dc1394error_t RegisterBatch::getError( uint64_t offset ) const
+{
+	auto it = mErrors.find( offset );
+	return ( it == mErrors.cend() ) ? DC1394_SUCCESS : it->second;
+}
+
+uint64_t RegisterBatch::getFeatureValueOffset( dc1394feature_t feature )
+{
+	if ( feature < DC1394_FEATURE_ZOOM )
+		return 0x800 + ( feature - DC1394_FEATURE_MIN ) * kRegisterSize;
+	else if ( feature < DC1394_FEATURE_CAPTURE_SIZE )
+		return 0x880 + ( feature - DC1394_FEATURE_ZOOM ) * kRegisterSize;
+	else
+		return 0x8c0 + ( feature - DC1394_FEATURE_CAPTURE_SIZE ) * kRegisterSize;
+}
+
+} // namespace mndl
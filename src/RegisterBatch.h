@@ -0,0 +1,71 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <map>
+#include <set>
+
+#include "cinder/Cinder.h"
+
+#include <dc1394/dc1394.h>
+
+namespace mndl {
+
+/** Collects control register accesses of a camera and issues them as block transactions over contiguous offsets, so a run
+ *  of neighbouring registers costs one bus round-trip instead of one per register. Offsets are relative to the command
+ *  register base like with dc1394_get_control_registers(). Not thread-safe.
+ */
+class RegisterBatch
+{
+	public:
+		RegisterBatch( dc1394camera_t *camera );
+
+		//! Queues reading the register at \a offset.
+		void read( uint64_t offset );
+		//! Queues writing \a value to the register at \a offset, a later write to the same offset replaces it.
+		void write( uint64_t offset, uint32_t value );
+
+		/** Writes the queued values, then reads the queued registers and clears the queues. A failed block does not stop the
+		 *  others, returns the first error.
+		 */
+		dc1394error_t execute();
+
+		//! Returns the value read by the last execute(), false if the read of \a offset failed or was not queued.
+		bool getValue( uint64_t offset, uint32_t *value ) const;
+
+		//! Returns the error of the block containing \a offset in the last execute(), DC1394_SUCCESS if it went through.
+		dc1394error_t getError( uint64_t offset ) const;
+
+		//! Returns the number of bus transactions issued by the last execute().
+		size_t getNumTransactions() const { return mNumTransactions; }
+
+		//! Returns the offset of the value register of \a feature, see IIDC 1.31 chapter 4.8.
+		static uint64_t getFeatureValueOffset( dc1394feature_t feature );
+
+	protected:
+		dc1394camera_t *mCamera;
+
+		std::set< uint64_t > mReads;
+		std::map< uint64_t, uint32_t > mWrites;
+		std::map< uint64_t, uint32_t > mValues;
+		//! The offsets of the failed blocks.
+		std::map< uint64_t, dc1394error_t > mErrors;
+		size_t mNumTransactions;
+};
+
+} // namespace mndl
@@ -23,43 +23,107 @@
 #include "SurfaceCache.h"
 
 SurfaceCache::SurfaceCache( int32_t width, int32_t height, ci::SurfaceChannelOrder sco, int numSurfaces )
-        : mWidth( width ), mHeight( height ), mSCO( sco )
+        : mLatest( -1 ), mWidth( width ), mHeight( height ), mSCO( sco )
 {
 	for ( int i = 0; i < numSurfaces; ++i )
 	{
 		mSurfaceData.push_back( std::shared_ptr<uint8_t>( new uint8_t[ width * height * sco.getPixelInc()], checked_array_deleter<uint8_t>() ) );
 		mDeallocatorRefcon.push_back( std::make_pair( this, i ) );
-		mSurfaceUsed.push_back( false );
+		mSurfaceRefs.push_back( 0 );
+		mSurfaceWriting.push_back( false );
+		mSurfaces.push_back( ci::Surface8u( mSurfaceData[ i ].get(), width, height, width * sco.getPixelInc(), sco ) );
 	}
 }
 
 void SurfaceCache::resize( int32_t width, int32_t height )
 {
+	std::lock_guard< std::mutex > lock( mMutex );
 	mWidth = width;
 	mHeight = height;
+	mLatest = -1;
+	for ( size_t i = 0; i < mSurfaces.size(); ++i )
+		mSurfaces[ i ] = ci::Surface8u( mSurfaceData[ i ].get(), width, height, width * mSCO.getPixelInc(), mSCO );
 }
 
-ci::Surface8u SurfaceCache::getNewSurface()
+bool SurfaceCache::isFree( int id ) const
+{
+	return ( id != mLatest ) && ( !mSurfaceWriting[ id ] ) && ( mSurfaceRefs[ id ] == 0 );
+}
+
+int SurfaceCache::acquire()
 {
-	// try to find an available block of pixel data to wrap a surface around
+	// the producer side never allocates, if the application holds on to every buffer the frame has to be dropped
+	std::lock_guard< std::mutex > lock( mMutex );
 	for ( size_t i = 0; i < mSurfaceData.size(); ++i )
 	{
-		if ( !mSurfaceUsed[i] )
+		if ( isFree( i ) )
 		{
-			mSurfaceUsed[i] = true;
-			ci::Surface8u result( mSurfaceData[i].get(), mWidth, mHeight, mWidth * mSCO.getPixelInc(), mSCO );
-			result.setDeallocator( surfaceDeallocator, &mDeallocatorRefcon[i] );
-			return result;
+			mSurfaceWriting[ i ] = true;
+			return i;
 		}
 	}
+	return -1;
+}
+
+void SurfaceCache::publish( int id )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mSurfaceWriting[ id ] = false;
+	mLatest = id;
+}
+
+void SurfaceCache::discard( int id )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mSurfaceWriting[ id ] = false;
+}
+
+ci::Surface8u SurfaceCache::getNewSurface()
+{
+	int id;
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		id = mLatest;
+		if ( id < 0 )
+			return ci::Surface8u();
+		mSurfaceRefs[ id ]++;
+	}
+
+	// the reference taken under the lock keeps the buffer while the wrapper is built
+	ci::Surface8u result = getNewSurface( id );
+	release( id );
+	return result;
+}
+
+ci::Surface8u SurfaceCache::getNewSurface( int id )
+{
+	int32_t width, height;
+	{
+		std::lock_guard< std::mutex > lock( mMutex );
+		mSurfaceRefs[ id ]++;
+		width = mWidth;
+		height = mHeight;
+	}
+	ci::Surface8u result( mSurfaceData[ id ].get(), width, height, width * mSCO.getPixelInc(), mSCO );
+	result.setDeallocator( surfaceDeallocator, &mDeallocatorRefcon[ id ] );
+	return result;
+}
 
-	// we couldn't find an available surface, so we'll need to allocate one
-	return ci::Surface8u( mWidth, mHeight, mSCO.hasAlpha(), mSCO );
+void SurfaceCache::retain( int id )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mSurfaceRefs[ id ]++;
+}
+
+void SurfaceCache::release( int id )
+{
+	std::lock_guard< std::mutex > lock( mMutex );
+	mSurfaceRefs[ id ]--;
 }
 
 void SurfaceCache::surfaceDeallocator( void *refcon )
 {
 	std::pair< SurfaceCache *, int > *info = reinterpret_cast< std::pair< SurfaceCache *, int > *>( refcon );
-	info->first->mSurfaceUsed[ info->second ] = false;
+	std::lock_guard< std::mutex > lock( info->first->mMutex );
+	info->first->mSurfaceRefs[ info->second ]--;
 }
-
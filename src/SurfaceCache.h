@@ -4,20 +4,48 @@
 
 #include "cinder/Cinder.h"
 #include "cinder/Surface.h"
+#include "cinder/Thread.h"
 
 class SurfaceCache
 {
 	public:
 		SurfaceCache( int32_t width, int32_t height, ci::SurfaceChannelOrder sco, int numSurfaces );
 		void resize( int32_t width, int32_t height );
+
+		//! Returns the index of a free buffer for the producer to write into, or -1 if all of them are in use.
+		int acquire();
+		//! Makes the acquired buffer \a id the latest frame.
+		void publish( int id );
+		//! Returns the acquired buffer \a id to the cache without publishing it.
+		void discard( int id );
+
+		uint8_t * getData( int id ) { return mSurfaceData[ id ].get(); }
+		int32_t getRowBytes() const { return mWidth * mSCO.getPixelInc(); }
+
+		//! Returns a Surface wrapping the latest published buffer, the buffer is not reused while the Surface is alive.
 		ci::Surface8u getNewSurface();
+		//! Returns a Surface wrapping buffer \a id, the buffer is not reused while the Surface is alive.
+		ci::Surface8u getNewSurface( int id );
+
+		/** Returns the pooled Surface wrapping buffer \a id without allocating. It does not keep the buffer from being reused,
+		 *  it is only valid while the producer holds the buffer or it is retained.
+		 */
+		const ci::Surface8u & getSurface( int id ) const { return mSurfaces[ id ]; }
+		//! Keeps buffer \a id from being reused until release() is called.
+		void retain( int id );
+		void release( int id );
 		static void surfaceDeallocator( void *refcon );
 
 	private:
+		bool isFree( int id ) const;
+
 		std::vector< std::shared_ptr< uint8_t > > mSurfaceData;
-		std::vector< bool > mSurfaceUsed;
+		std::vector< int > mSurfaceRefs; // number of live surfaces wrapping the buffer
+		std::vector< bool > mSurfaceWriting;
 		std::vector< std::pair< SurfaceCache *, int > > mDeallocatorRefcon;
+		std::vector< ci::Surface8u > mSurfaces; // non-owning wrappers of the buffers, rebuilt on resize
+		int mLatest;
 		int32_t mWidth, mHeight;
 		ci::SurfaceChannelOrder mSCO;
+		std::mutex mMutex;
 };
-
@@ -0,0 +1,159 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "BandwidthPlanner.h"
+#include "VideoModeSolver.h"
+
+using namespace std;
+
+namespace mndl {
+
+//! Throughputs within about this ratio are considered equal, so the coding preference and the cost decide.
+static const double kThroughputTolerance = 0.05;
+
+double VideoModeSolver::getConversionCost( dc1394color_coding_t coding )
+{
+	switch ( coding )
+	{
+		case DC1394_COLOR_CODING_MONO8:
+		case DC1394_COLOR_CODING_RGB8:
+			return 0.5;
+
+		case DC1394_COLOR_CODING_MONO16:
+		case DC1394_COLOR_CODING_MONO16S:
+		case DC1394_COLOR_CODING_RGB16:
+		case DC1394_COLOR_CODING_RGB16S:
+			return 1.5;
+
+		case DC1394_COLOR_CODING_YUV411:
+		case DC1394_COLOR_CODING_YUV422:
+		case DC1394_COLOR_CODING_YUV444:
+			return 2.0;
+
+		// bilinear debayering
+		case DC1394_COLOR_CODING_RAW8:
+			return 3.0;
+		case DC1394_COLOR_CODING_RAW16:
+			return 4.0;
+
+		default:
+			return 2.0;
+	}
+}
+
+vector< VideoModeSolver::Candidate > VideoModeSolver::rank( const vector< Capture1394::VideoMode > &videoModes,
+		const vector< Capture1394::Device::Format7Info > &format7Info,
+		const Capture1394::VideoModeConstraints &constraints, dc1394speed_t speed )
+{
+	vector< Candidate > candidates;
+	for ( auto it = videoModes.cbegin(); it != videoModes.cend(); ++it )
+	{
+		Candidate candidate;
+		candidate.mVideoMode = *it;
+
+		const Capture1394::Device::Format7Info *info = NULL;
+		for ( auto f7 = format7Info.cbegin(); f7 != format7Info.cend(); ++f7 )
+		{
+			if ( f7->mVideoMode == it->getVideoMode() )
+				info = &( *f7 );
+		}
+
+		if ( info )
+		{
+			// crop to the minimum resolution rounded up to the units, smaller frames are faster
+			ci::Vec2i size = info->mMaxSize;
+			ci::Vec2i unit( std::max( info->mUnitSize.x, 1 ), std::max( info->mUnitSize.y, 1 ) );
+			if ( ( constraints.mMinResolution.x > 0 ) && ( constraints.mMinResolution.y > 0 ) )
+			{
+				size.x = ( ( constraints.mMinResolution.x + unit.x - 1 ) / unit.x ) * unit.x;
+				size.y = ( ( constraints.mMinResolution.y + unit.y - 1 ) / unit.y ) * unit.y;
+			}
+			if ( ( size.x > info->mMaxSize.x ) || ( size.y > info->mMaxSize.y ) )
+				continue;
+			candidate.mVideoMode.setResolution( size );
+
+			uint32_t bits = 0;
+			dc1394_get_color_coding_bit_size( it->getColorCoding(), &bits );
+			uint32_t maxBytes = std::min( info->mMaxBytes, BandwidthPlanner::getMaxPacketBytes( speed ) );
+			candidate.mFrameRate = BandwidthPlanner::getFormat7FrameRate( static_cast< uint64_t >( size.x ) * size.y * bits / 8, maxBytes );
+		}
+		else
+		{
+			if ( ( it->getResolution().x < constraints.mMinResolution.x ) || ( it->getResolution().y < constraints.mMinResolution.y ) )
+				continue;
+			if ( dc1394_framerate_as_float( it->getFrameRate(), &candidate.mFrameRate ) != DC1394_SUCCESS )
+				continue;
+		}
+
+		double megapixels = candidate.mVideoMode.getResolution().x * candidate.mVideoMode.getResolution().y / 1000000.0;
+		double cost = getConversionCost( it->getColorCoding() );
+
+		// Format7 modes can be slowed down to fit the cpu budget
+		if ( ( constraints.mCpuBudget > 0.0 ) && ( info ) && ( megapixels * candidate.mFrameRate * cost / 1000.0 > constraints.mCpuBudget ) )
+		{
+			candidate.mFrameRate = static_cast< float >( constraints.mCpuBudget * 1000.0 / ( megapixels * cost ) );
+			candidate.mVideoMode.setTargetFrameRate( candidate.mFrameRate );
+		}
+
+		candidate.mThroughput = megapixels * candidate.mFrameRate;
+		candidate.mCpuLoad = candidate.mThroughput * cost / 1000.0;
+		if ( candidate.mFrameRate < constraints.mMinFrameRate )
+			continue;
+		// the float frame rate of a slowed down mode may round above the budget
+		if ( ( constraints.mCpuBudget > 0.0 ) && ( candidate.mCpuLoad > constraints.mCpuBudget * ( 1.0 + 1e-6 ) ) )
+			continue;
+
+		candidate.mPreference = find( constraints.mPreferredCodings.cbegin(), constraints.mPreferredCodings.cend(), it->getColorCoding() ) -
+								constraints.mPreferredCodings.cbegin();
+		candidates.push_back( candidate );
+	}
+
+	// throughputs are compared in logarithmic buckets to keep the ordering strict
+	auto bucket = []( double throughput )
+			{ return std::floor( std::log( std::max( throughput, 1e-9 ) ) / std::log1p( kThroughputTolerance ) ); };
+	stable_sort( candidates.begin(), candidates.end(), [ & ]( const Candidate &a, const Candidate &b )
+			{
+				double bucketA = bucket( a.mThroughput ), bucketB = bucket( b.mThroughput );
+				if ( bucketA != bucketB )
+					return bucketA > bucketB;
+				if ( a.mPreference != b.mPreference )
+					return a.mPreference < b.mPreference;
+				return a.mCpuLoad < b.mCpuLoad;
+			} );
+	return candidates;
+}
+
+bool VideoModeSolver::solve( const Capture1394::DeviceRef &device, const Capture1394::VideoModeConstraints &constraints,
+		Capture1394::VideoMode *videoMode )
+{
+	dc1394speed_t speed;
+	{
+		Capture1394::Device::NativeLock nativeLock = device->lockNative();
+		speed = device->getNative()->bmode_capable ? DC1394_ISO_SPEED_800 : DC1394_ISO_SPEED_400;
+	}
+	vector< Candidate > candidates = rank( device->getSupportedVideoModes(), device->getFormat7Info(), constraints, speed );
+	if ( candidates.empty() )
+		return false;
+
+	*videoMode = candidates[ 0 ].mVideoMode;
+	return true;
+}
+
+} // namespace mndl
@@ -0,0 +1,67 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "cinder/Cinder.h"
+
+#include <dc1394/dc1394.h>
+
+#include "Capture1394.h"
+
+namespace mndl {
+
+/** Chooses the video mode of a camera from constraints instead of an index. The modes are ranked by their expected
+ *  throughput on the bus and the host conversion cost, rank() does not touch the cameras.
+ */
+class VideoModeSolver
+{
+	public:
+		struct Candidate
+		{
+			Candidate() : mFrameRate( 0.f ), mThroughput( 0.0 ), mCpuLoad( 0.0 ), mPreference( 0 ) {}
+
+			//! The video mode to set, Format7 modes are cropped to the minimum resolution.
+			Capture1394::VideoMode mVideoMode;
+			//! Expected frame rate.
+			float mFrameRate;
+			//! Expected megapixels per second.
+			double mThroughput;
+			//! Expected share of a cpu core converting the frames.
+			double mCpuLoad;
+			//! Position of the color coding in the preferred codings, their number if it is not listed.
+			size_t mPreference;
+		};
+
+		/** Returns the modes satisfying \a constraints, the best first. Format7 frame rates are estimated from the packet
+		 *  limits in \a format7Info at \a speed, the sensor of the camera might be slower.
+		 */
+		static std::vector< Candidate > rank( const std::vector< Capture1394::VideoMode > &videoModes,
+				const std::vector< Capture1394::Device::Format7Info > &format7Info,
+				const Capture1394::VideoModeConstraints &constraints, dc1394speed_t speed = DC1394_ISO_SPEED_400 );
+
+		//! Chooses the best mode of \a device for \a constraints into \a videoMode. Returns false if no mode satisfies them.
+		static bool solve( const Capture1394::DeviceRef &device, const Capture1394::VideoModeConstraints &constraints,
+				Capture1394::VideoMode *videoMode );
+
+		//! Returns the estimated cost of converting a pixel of \a coding to RGB8 in nanoseconds.
+		static double getConversionCost( dc1394color_coding_t coding );
+};
+
+} // namespace mndl
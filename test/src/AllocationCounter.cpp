@@ -0,0 +1,90 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#include "AllocationCounter.h"
+
+using namespace std;
+
+static atomic< bool > sCounting( false );
+static atomic< size_t > sNumAllocations( 0 );
+
+void *operator new( size_t size )
+{
+	if ( sCounting )
+		sNumAllocations++;
+	void *p = malloc( size ? size : 1 );
+	if ( !p )
+		throw bad_alloc();
+	return p;
+}
+
+void *operator new[]( size_t size )
+{
+	return operator new( size );
+}
+
+void *operator new( size_t size, const nothrow_t & ) noexcept
+{
+	if ( sCounting )
+		sNumAllocations++;
+	return malloc( size ? size : 1 );
+}
+
+void *operator new[]( size_t size, const nothrow_t &tag ) noexcept
+{
+	return operator new( size, tag );
+}
+
+void operator delete( void *p ) noexcept
+{
+	free( p );
+}
+
+void operator delete[]( void *p ) noexcept
+{
+	free( p );
+}
+
+void operator delete( void *p, const nothrow_t & ) noexcept
+{
+	free( p );
+}
+
+void operator delete[]( void *p, const nothrow_t & ) noexcept
+{
+	free( p );
+}
+
+namespace mndl { namespace test {
+
+void AllocationCounter::start()
+{
+	sNumAllocations = 0;
+	sCounting = true;
+}
+
+size_t AllocationCounter::stop()
+{
+	sCounting = false;
+	return sNumAllocations;
+}
+
+} } // namespace mndl::test
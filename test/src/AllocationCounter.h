@@ -0,0 +1,38 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+
+namespace mndl { namespace test {
+
+/** Counts the allocations of the global operator new on every thread of the test binary, which AllocationCounter.cpp
+ *  replaces. Kept out of the tests, so the compiler does not see the replaced operators next to their callers.
+ *  Direct calls of malloc(), calloc() and realloc() are not counted, replacing them would clash with the sanitizer
+ *  runtimes the tests are built with. The capture code does not call them, but allocations inside libdc1394 are missed.
+ */
+class AllocationCounter
+{
+	public:
+		//! Starts counting from zero.
+		static void start();
+		//! Stops counting and returns the allocations since start().
+		static size_t stop();
+};
+
+} } // namespace mndl::test
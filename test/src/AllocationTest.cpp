@@ -0,0 +1,82 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <thread>
+
+#include "Capture1394.h"
+
+#include "AllocationCounter.h"
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+static Capture1394Ref createCapture( Capture1394::Trigger trigger )
+{
+	MockBus::get().addDefaultCamera( 1, "Mock" );
+	return Capture1394::create( Capture1394::Options().trigger( trigger ).videoMode( Capture1394::VideoMode( ci::Vec2i( 640, 480 ),
+					DC1394_VIDEO_MODE_640x480_MONO8, DC1394_COLOR_CODING_MONO8, DC1394_FRAMERATE_30 ) ),
+			Capture1394::getDevices( true ).at( 0 ) );
+}
+
+TEST( testFreeRunningAllocations )
+{
+	// the counter sees the allocations of other threads
+	AllocationCounter::start();
+	thread( []() { delete new int( 0 ); } ).join();
+	CHECK( AllocationCounter::stop() >= 1 );
+
+	Capture1394Ref capture = createCapture( Capture1394::TRIGGER_NONE );
+	atomic< size_t > numFrames( 0 );
+	capture->setFrameCallback( [ &numFrames ]( const Capture1394::FrameInfo & ) { numFrames++; } );
+	capture->start();
+
+	// warmed up once the clock model has its first samples, which are taken every 0.5 s
+	CHECK( waitFor( [ &numFrames ]() { return numFrames >= 20; }, 10.0 ) );
+	const size_t warmFrames = numFrames;
+	AllocationCounter::start();
+	const bool delivered = waitFor( [ & ]() { return numFrames - warmFrames >= 50; }, 10.0 );
+	CHECK_EQUAL( size_t( 0 ), AllocationCounter::stop() );
+	CHECK( delivered );
+
+	capture->stop();
+}
+
+TEST( testMultiShotGrabAllocations )
+{
+	Capture1394Ref capture = createCapture( Capture1394::TRIGGER_ONE_SHOT );
+	atomic< size_t > numGrabs( 0 );
+	auto grabFn = [ &numGrabs ]( const ci::Surface8u &, const Capture1394::FrameInfo & ) { numGrabs++; };
+	capture->start();
+
+	capture->grabAsync( grabFn, 5 );
+	CHECK( waitFor( [ &numGrabs ]() { return numGrabs >= 5; }, 10.0 ) );
+	CHECK_EQUAL( size_t( 5 ), size_t( numGrabs ) );
+
+	// queuing the grab allocates on the calling thread, delivering its frames does not
+	capture->grabAsync( grabFn, 20 );
+	AllocationCounter::start();
+	const bool delivered = waitFor( [ &numGrabs ]() { return numGrabs >= 25; }, 10.0 );
+	CHECK_EQUAL( size_t( 0 ), AllocationCounter::stop() );
+	CHECK( delivered );
+	CHECK_EQUAL( size_t( 25 ), size_t( numGrabs ) );
+
+	capture->stop();
+}
@@ -0,0 +1,242 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BandwidthPlanner.h"
+#include "Capture1394.h"
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+TEST( testFormat7PacketBytes )
+{
+	// frame bytes, PACKET_PARA_INQ unit and max bytes, target frame rate and the expected BYTE_PER_PACKET
+	const struct
+	{
+		uint64_t mFrameBytes;
+		uint32_t mUnitBytes, mMaxBytes;
+		float mFrameRate;
+		uint32_t mPacketBytes;
+	} rows[] = {
+		// 640x480 MONO8 at 30 fps in 266 packets
+		{ 307200, 4, 4096, 30.f, 1156 },
+		// 1280x960 MONO8 at 15 fps in 533 packets, rounded up to the 8 byte unit
+		{ 1228800, 8, 4096, 15.f, 2312 },
+		// the same at 60 fps would need 9240 byte packets, limited to the maximum
+		{ 1228800, 8, 4096, 60.f, 4096 },
+		// 1024x768 MONO16 at 7.5 fps in 1066 packets
+		{ 1572864, 4, 8192, 7.5f, 1476 },
+		// one unit at least, however low the frame rate
+		{ 1024, 64, 4096, 1.875f, 64 },
+		// a camera not reporting its unit and no target frame rate both send the largest packets
+		{ 307200, 0, 4096, 30.f, 4096 },
+		{ 307200, 4, 4096, 0.f, 4096 },
+		// faster than one packet a cycle
+		{ 307200, 4, 4096, 16000.f, 4096 }
+	};
+	for ( size_t i = 0; i < sizeof( rows ) / sizeof( rows[ 0 ] ); i++ )
+	{
+		CHECK_EQUAL( rows[ i ].mPacketBytes, BandwidthPlanner::getFormat7PacketBytes( rows[ i ].mFrameBytes,
+					rows[ i ].mUnitBytes, rows[ i ].mMaxBytes, rows[ i ].mFrameRate ) );
+	}
+}
+
+TEST( testApplyVideoModeSelection )
+{
+	// the registers of the Format7 mode, the requested mode and the packet size and frame interval it should end up with
+	const struct
+	{
+		ci::Vec2i mMaxSize;
+		dc1394color_coding_t mColorCoding;
+		uint32_t mUnitBytes, mMaxBytes;
+		//! FRAME_INTERVAL_INQ of the sensor, 0 if the camera does not have the register.
+		double mSensorInterval;
+		float mTargetFrameRate;
+		uint32_t mPacketSize;
+		uint32_t mExpectedPacketBytes;
+		double mExpectedInterval;
+	} rows[] = {
+		// 266 packets a frame, one per cycle
+		{ ci::Vec2i( 640, 480 ), DC1394_COLOR_CODING_MONO8, 4, 4096, 0.0, 30.f, 0, 1156, 266 / 8000.0 },
+		// the sensor is slower than the bus, its frame interval register wins
+		{ ci::Vec2i( 640, 480 ), DC1394_COLOR_CODING_MONO8, 4, 4096, 0.04, 30.f, 0, 1156, 0.04 },
+		// and the bus when it is the slower one
+		{ ci::Vec2i( 640, 480 ), DC1394_COLOR_CODING_MONO8, 4, 4096, 0.01, 30.f, 0, 1156, 266 / 8000.0 },
+		{ ci::Vec2i( 1280, 960 ), DC1394_COLOR_CODING_MONO8, 8, 4096, 0.0, 15.f, 0, 2312, 532 / 8000.0 },
+		{ ci::Vec2i( 1280, 960 ), DC1394_COLOR_CODING_MONO8, 8, 4096, 0.0, 60.f, 0, 4096, 300 / 8000.0 },
+		{ ci::Vec2i( 1024, 768 ), DC1394_COLOR_CODING_MONO16, 4, 8192, 0.0, 7.5f, 0, 1476, 1066 / 8000.0 },
+		// an explicit packet size is used as it is
+		{ ci::Vec2i( 640, 480 ), DC1394_COLOR_CODING_MONO8, 4, 4096, 0.0, 30.f, 2048, 2048, 150 / 8000.0 },
+		// no target frame rate, the camera sends as fast as it can
+		{ ci::Vec2i( 640, 480 ), DC1394_COLOR_CODING_MONO8, 4, 4096, 0.0, 0.f, 0, 4096, 75 / 8000.0 }
+	};
+	for ( size_t i = 0; i < sizeof( rows ) / sizeof( rows[ 0 ] ); i++ )
+	{
+		MockBus::get().reset();
+		MockBus::Format7Mode &mode = MockBus::get().addDefaultCamera( 1, "Mock" ).mFormat7[ 0 ];
+		mode.mMaxSize = rows[ i ].mMaxSize;
+		mode.mSize = rows[ i ].mMaxSize;
+		mode.mColorCoding = rows[ i ].mColorCoding;
+		mode.mUnitBytes = rows[ i ].mUnitBytes;
+		mode.mMaxBytes = rows[ i ].mMaxBytes;
+		mode.mPacketBytes = rows[ i ].mMaxBytes;
+		mode.mSensorInterval = rows[ i ].mSensorInterval;
+
+		Capture1394::VideoMode videoMode( rows[ i ].mMaxSize, DC1394_VIDEO_MODE_FORMAT7_0, rows[ i ].mColorCoding );
+		videoMode.targetFrameRate( rows[ i ].mTargetFrameRate ).packetSize( rows[ i ].mPacketSize );
+		Capture1394Ref capture = Capture1394::create( Capture1394::Options().videoMode( videoMode ),
+				Capture1394::getDevices( true ).at( 0 ) );
+
+		CHECK_EQUAL( rows[ i ].mExpectedPacketBytes, mode.mPacketBytes );
+		CHECK_CLOSE( rows[ i ].mExpectedInterval, capture->getFrameInterval(), 1e-6 );
+		CHECK_EQUAL( DC1394_VIDEO_MODE_FORMAT7_0, MockBus::get().findCamera( 1 )->mVideoMode );
+	}
+}
+
+TEST( testBandwidthUnits )
+{
+	// a 4096 byte packet is 1027 quadlets with the header and trailer, counted in S1600 units
+	CHECK_EQUAL( 4108u, BandwidthPlanner::getBandwidthUnits( 4096, DC1394_ISO_SPEED_400 ) );
+	CHECK_EQUAL( 2054u, BandwidthPlanner::getBandwidthUnits( 4096, DC1394_ISO_SPEED_800 ) );
+	CHECK_EQUAL( 1027u, BandwidthPlanner::getBandwidthUnits( 4096, DC1394_ISO_SPEED_1600 ) );
+	CHECK_EQUAL( 4u * 4u, BandwidthPlanner::getBandwidthUnits( 1, DC1394_ISO_SPEED_400 ) );
+	CHECK_EQUAL( 4096u, BandwidthPlanner::getMaxPacketBytes( DC1394_ISO_SPEED_400 ) );
+	CHECK_EQUAL( 8192u, BandwidthPlanner::getMaxPacketBytes( DC1394_ISO_SPEED_800 ) );
+}
+
+static BandwidthPlanner::Request createFixedRequest( uint64_t frameBytes, float frameRate )
+{
+	BandwidthPlanner::Request request;
+	request.mFrameBytes = frameBytes;
+	request.mFrameRate = frameRate;
+	return request;
+}
+
+static BandwidthPlanner::Request createFormat7Request( uint64_t frameBytes, uint32_t unitBytes, uint32_t maxBytes, float maxFrameRate = 0.f )
+{
+	BandwidthPlanner::Request request;
+	request.mFormat7 = true;
+	request.mFrameBytes = frameBytes;
+	request.mUnitBytes = unitBytes;
+	request.mMaxBytes = maxBytes;
+	request.mMaxFrameRate = maxFrameRate;
+	return request;
+}
+
+//! Checks the invariants of a feasible plan.
+static void checkPlan( const vector< BandwidthPlanner::Request > &requests, const BandwidthPlanner::Plan &plan )
+{
+	CHECK( plan.mFeasible );
+	CHECK_EQUAL( requests.size(), plan.mAllocations.size() );
+	uint32_t units = 0;
+	float frameRate = 0.f;
+	for ( size_t i = 0; i < plan.mAllocations.size(); i++ )
+	{
+		const BandwidthPlanner::Allocation &allocation = plan.mAllocations[ i ];
+		CHECK_EQUAL( BandwidthPlanner::getBandwidthUnits( allocation.mPacketBytes, allocation.mSpeed ), allocation.mBandwidthUnits );
+		CHECK( allocation.mPacketBytes <= BandwidthPlanner::getMaxPacketBytes( allocation.mSpeed ) );
+		if ( requests[ i ].mFormat7 )
+		{
+			CHECK_EQUAL( 0u, allocation.mPacketBytes % requests[ i ].mUnitBytes );
+			CHECK( allocation.mPacketBytes <= requests[ i ].mMaxBytes );
+		}
+		units += allocation.mBandwidthUnits;
+		frameRate += allocation.mFrameRate;
+	}
+	CHECK_EQUAL( units, plan.mBandwidthUnits );
+	CHECK( units <= BandwidthPlanner::kMaxBandwidthUnits );
+	CHECK_CLOSE( frameRate, plan.mFrameRate, 1e-3 );
+}
+
+TEST( testPlanFixedModes )
+{
+	// 640x480 MONO8 at 30 fps sends 1152 bytes a cycle, 1164 units at S400, four cameras fit, five do not
+	vector< BandwidthPlanner::Request > requests( 4, createFixedRequest( 307200, 30.f ) );
+	BandwidthPlanner::Plan plan = BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_400 );
+	checkPlan( requests, plan );
+	CHECK_EQUAL( 1152u, plan.mAllocations[ 0 ].mPacketBytes );
+	CHECK_EQUAL( 4u * 1164u, plan.mBandwidthUnits );
+	CHECK_CLOSE( 120.f, plan.mFrameRate, 1e-3 );
+
+	requests.push_back( createFixedRequest( 307200, 30.f ) );
+	CHECK( !BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_400 ).mFeasible );
+
+	// a single camera sending more than a packet a cycle
+	requests.assign( 1, createFixedRequest( 1280 * 960 * 3, 60.f ) );
+	CHECK( !BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_400 ).mFeasible );
+}
+
+TEST( testPlanFormat7 )
+{
+	// two 1280x960 MONO8 cameras share the bus for over 31 fps together, the bus is full once neither packet can grow
+	vector< BandwidthPlanner::Request > requests( 2, createFormat7Request( 1228800, 8, 4096 ) );
+	BandwidthPlanner::Plan plan = BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_400 );
+	checkPlan( requests, plan );
+	CHECK( plan.mFrameRate > 31.f );
+	CHECK( plan.mAllocations[ 0 ].mFrameRate > 14.f );
+	CHECK( plan.mAllocations[ 1 ].mFrameRate > 14.f );
+	CHECK( plan.mBandwidthUnits + BandwidthPlanner::getBandwidthUnits( 8, DC1394_ISO_SPEED_400 ) > BandwidthPlanner::kMaxBandwidthUnits );
+	for ( size_t i = 0; i < 2; i++ )
+	{
+		CHECK_CLOSE( BandwidthPlanner::getFormat7FrameRate( 1228800, plan.mAllocations[ i ].mPacketBytes ),
+				plan.mAllocations[ i ].mFrameRate, 1e-3 );
+	}
+
+	// capping the first camera at 5 fps leaves the bandwidth to the second
+	requests[ 0 ].mMaxFrameRate = 5.f;
+	BandwidthPlanner::Plan capped = BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_400 );
+	checkPlan( requests, capped );
+	CHECK( capped.mAllocations[ 0 ].mFrameRate <= 5.f );
+	CHECK( capped.mAllocations[ 1 ].mFrameRate > plan.mAllocations[ 1 ].mFrameRate );
+
+	// a camera not reporting its packet unit cannot be planned
+	requests[ 1 ].mUnitBytes = 0;
+	CHECK( !BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_400 ).mFeasible );
+}
+
+TEST( testPlanMixedModes )
+{
+	// 640x480 RGB8 at 30 fps takes 3468 units, the Format7 camera gets the rest of the cycle
+	vector< BandwidthPlanner::Request > requests;
+	requests.push_back( createFixedRequest( 921600, 30.f ) );
+	requests.push_back( createFormat7Request( 1228800, 8, 4096 ) );
+	BandwidthPlanner::Plan plan = BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_400 );
+	checkPlan( requests, plan );
+	CHECK_EQUAL( 3468u, plan.mAllocations[ 0 ].mBandwidthUnits );
+	CHECK( plan.mAllocations[ 1 ].mBandwidthUnits <= BandwidthPlanner::kMaxBandwidthUnits - 3468u );
+	CHECK_CLOSE( 30.f, plan.mAllocations[ 0 ].mFrameRate, 1e-3 );
+}
+
+TEST( testPlanSpeed )
+{
+	// every camera runs at the highest speed it shares with the bus
+	vector< BandwidthPlanner::Request > requests( 2, createFormat7Request( 1228800, 8, 8192 ) );
+	requests[ 1 ].mMaxSpeed = DC1394_ISO_SPEED_800;
+	BandwidthPlanner::Plan plan = BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_800 );
+	checkPlan( requests, plan );
+	CHECK_EQUAL( DC1394_ISO_SPEED_400, plan.mAllocations[ 0 ].mSpeed );
+	CHECK_EQUAL( DC1394_ISO_SPEED_800, plan.mAllocations[ 1 ].mSpeed );
+	// the faster camera gets more frames out of the same units
+	CHECK( plan.mAllocations[ 1 ].mFrameRate > plan.mAllocations[ 0 ].mFrameRate );
+
+	plan = BandwidthPlanner::plan( requests, DC1394_ISO_SPEED_400 );
+	checkPlan( requests, plan );
+	CHECK_EQUAL( DC1394_ISO_SPEED_400, plan.mAllocations[ 1 ].mSpeed );
+}
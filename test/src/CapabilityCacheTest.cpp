@@ -0,0 +1,196 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "Capture1394.h"
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+//! An empty cache directory Capture1394 uses while it exists, removed with the file of the mock camera even if a check fails.
+struct CacheDirectory
+{
+	CacheDirectory()
+	{
+		char directory[] = "/tmp/capture1394-test-XXXXXX";
+		CHECK( mkdtemp( directory ) != NULL );
+		mDirectory = directory;
+		Capture1394::setCapabilityCacheDirectory( ci::fs::path( mDirectory ) );
+	}
+
+	~CacheDirectory()
+	{
+		Capture1394::setCapabilityCacheDirectory( ci::fs::path() );
+		remove( getFile().c_str() );
+		rmdir( mDirectory.c_str() );
+	}
+
+	//! The cache file of the mock camera of GUID 1.
+	string getFile() const { return mDirectory + "/0000000000000001.cache"; }
+
+	string mDirectory;
+};
+
+//! Returns the probes of the camera, a probe reads the supported modes once.
+static size_t getNumProbes()
+{
+	return MockBus::get().getNumCalls( "dc1394_video_get_supported_modes" );
+}
+
+static void checkCapabilities( const Capture1394::DeviceRef &expected, const Capture1394::DeviceRef &actual )
+{
+	const vector< Capture1394::VideoMode > &expectedModes = expected->getSupportedVideoModes();
+	const vector< Capture1394::VideoMode > &actualModes = actual->getSupportedVideoModes();
+	CHECK_EQUAL( expectedModes.size(), actualModes.size() );
+	for ( size_t i = 0; i < min( expectedModes.size(), actualModes.size() ); i++ )
+	{
+		CHECK( expectedModes[ i ].getResolution() == actualModes[ i ].getResolution() );
+		CHECK_EQUAL( expectedModes[ i ].getVideoMode(), actualModes[ i ].getVideoMode() );
+		CHECK_EQUAL( expectedModes[ i ].getColorCoding(), actualModes[ i ].getColorCoding() );
+		CHECK_EQUAL( expectedModes[ i ].getFrameRate(), actualModes[ i ].getFrameRate() );
+	}
+
+	const vector< Capture1394::Device::Format7Info > &expectedFormat7 = expected->getFormat7Info();
+	const vector< Capture1394::Device::Format7Info > &actualFormat7 = actual->getFormat7Info();
+	CHECK_EQUAL( expectedFormat7.size(), actualFormat7.size() );
+	for ( size_t i = 0; i < min( expectedFormat7.size(), actualFormat7.size() ); i++ )
+	{
+		CHECK_EQUAL( expectedFormat7[ i ].mVideoMode, actualFormat7[ i ].mVideoMode );
+		CHECK( expectedFormat7[ i ].mMaxSize == actualFormat7[ i ].mMaxSize );
+		CHECK( expectedFormat7[ i ].mUnitSize == actualFormat7[ i ].mUnitSize );
+		CHECK( expectedFormat7[ i ].mUnitPosition == actualFormat7[ i ].mUnitPosition );
+		CHECK_EQUAL( expectedFormat7[ i ].mUnitBytes, actualFormat7[ i ].mUnitBytes );
+		CHECK_EQUAL( expectedFormat7[ i ].mMaxBytes, actualFormat7[ i ].mMaxBytes );
+	}
+
+	const vector< Capture1394::Device::FeatureInfo > &expectedFeatures = expected->getFeatureInfo();
+	const vector< Capture1394::Device::FeatureInfo > &actualFeatures = actual->getFeatureInfo();
+	CHECK_EQUAL( expectedFeatures.size(), actualFeatures.size() );
+	for ( size_t i = 0; i < min( expectedFeatures.size(), actualFeatures.size() ); i++ )
+	{
+		CHECK_EQUAL( expectedFeatures[ i ].mId, actualFeatures[ i ].mId );
+		CHECK_EQUAL( expectedFeatures[ i ].mMin, actualFeatures[ i ].mMin );
+		CHECK_EQUAL( expectedFeatures[ i ].mMax, actualFeatures[ i ].mMax );
+		CHECK_EQUAL( expectedFeatures[ i ].mAbsoluteCapable, actualFeatures[ i ].mAbsoluteCapable );
+		CHECK_EQUAL( expectedFeatures[ i ].mAbsoluteMin, actualFeatures[ i ].mAbsoluteMin );
+		CHECK_EQUAL( expectedFeatures[ i ].mAbsoluteMax, actualFeatures[ i ].mAbsoluteMax );
+	}
+}
+
+TEST( testCapabilityCacheRoundTrip )
+{
+	MockBus::get().addDefaultCamera( 1, "Mock" );
+	CacheDirectory directory;
+
+	Capture1394::DeviceRef probed = Capture1394::getDevices( true ).at( 0 );
+	CHECK( !probed->getSupportedVideoModes().empty() );
+	CHECK_EQUAL( size_t( 1 ), getNumProbes() );
+	CHECK( ci::fs::exists( ci::fs::path( directory.getFile() ) ) );
+
+	// the next start reads the capabilities from the cache
+	Capture1394::DeviceRef cached = Capture1394::getDevices( true ).at( 0 );
+	checkCapabilities( probed, cached );
+	CHECK_EQUAL( size_t( 1 ), getNumProbes() );
+	CHECK_EQUAL( size_t( 1 ), MockBus::get().getNumCalls( "dc1394_feature_get_all" ) );
+}
+
+TEST( testCapabilityCacheValidation )
+{
+	MockBus::Camera &camera = MockBus::get().addDefaultCamera( 1, "Mock" );
+	CacheDirectory directory;
+	Capture1394::getDevices( true ).at( 0 )->getSupportedVideoModes();
+	CHECK_EQUAL( size_t( 1 ), getNumProbes() );
+
+	// a firmware update invalidates the entry, the probe rewrites it
+	{
+		lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+		camera.mSwVersion++;
+	}
+	Capture1394::getDevices( true ).at( 0 )->getSupportedVideoModes();
+	CHECK_EQUAL( size_t( 2 ), getNumProbes() );
+	Capture1394::getDevices( true ).at( 0 )->getSupportedVideoModes();
+	CHECK_EQUAL( size_t( 2 ), getNumProbes() );
+
+	// so does a change of the video formats of the camera
+	{
+		lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+		camera.mRegisters[ 0x100 ] |= 0x40000000;
+	}
+	Capture1394::getDevices( true ).at( 0 )->getSupportedVideoModes();
+	CHECK_EQUAL( size_t( 3 ), getNumProbes() );
+
+	// and a truncated file
+	{
+		ofstream out( directory.getFile().c_str() );
+		out << "capture1394-capabilities 2\n" << camera.mVendorId << " " << camera.mModelId << " " << camera.mSwVersion << "\n";
+	}
+	Capture1394::DeviceRef probed = Capture1394::getDevices( true ).at( 0 );
+	CHECK( !probed->getSupportedVideoModes().empty() );
+	CHECK_EQUAL( size_t( 4 ), getNumProbes() );
+
+	// as well as a failed signature read, the entry cannot be checked
+	MockBus::get().fail( "dc1394_get_control_registers", DC1394_FAILURE, 1 );
+	Capture1394::getDevices( true ).at( 0 )->getSupportedVideoModes();
+	CHECK_EQUAL( size_t( 5 ), getNumProbes() );
+
+	Capture1394::DeviceRef cached = Capture1394::getDevices( true ).at( 0 );
+	checkCapabilities( probed, cached );
+	CHECK_EQUAL( size_t( 5 ), getNumProbes() );
+}
+
+TEST( testCapabilitiesMemoized )
+{
+	// the capabilities are probed once per device, however many threads ask for them
+	for ( uint64_t guid = 1; guid <= 3; guid++ )
+		MockBus::get().addDefaultCamera( guid, "Mock" );
+	const vector< Capture1394::DeviceRef > &devices = Capture1394::getDevices( true );
+	CHECK_EQUAL( size_t( 3 ), devices.size() );
+	CHECK_EQUAL( size_t( 3 ), getNumProbes() );
+
+	vector< thread > threads;
+	for ( int i = 0; i < 4; i++ )
+	{
+		threads.push_back( thread( [ &devices ]()
+					{
+						for ( int j = 0; j < 100; j++ )
+						{
+							const Capture1394::DeviceRef &device = devices[ j % devices.size() ];
+							device->getSupportedVideoModes();
+							device->getFormat7Info();
+							device->getFeatureInfo();
+						}
+					} ) );
+	}
+	for ( auto it = threads.begin(); it != threads.end(); ++it )
+		it->join();
+
+	CHECK_EQUAL( size_t( 3 ), getNumProbes() );
+	CHECK_EQUAL( size_t( 3 ), MockBus::get().getNumCalls( "dc1394_feature_get_all" ) );
+	CHECK_EQUAL( size_t( 3 ), MockBus::get().getNumCalls( "dc1394_format7_get_modeset" ) );
+}
@@ -0,0 +1,235 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+#include "Capture1394.h"
+#include "CaptureGroup.h"
+#include "RegisterBatch.h"
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+//! Returns a frame exposed \a time microseconds after an arbitrary epoch.
+static FrameSetAssembler::Frame createFrame( int64_t time )
+{
+	FrameSetAssembler::Frame frame;
+	frame.mFrameInfo.mExposureTime = chrono::steady_clock::time_point( chrono::microseconds( 1000000000 + time ) );
+	return frame;
+}
+
+//! Repeatable jitter in [ -\a amplitude, \a amplitude ] microseconds.
+static int64_t jitter( uint32_t *state, int64_t amplitude )
+{
+	*state = *state * 1664525u + 1013904223u;
+	return static_cast< int64_t >( *state >> 8 ) % ( 2 * amplitude + 1 ) - amplitude;
+}
+
+TEST( testAssembleJitteredFrames )
+{
+	// three cameras at 50 fps, their exposure times jittered by up to 0.9 ms, arriving in changing order
+	const int64_t kPeriod = 20000;
+	FrameSetAssembler assembler( 3, 2000 );
+	uint32_t state = 1;
+	size_t numSets = 0;
+	vector< FrameSetAssembler::Frame > frameSet;
+	for ( int64_t i = 0; i < 100; i++ )
+	{
+		for ( size_t c = 0; c < 3; c++ )
+		{
+			size_t camera = ( c + static_cast< size_t >( i ) ) % 3;
+			if ( !assembler.push( camera, createFrame( i * kPeriod + jitter( &state, 900 ) ), &frameSet ) )
+				continue;
+
+			numSets++;
+			CHECK_EQUAL( size_t( 3 ), frameSet.size() );
+			int64_t oldest = FrameSetAssembler::getTime( frameSet[ 0 ] );
+			int64_t newest = oldest;
+			for ( auto it = frameSet.cbegin(); it != frameSet.cend(); ++it )
+			{
+				oldest = min( oldest, FrameSetAssembler::getTime( *it ) );
+				newest = max( newest, FrameSetAssembler::getTime( *it ) );
+			}
+			CHECK( newest - oldest <= 2000 );
+			CHECK( abs( oldest - ( 1000000000 + i * kPeriod ) ) <= 900 );
+		}
+	}
+	CHECK_EQUAL( size_t( 100 ), numSets );
+	CHECK_EQUAL( uint64_t( 100 ), assembler.getNumFrameSets() );
+	CHECK_EQUAL( uint64_t( 0 ), assembler.getNumIncompleteFrameSets() );
+}
+
+TEST( testAssembleDroppedFrame )
+{
+	// the second camera loses frame 5, only its set is given up
+	FrameSetAssembler assembler( 2, 2000 );
+	uint32_t state = 7;
+	vector< FrameSetAssembler::Frame > frameSet;
+	for ( int64_t i = 0; i < 10; i++ )
+	{
+		assembler.push( 0, createFrame( i * 20000 + jitter( &state, 900 ) ), &frameSet );
+		if ( i != 5 )
+			assembler.push( 1, createFrame( i * 20000 + jitter( &state, 900 ) ), &frameSet );
+	}
+	CHECK_EQUAL( uint64_t( 9 ), assembler.getNumFrameSets() );
+	CHECK_EQUAL( uint64_t( 1 ), assembler.getNumIncompleteFrameSets() );
+	CHECK( assembler.getPending( 0 ).empty() );
+	CHECK( assembler.getPending( 1 ).empty() );
+}
+
+TEST( testAssembleStalledCamera )
+{
+	// a camera sending nothing holds back at most the maximum pending frames of the others
+	FrameSetAssembler assembler( 2, 2000, 4 );
+	vector< FrameSetAssembler::Frame > frameSet;
+	for ( int64_t i = 0; i < 10; i++ )
+		CHECK( !assembler.push( 0, createFrame( i * 20000 ), &frameSet ) );
+	CHECK_EQUAL( size_t( 4 ), assembler.getPending( 0 ).size() );
+	CHECK_EQUAL( uint64_t( 6 ), assembler.getNumIncompleteFrameSets() );
+
+	// the first frame of the stalled camera matches the newest pending frame
+	CHECK( assembler.push( 1, createFrame( 9 * 20000 + 500 ), &frameSet ) );
+	CHECK_EQUAL( FrameSetAssembler::getTime( createFrame( 9 * 20000 ) ), FrameSetAssembler::getTime( frameSet[ 0 ] ) );
+	CHECK_EQUAL( uint64_t( 9 ), assembler.getNumIncompleteFrameSets() );
+}
+
+TEST( testCaptureGroupJitteredTimestamps )
+{
+	// two cameras of the same period, the host timestamps of their frames jittered by up to 0.5 ms
+	for ( uint64_t guid = 1; guid <= 2; guid++ )
+	{
+		MockBus::Camera &camera = MockBus::get().addDefaultCamera( guid, "Mock" );
+		camera.mFramePeriod = 0.02;
+		camera.mTimestampJitter = 0.0005;
+	}
+
+	vector< Capture1394Ref > captures;
+	const vector< Capture1394::DeviceRef > &devices = Capture1394::getDevices( true );
+	CHECK_EQUAL( size_t( 2 ), devices.size() );
+	for ( auto it = devices.cbegin(); it != devices.cend(); ++it )
+	{
+		// a small region keeps the copies cheap enough for sanitizer builds to follow the frame period
+		captures.push_back( Capture1394::create( Capture1394::Options().videoMode( Capture1394::VideoMode( ci::Vec2i( 160, 120 ),
+							DC1394_VIDEO_MODE_FORMAT7_0, DC1394_COLOR_CODING_MONO8 ) ), *it ) );
+	}
+
+	CaptureGroupRef group = CaptureGroup::create( captures, 0.002 );
+	mutex setMutex;
+	size_t numSets = 0;
+	int64_t maxSkew = 0;
+	bool uniform = true;
+	group->setFrameSetCallback( [ & ]( const CaptureGroup::FrameSet &frameSet )
+			{
+				lock_guard< mutex > lock( setMutex );
+				numSets++;
+				int64_t t0 = FrameSetAssembler::getTime( FrameSetAssembler::Frame{ ci::Surface8u(), frameSet.mFrameInfos[ 0 ] } );
+				int64_t t1 = FrameSetAssembler::getTime( FrameSetAssembler::Frame{ ci::Surface8u(), frameSet.mFrameInfos[ 1 ] } );
+				maxSkew = max( maxSkew, abs( t0 - t1 ) );
+
+				// every byte of a simulated frame holds its number, a torn copy would mix two frames
+				for ( auto it = frameSet.mSurfaces.cbegin(); it != frameSet.mSurfaces.cend(); ++it )
+				{
+					const uint8_t *data = it->getData();
+					for ( int32_t y = 0; y < it->getHeight(); y++ )
+					{
+						const uint8_t *row = data + y * it->getRowBytes();
+						uniform = uniform && ( count( row, row + it->getWidth() * 3, data[ 0 ] ) == it->getWidth() * 3 );
+					}
+				}
+			} );
+
+	group->start();
+	// 50 sets take a second, the deadline leaves room for slow sanitizer builds
+	CHECK( waitFor( [ & ]() { lock_guard< mutex > lock( setMutex ); return numSets >= 50; }, 10.0 ) );
+	// stop() resets the counters
+	uint64_t numIncomplete = group->getNumIncompleteFrameSets();
+	group->stop();
+
+	lock_guard< mutex > lock( setMutex );
+	CHECK( numIncomplete <= 10 );
+	CHECK( maxSkew <= 2000 );
+	CHECK( uniform );
+}
+
+//! Returns the register at \a offset of the camera of \a guid.
+static uint32_t getRegister( uint64_t guid, uint64_t offset )
+{
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	return MockBus::get().findCamera( guid )->mRegisters[ offset ];
+}
+
+TEST( testBroadcastControl )
+{
+	// the second camera runs its gain in auto mode
+	for ( uint64_t guid = 1; guid <= 2; guid++ )
+		MockBus::get().addDefaultCamera( guid, "Mock" );
+	const uint64_t gainOffset = RegisterBatch::getFeatureValueOffset( DC1394_FEATURE_GAIN );
+	{
+		lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+		MockBus::get().findCamera( 2 )->mRegisters[ gainOffset ] |= 0x01000000;
+	}
+
+	vector< Capture1394Ref > captures;
+	const vector< Capture1394::DeviceRef > &devices = Capture1394::getDevices( true );
+	for ( auto it = devices.cbegin(); it != devices.cend(); ++it )
+		captures.push_back( Capture1394::create( Capture1394::Options().trigger( Capture1394::TRIGGER_ONE_SHOT ), *it ) );
+	CaptureGroupRef group = CaptureGroup::create( captures );
+
+	// the register is composed from the first camera and only the write goes out with broadcast on
+	const size_t numWrites = MockBus::get().getNumCalls( "dc1394_set_control_registers" );
+	CHECK( group->setFeatureValue( DC1394_FEATURE_GAIN, 300 ) );
+	CHECK_EQUAL( numWrites + 1, MockBus::get().getNumCalls( "dc1394_set_control_registers" ) );
+	CHECK_EQUAL( getRegister( 1, gainOffset ), getRegister( 2, gainOffset ) );
+	CHECK_EQUAL( 300u, getRegister( 2, gainOffset ) & 0xfff );
+	CHECK_EQUAL( 0u, getRegister( 2, gainOffset ) & 0x01000000 );
+	{
+		lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+		CHECK( ( !MockBus::get().findCamera( 1 )->mBroadcast ) && ( !MockBus::get().findCamera( 2 )->mBroadcast ) );
+	}
+
+	CHECK( group->setFeatureMode( DC1394_FEATURE_GAIN, DC1394_FEATURE_MODE_AUTO ) );
+	CHECK_EQUAL( 300u | 0x01000000, getRegister( 2, gainOffset ) & 0x01000fff );
+	CHECK( group->setTriggerMode( DC1394_TRIGGER_MODE_15 ) );
+	CHECK( group->setTriggerSource( DC1394_TRIGGER_SOURCE_SOFTWARE ) );
+	CHECK( group->setTriggerPower( true ) );
+	CHECK_EQUAL( 0x02000000u | ( 7u << 21 ) | ( 15u << 16 ), getRegister( 2, 0x830 ) & 0x02ef0000 );
+
+	CHECK( group->softwareTrigger() );
+	{
+		lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+		CHECK( MockBus::get().findCamera( 1 )->mPendingShots == 1 );
+		CHECK( MockBus::get().findCamera( 2 )->mPendingShots == 1 );
+	}
+
+	// one by one every camera keeps the other bits of its register
+	{
+		lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+		MockBus::get().findCamera( 2 )->mRegisters[ gainOffset ] &= ~0x01000000;
+	}
+	group->setBroadcastEnabled( false );
+	CHECK( !group->setFeatureValue( DC1394_FEATURE_GAIN, 400 ) );
+	CHECK_EQUAL( 400u | 0x01000000, getRegister( 1, gainOffset ) & 0x01000fff );
+	CHECK_EQUAL( 400u, getRegister( 2, gainOffset ) & 0x01000fff );
+}
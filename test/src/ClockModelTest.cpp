@@ -0,0 +1,171 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "ClockModel.h"
+
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+//! Returns the cycle timer register at \a busTime seconds, truncated to the offset tick like the hardware.
+static uint32_t encodeCycleTimer( double busTime )
+{
+	double seconds = fmod( busTime, 128.0 );
+	uint32_t wholeSeconds = static_cast< uint32_t >( seconds );
+	double cycles = ( seconds - wholeSeconds ) * 8000.0;
+	uint32_t wholeCycles = min( static_cast< uint32_t >( cycles ), 7999u );
+	uint32_t offset = min( static_cast< uint32_t >( ( cycles - wholeCycles ) * 3072.0 ), 3071u );
+	return ( wholeSeconds << 25 ) | ( wholeCycles << 12 ) | offset;
+}
+
+/** A bus clock running 50 ppm fast, starting 8 seconds before its wrap around, a host clock at \a hostOffset microseconds
+ *  and the steady clock, sampled every half second like Capture1394 does.
+ */
+struct Clocks
+{
+	Clocks( uint64_t hostOffset = 0 ) : mHostOffset( hostOffset ) {}
+
+	double getBus( double t ) const { return 120.0 + t * ( 1.0 + 50e-6 ); }
+	uint64_t getHost( double t ) const { return 1700000000000000ull + mHostOffset + static_cast< uint64_t >( llround( t * 1e6 ) ); }
+	chrono::steady_clock::time_point getSteady( double t ) const
+	{ return chrono::steady_clock::time_point( chrono::hours( 1 ) ) +
+		chrono::duration_cast< chrono::steady_clock::duration >( chrono::duration< double >( t ) ); }
+
+	void addSample( ClockModel *model, double t ) const
+	{ model->addSample( encodeCycleTimer( getBus( t ) ), getHost( t ), getSteady( t ) ); }
+
+	uint64_t mHostOffset;
+};
+
+TEST( testCycleTimerToSeconds )
+{
+	CHECK_CLOSE( 0.0, ClockModel::cycleTimerToSeconds( 0 ), 1e-12 );
+	CHECK_CLOSE( 127.0, ClockModel::cycleTimerToSeconds( 127u << 25 ), 1e-12 );
+	CHECK_CLOSE( 5.5, ClockModel::cycleTimerToSeconds( ( 5u << 25 ) | ( 4000u << 12 ) ), 1e-12 );
+	CHECK_CLOSE( 1.0 / 8000.0 + 0.5 / 8000.0, ClockModel::cycleTimerToSeconds( ( 1u << 12 ) | 1536u ), 1e-12 );
+	CHECK_CLOSE( 42.123456, ClockModel::cycleTimerToSeconds( encodeCycleTimer( 42.123456 ) ), 1e-7 );
+}
+
+TEST( testClockModelFit )
+{
+	Clocks clocks;
+	ClockModel model;
+	CHECK( !model.isValid() );
+	clocks.addSample( &model, 0.0 );
+	CHECK( !model.isValid() );
+	clocks.addSample( &model, 0.5 );
+	CHECK( model.isValid() );
+
+	// across two wrap arounds of the cycle timer, the ring keeps the last 32 samples
+	for ( int i = 2; i <= 400; i++ )
+		clocks.addSample( &model, i * 0.5 );
+
+	const double times[] = { 180.0, 199.9, 200.0, 200.25, 205.0 };
+	for ( size_t i = 0; i < sizeof( times ) / sizeof( times[ 0 ] ); i++ )
+	{
+		double t = times[ i ];
+		// bus times count from the first sample
+		double bus = model.hostToBus( clocks.getHost( t ) );
+		CHECK_CLOSE( clocks.getBus( t ) - clocks.getBus( 0.0 ), bus, 1e-6 );
+		CHECK_CLOSE( 0.0, chrono::duration< double >( model.busToSteady( bus ) - clocks.getSteady( t ) ).count(), 1e-6 );
+	}
+
+	model.reset();
+	CHECK( !model.isValid() );
+}
+
+TEST( testClockModelHostStep )
+{
+	// the host clock is stepped by 5 ms, once the ring only holds samples after the step the model follows it
+	Clocks before, after( 5000 );
+	ClockModel model( 8 );
+	for ( int i = 0; i < 8; i++ )
+		before.addSample( &model, i * 0.5 );
+	CHECK_CLOSE( 0.0, chrono::duration< double >( model.busToSteady( model.hostToBus( before.getHost( 4.0 ) ) ) -
+				before.getSteady( 4.0 ) ).count(), 1e-6 );
+
+	for ( int i = 8; i < 16; i++ )
+		after.addSample( &model, i * 0.5 );
+	CHECK_CLOSE( 0.0, chrono::duration< double >( model.busToSteady( model.hostToBus( after.getHost( 8.0 ) ) ) -
+				after.getSteady( 8.0 ) ).count(), 1e-6 );
+}
+
+/** Returns the errors of the smoothed steady times of \a numFrames frames every \a period seconds from \a start, with
+ *  their host timestamps late by up to \a jitter seconds. Every 37th frame is dropped, the first \a numSettling frames
+ *  are not measured.
+ */
+static vector< double > getFrameTimeErrors( ClockModel *model, const Clocks &clocks, mt19937 *random, double start,
+		double period, int numFrames, int numSettling, double jitter )
+{
+	uniform_real_distribution< double > latency( 0.0, jitter );
+	vector< double > errors;
+	for ( int i = 0; i < numFrames; i++ )
+	{
+		double t = start + i * period;
+		if ( fmod( t, 0.5 ) < period )
+			clocks.addSample( model, t );
+		if ( i % 37 == 36 )
+			continue;
+
+		double bus = model->smoothFrameTime( model->hostToBus( clocks.getHost( t + latency( *random ) ) ) );
+		if ( i >= numSettling )
+			errors.push_back( chrono::duration< double >( model->busToSteady( bus ) - clocks.getSteady( t ) ).count() );
+	}
+	return errors;
+}
+
+//! Checks that the jitter left in \a errors around their mean, the mean latency, is well below the \a jitter of the input.
+static void checkResidualJitter( const vector< double > &errors, double jitter )
+{
+	double mean = 0.0;
+	for ( auto it = errors.cbegin(); it != errors.cend(); ++it )
+		mean += *it;
+	mean /= errors.size();
+	CHECK_CLOSE( jitter / 2, mean, jitter / 10 );
+
+	// uniform input jitter has an rms of jitter / sqrt( 12 )
+	double maxResidual = 0.0, sumSquares = 0.0;
+	for ( auto it = errors.cbegin(); it != errors.cend(); ++it )
+	{
+		maxResidual = max( maxResidual, abs( *it - mean ) );
+		sumSquares += ( *it - mean ) * ( *it - mean );
+	}
+	CHECK( sqrt( sumSquares / errors.size() ) < jitter / sqrt( 12.0 ) / 3 );
+	CHECK( maxResidual < jitter / 4 );
+}
+
+TEST( testClockModelJitteredFrames )
+{
+	// host timestamps late by up to 1 ms
+	const double jitter = 0.001;
+	Clocks clocks;
+	ClockModel model;
+	mt19937 random( 1394 );
+	clocks.addSample( &model, 0.0 );
+
+	checkResidualJitter( getFrameTimeErrors( &model, clocks, &random, 0.01, 0.02, 1000, 200, jitter ), jitter );
+	// a new frame period is tracked after a few frames off the old one
+	checkResidualJitter( getFrameTimeErrors( &model, clocks, &random, 20.01, 1.0 / 30.0, 600, 200, jitter ), jitter );
+}
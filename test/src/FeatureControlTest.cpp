@@ -0,0 +1,212 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "Capture1394.h"
+#include "FeatureControl.h"
+#include "RegisterBatch.h"
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace mndl;
+using namespace mndl::test;
+
+//! Returns the value register of \a feature of the mock camera \a guid.
+static uint32_t getValueRegister( uint64_t guid, dc1394feature_t feature )
+{
+	std::lock_guard< std::recursive_mutex > lock( MockBus::get().getMutex() );
+	return MockBus::get().findCamera( guid )->mRegisters[ RegisterBatch::getFeatureValueOffset( feature ) ];
+}
+
+static float getAbsoluteValue( uint64_t guid, dc1394feature_t feature )
+{
+	std::lock_guard< std::recursive_mutex > lock( MockBus::get().getMutex() );
+	return MockBus::get().findCamera( guid )->mAbsValues[ feature - DC1394_FEATURE_MIN ];
+}
+
+/** Returns a control of the single mock camera \a guid, which knows its features like after a capture started.
+ *  Its writes are \a minInterval seconds apart.
+ */
+static FeatureControlRef createFeatureControl( uint64_t guid, double minInterval = 0.0 )
+{
+	Capture1394::DeviceRef device = Capture1394::getDevices( true ).at( 0 );
+	CHECK_EQUAL( guid, device->getUniqueId() );
+	FeatureControlRef control = FeatureControl::create( device, minInterval );
+	dc1394featureset_t featureSet;
+	CHECK_EQUAL( DC1394_SUCCESS, dc1394_feature_get_all( device->getNative(), &featureSet ) );
+	control->setFeatureSet( featureSet );
+	return control;
+}
+
+TEST( testQueuedAbsoluteWrite )
+{
+	MockBus::get().addDefaultCamera( 1, "Mock" );
+	FeatureControlRef control = createFeatureControl( 1 );
+	const uint32_t before = getValueRegister( 1, DC1394_FEATURE_SHUTTER );
+	CHECK( !( before & 0x40000000 ) );
+
+	// the value is queued first, the write still turns the absolute control on before setting it
+	control->setAbsoluteValue( DC1394_FEATURE_SHUTTER, 0.025f );
+	control->setAbsoluteControl( DC1394_FEATURE_SHUTTER, true );
+	CHECK( control->flush() );
+	CHECK_EQUAL( FeatureControl::STATUS_DONE, control->getStatus( DC1394_FEATURE_SHUTTER ) );
+
+	// the absolute control bit is set in the value register, the other bits are kept
+	const uint32_t after = getValueRegister( 1, DC1394_FEATURE_SHUTTER );
+	CHECK_EQUAL( before | 0x40000000, after );
+	CHECK_CLOSE( 0.025f, getAbsoluteValue( 1, DC1394_FEATURE_SHUTTER ), 1e-6f );
+	CHECK_EQUAL( 1u, MockBus::get().getNumCalls( "dc1394_feature_set_absolute_value" ) );
+}
+
+TEST( testAbsoluteControlOff )
+{
+	MockBus::get().addDefaultCamera( 1, "Mock" );
+	FeatureControlRef control = createFeatureControl( 1 );
+	control->setAbsoluteControl( DC1394_FEATURE_GAIN, true );
+	control->setAbsoluteValue( DC1394_FEATURE_GAIN, 6.f );
+	CHECK( control->flush() );
+	CHECK( getValueRegister( 1, DC1394_FEATURE_GAIN ) & 0x40000000 );
+
+	// back to register units, the value bits written with the control stay as queued
+	control->setAbsoluteControl( DC1394_FEATURE_GAIN, false );
+	control->setValue( DC1394_FEATURE_GAIN, 300 );
+	CHECK( control->flush() );
+	const uint32_t reg = getValueRegister( 1, DC1394_FEATURE_GAIN );
+	CHECK( !( reg & 0x40000000 ) );
+	CHECK_EQUAL( 300u, reg & 0xfff );
+	CHECK_CLOSE( 6.f, getAbsoluteValue( 1, DC1394_FEATURE_GAIN ), 1e-6f );
+}
+
+TEST( testCoalescedWrites )
+{
+	// a slider sending a value every millisecond for 0.3 s to a control writing each feature at most every 50 ms
+	MockBus::get().addDefaultCamera( 1, "Mock" );
+	MockBus::get().setLatency( "dc1394_set_control_registers", 0.002 );
+	MockBus::get().setLatency( "dc1394_feature_set_value", 0.002 );
+	FeatureControlRef control = createFeatureControl( 1, 0.05 );
+
+	uint32_t numValues = 0;
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds( 300 );
+	while ( std::chrono::steady_clock::now() < end )
+	{
+		control->setValue( DC1394_FEATURE_BRIGHTNESS, numValues % 256 );
+		numValues++;
+		// another feature is written on its own schedule
+		if ( numValues == 100 )
+			control->setValue( DC1394_FEATURE_GAIN, 500 );
+		std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+	}
+	control->setValue( DC1394_FEATURE_BRIGHTNESS, 200 );
+	numValues++;
+	CHECK( control->flush() );
+
+	// every value is either written or replaced by a newer one, the first is written right away, then one every interval
+	const uint64_t numWrites = control->getNumWrites() - 1;
+	CHECK( numWrites >= 2 );
+	CHECK( numWrites <= 300 / 50 + 2 );
+	CHECK_EQUAL( uint64_t( numValues ), numWrites + control->getNumCoalesced() );
+
+	CHECK_EQUAL( FeatureControl::STATUS_DONE, control->getStatus( DC1394_FEATURE_BRIGHTNESS ) );
+	CHECK_EQUAL( 200u, getValueRegister( 1, DC1394_FEATURE_BRIGHTNESS ) & 0xfff );
+	CHECK_EQUAL( FeatureControl::STATUS_DONE, control->getStatus( DC1394_FEATURE_GAIN ) );
+	CHECK_EQUAL( 500u, getValueRegister( 1, DC1394_FEATURE_GAIN ) & 0xfff );
+}
+
+//! Changes the value bits of \a feature behind the back of the control, like the auto mode of the camera does.
+static void setValueBits( uint64_t guid, dc1394feature_t feature, uint32_t value )
+{
+	std::lock_guard< std::recursive_mutex > lock( MockBus::get().getMutex() );
+	uint32_t &reg = MockBus::get().findCamera( guid )->mRegisters[ RegisterBatch::getFeatureValueOffset( feature ) ];
+	reg = ( reg & ~0xfffu ) | value;
+}
+
+TEST( testAutoFeatureReadBack )
+{
+	MockBus::get().addDefaultCamera( 1, "Mock" );
+	{
+		std::lock_guard< std::recursive_mutex > lock( MockBus::get().getMutex() );
+		MockBus::get().findCamera( 1 )->mRegisters[ RegisterBatch::getFeatureValueOffset( DC1394_FEATURE_GAIN ) ] |= 0x01000000;
+	}
+	FeatureControlRef control = createFeatureControl( 1 );
+	CHECK_EQUAL( DC1394_FEATURE_MODE_AUTO, control->getSnapshot().mFeatures[ DC1394_FEATURE_GAIN - DC1394_FEATURE_MIN ].mMode );
+	const size_t numFeatureSetReads = MockBus::get().getNumCalls( "dc1394_feature_get_all" );
+	control->setPollInterval( 0.02 );
+
+	// the auto gain moves, a manual feature changed elsewhere is not read back
+	setValueBits( 1, DC1394_FEATURE_GAIN, 321 );
+	setValueBits( 1, DC1394_FEATURE_BRIGHTNESS, 77 );
+	std::chrono::steady_clock::time_point timeout = std::chrono::steady_clock::now() + std::chrono::seconds( 1 );
+	while ( ( control->getSnapshot().mFeatures[ DC1394_FEATURE_GAIN - DC1394_FEATURE_MIN ].mValue != 321 ) &&
+			( std::chrono::steady_clock::now() < timeout ) )
+		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+
+	const FeatureControl::Snapshot snapshot = control->getSnapshot();
+	CHECK_EQUAL( 321u, snapshot.mFeatures[ DC1394_FEATURE_GAIN - DC1394_FEATURE_MIN ].mValue );
+	CHECK_EQUAL( 128u, snapshot.mFeatures[ DC1394_FEATURE_BRIGHTNESS - DC1394_FEATURE_MIN ].mValue );
+	CHECK( snapshot.mSequence > 1 );
+	CHECK( control->getNumPolls() >= 1 );
+	// the polls read the value registers in batches, not the whole feature set
+	CHECK_EQUAL( numFeatureSetReads, MockBus::get().getNumCalls( "dc1394_feature_get_all" ) );
+	CHECK( MockBus::get().getNumCalls( "dc1394_get_control_registers" ) >= 1 );
+
+	// polling stops, a poll running meanwhile may still complete
+	control->setPollInterval( 0.0 );
+	std::this_thread::sleep_for( std::chrono::milliseconds( 30 ) );
+	const uint64_t numPolls = control->getNumPolls();
+	std::this_thread::sleep_for( std::chrono::milliseconds( 100 ) );
+	CHECK_EQUAL( numPolls, control->getNumPolls() );
+}
+
+TEST( testSnapshotConsistency )
+{
+	MockBus::get().addDefaultCamera( 1, "Mock" );
+	Capture1394::DeviceRef device = Capture1394::getDevices( true ).at( 0 );
+	FeatureControlRef control = FeatureControl::create( device, 0.0 );
+	CHECK_EQUAL( uint64_t( 0 ), control->getSnapshot().mSequence );
+	dc1394featureset_t featureSet;
+	CHECK_EQUAL( DC1394_SUCCESS, dc1394_feature_get_all( device->getNative(), &featureSet ) );
+
+	// every published snapshot has the same value in all features, a torn copy would mix two of them
+	std::atomic< bool > quit( false );
+	std::thread publisher( [ & ]()
+			{
+				for ( uint32_t i = 1; !quit; i++ )
+				{
+					for ( int j = 0; j < DC1394_FEATURE_NUM; j++ )
+						featureSet.feature[ j ].value = i % 4096;
+					control->setFeatureSet( featureSet );
+				}
+			} );
+
+	uint64_t lastSequence = 0;
+	for ( int i = 0; i < 20000; i++ )
+	{
+		const FeatureControl::Snapshot snapshot = control->getSnapshot();
+		CHECK( snapshot.mSequence >= lastSequence );
+		lastSequence = snapshot.mSequence;
+		const uint32_t value = snapshot.mFeatures[ DC1394_FEATURE_BRIGHTNESS - DC1394_FEATURE_MIN ].mValue;
+		for ( int j = 0; j < DC1394_FEATURE_NUM; j++ )
+			CHECK( ( !snapshot.mFeatures[ j ].mValid ) || ( snapshot.mFeatures[ j ].mValue == value ) );
+	}
+	quit = true;
+	publisher.join();
+	CHECK( lastSequence > 0 );
+}
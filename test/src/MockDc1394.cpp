@@ -0,0 +1,1478 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+#include "MockDc1394.h"
+
+using namespace std;
+
+namespace mndl { namespace test {
+
+//! Size and color coding of the fixed video modes, indexed by the video mode - DC1394_VIDEO_MODE_MIN.
+static const struct
+{
+	uint32_t mWidth, mHeight;
+	dc1394color_coding_t mColorCoding;
+} kFixedModes[] = {
+	{ 160, 120, DC1394_COLOR_CODING_YUV444 }, { 320, 240, DC1394_COLOR_CODING_YUV422 },
+	{ 640, 480, DC1394_COLOR_CODING_YUV411 }, { 640, 480, DC1394_COLOR_CODING_YUV422 },
+	{ 640, 480, DC1394_COLOR_CODING_RGB8 }, { 640, 480, DC1394_COLOR_CODING_MONO8 },
+	{ 640, 480, DC1394_COLOR_CODING_MONO16 }, { 800, 600, DC1394_COLOR_CODING_YUV422 },
+	{ 800, 600, DC1394_COLOR_CODING_RGB8 }, { 800, 600, DC1394_COLOR_CODING_MONO8 },
+	{ 1024, 768, DC1394_COLOR_CODING_YUV422 }, { 1024, 768, DC1394_COLOR_CODING_RGB8 },
+	{ 1024, 768, DC1394_COLOR_CODING_MONO8 }, { 800, 600, DC1394_COLOR_CODING_MONO16 },
+	{ 1024, 768, DC1394_COLOR_CODING_MONO16 }, { 1280, 960, DC1394_COLOR_CODING_YUV422 },
+	{ 1280, 960, DC1394_COLOR_CODING_RGB8 }, { 1280, 960, DC1394_COLOR_CODING_MONO8 },
+	{ 1600, 1200, DC1394_COLOR_CODING_YUV422 }, { 1600, 1200, DC1394_COLOR_CODING_RGB8 },
+	{ 1600, 1200, DC1394_COLOR_CODING_MONO8 }, { 1280, 960, DC1394_COLOR_CODING_MONO16 },
+	{ 1600, 1200, DC1394_COLOR_CODING_MONO16 }
+};
+
+//! Bits per pixel of the color codings, indexed by the coding - DC1394_COLOR_CODING_MIN.
+static const uint32_t kColorCodingBits[ DC1394_COLOR_CODING_NUM ] = { 8, 12, 16, 24, 24, 16, 48, 16, 48, 8, 16 };
+
+static const double kCycleDuration = 1.0 / 8000.0;
+//! Offsets of the trigger mode and the software trigger registers.
+static const uint64_t kTriggerModeOffset = 0x830;
+static const uint64_t kSoftwareTriggerOffset = 0x62c;
+
+static bool isFormat7( dc1394video_mode_t videoMode )
+{
+	return ( DC1394_VIDEO_MODE_FORMAT7_MIN <= videoMode ) && ( videoMode <= DC1394_VIDEO_MODE_FORMAT7_MAX );
+}
+
+static bool isFixed( dc1394video_mode_t videoMode )
+{
+	return ( DC1394_VIDEO_MODE_MIN <= videoMode ) && ( videoMode <= DC1394_VIDEO_MODE_1600x1200_MONO16 );
+}
+
+//! Returns the value register of a feature with the state of \a info, like a camera reports it.
+static uint32_t encodeFeature( const dc1394feature_info_t &info )
+{
+	if ( !info.available )
+		return 0;
+	uint32_t reg = 0x80000000;
+	if ( info.abs_control == DC1394_ON )
+		reg |= 0x40000000;
+	if ( info.is_on == DC1394_ON )
+		reg |= 0x02000000;
+	if ( info.current_mode == DC1394_FEATURE_MODE_AUTO )
+		reg |= 0x01000000;
+	else if ( info.current_mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO )
+		reg |= 0x04000000;
+	if ( info.id == DC1394_FEATURE_WHITE_BALANCE )
+		reg |= ( ( info.BU_value & 0xfff ) << 12 ) | ( info.RV_value & 0xfff );
+	else if ( info.id == DC1394_FEATURE_TEMPERATURE )
+		reg |= ( info.target_value & 0xfff ) << 12;
+	else
+		reg |= info.value & 0xfff;
+	return reg;
+}
+
+//! Returns the offset of the value register of \a feature, the same layout RegisterBatch uses.
+static uint64_t getValueOffset( dc1394feature_t feature )
+{
+	if ( feature < DC1394_FEATURE_ZOOM )
+		return 0x800 + ( feature - DC1394_FEATURE_MIN ) * 4;
+	else if ( feature < DC1394_FEATURE_CAPTURE_SIZE )
+		return 0x880 + ( feature - DC1394_FEATURE_ZOOM ) * 4;
+	else
+		return 0x8c0 + ( feature - DC1394_FEATURE_CAPTURE_SIZE ) * 4;
+}
+
+//! Returns the bytes of an image of the current video mode of \a camera and its size into \a width and \a height.
+static uint64_t getImageBytes( const MockBus::Camera *camera, uint32_t *width, uint32_t *height, dc1394color_coding_t *coding )
+{
+	if ( isFormat7( camera->mVideoMode ) )
+	{
+		const MockBus::Format7Mode &mode = camera->mFormat7[ camera->mVideoMode - DC1394_VIDEO_MODE_FORMAT7_MIN ];
+		*width = mode.mSize.x;
+		*height = mode.mSize.y;
+		*coding = mode.mColorCoding;
+	}
+	else
+	{
+		*width = kFixedModes[ camera->mVideoMode - DC1394_VIDEO_MODE_MIN ].mWidth;
+		*height = kFixedModes[ camera->mVideoMode - DC1394_VIDEO_MODE_MIN ].mHeight;
+		*coding = kFixedModes[ camera->mVideoMode - DC1394_VIDEO_MODE_MIN ].mColorCoding;
+	}
+	return static_cast< uint64_t >( *width ) * *height * kColorCodingBits[ *coding - DC1394_COLOR_CODING_MIN ] / 8;
+}
+
+//! Returns the packets of a frame of the current video mode of \a camera, one packet is sent per cycle.
+static uint32_t getPacketsPerFrame( const MockBus::Camera *camera )
+{
+	uint32_t width, height;
+	dc1394color_coding_t coding;
+	uint64_t bytes = getImageBytes( camera, &width, &height, &coding );
+	if ( isFormat7( camera->mVideoMode ) )
+	{
+		uint32_t packetBytes = camera->mFormat7[ camera->mVideoMode - DC1394_VIDEO_MODE_FORMAT7_MIN ].mPacketBytes;
+		return packetBytes ? static_cast< uint32_t >( ( bytes + packetBytes - 1 ) / packetBytes ) : 0;
+	}
+	return static_cast< uint32_t >( 8000.0 / ( 1.875 * pow( 2.0, camera->mFrameRate - DC1394_FRAMERATE_MIN ) ) );
+}
+
+MockBus & MockBus::get()
+{
+	// never destroyed, the devices enumerated by Capture1394 free their handles at exit
+	static MockBus *bus = new MockBus;
+	return *bus;
+}
+
+MockBus::MockBus() :
+	mNumCounters( 0 ), mNumFreedHandleCalls( 0 )
+{}
+
+void MockBus::reset()
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	// the devices of the previous test might still hold their handles, they fail from now on
+	for ( auto it = mHandles.begin(); it != mHandles.end(); ++it )
+		( *it )->mDevice = NULL;
+	mCameras.clear();
+	mRules.clear();
+	mNumCounters = 0;
+	mNumFreedHandleCalls = 0;
+}
+
+MockBus::Camera & MockBus::addCamera( uint64_t guid, const string &model )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	mCameras.push_back( Camera() );
+	Camera &camera = mCameras.back();
+	camera.mGuid = guid;
+	camera.mModel = model;
+	memset( &camera.mFeatures, 0, sizeof( camera.mFeatures ) );
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		camera.mFeatures.feature[ i ].id = dc1394feature_t( i + DC1394_FEATURE_MIN );
+		camera.mAbsValues[ i ] = 0.f;
+	}
+	camera.mRandom = static_cast< uint32_t >( guid ) | 1;
+	return camera;
+}
+
+MockBus::Camera & MockBus::addDefaultCamera( uint64_t guid, const string &model )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	Camera &camera = addCamera( guid, model );
+	camera.mVendorId = 0x1394;
+	camera.mModelId = 1;
+	camera.mSwVersion = 0x102;
+	camera.mVideoModes.push_back( DC1394_VIDEO_MODE_640x480_MONO8 );
+	camera.mVideoModes.push_back( DC1394_VIDEO_MODE_640x480_RGB8 );
+	camera.mFrameRates.push_back( DC1394_FRAMERATE_15 );
+	camera.mFrameRates.push_back( DC1394_FRAMERATE_30 );
+	camera.mFrameRates.push_back( DC1394_FRAMERATE_60 );
+
+	Format7Mode &mode = camera.mFormat7[ 0 ];
+	mode.mPresent = true;
+	mode.mMaxSize = ci::Vec2i( 640, 480 );
+	mode.mUnitSize = ci::Vec2i( 8, 2 );
+	mode.mColorCoding = DC1394_COLOR_CODING_MONO8;
+	mode.mUnitBytes = 4;
+	mode.mMaxBytes = 4096;
+	mode.mPacketBytes = 4096;
+	mode.mSize = mode.mMaxSize;
+
+	const struct
+	{
+		dc1394feature_t mId;
+		uint32_t mMin, mMax, mValue;
+		bool mAbsolute;
+		float mAbsMin, mAbsMax, mAbsValue;
+	} features[] = {
+		{ DC1394_FEATURE_BRIGHTNESS, 0, 255, 128, false, 0.f, 0.f, 0.f },
+		{ DC1394_FEATURE_WHITE_BALANCE, 0, 1023, 0, false, 0.f, 0.f, 0.f },
+		{ DC1394_FEATURE_SHUTTER, 1, 4095, 100, true, 0.0001f, 1.f, 0.01f },
+		{ DC1394_FEATURE_GAIN, 0, 680, 0, true, 0.f, 24.f, 0.f }
+	};
+	for ( size_t i = 0; i < sizeof( features ) / sizeof( features[ 0 ] ); i++ )
+	{
+		dc1394feature_info_t &info = camera.mFeatures.feature[ features[ i ].mId - DC1394_FEATURE_MIN ];
+		info.available = DC1394_TRUE;
+		info.readout_capable = DC1394_TRUE;
+		info.on_off_capable = DC1394_TRUE;
+		info.is_on = DC1394_ON;
+		info.current_mode = DC1394_FEATURE_MODE_MANUAL;
+		info.modes.num = 2;
+		info.modes.modes[ 0 ] = DC1394_FEATURE_MODE_MANUAL;
+		info.modes.modes[ 1 ] = DC1394_FEATURE_MODE_AUTO;
+		info.min = features[ i ].mMin;
+		info.max = features[ i ].mMax;
+		info.value = features[ i ].mValue;
+		info.absolute_capable = features[ i ].mAbsolute ? DC1394_TRUE : DC1394_FALSE;
+		info.abs_min = features[ i ].mAbsMin;
+		info.abs_max = features[ i ].mAbsMax;
+		info.abs_value = features[ i ].mAbsValue;
+		info.abs_control = DC1394_OFF;
+		if ( info.id == DC1394_FEATURE_WHITE_BALANCE )
+		{
+			info.BU_value = 500;
+			info.RV_value = 600;
+		}
+		camera.mAbsValues[ features[ i ].mId - DC1394_FEATURE_MIN ] = features[ i ].mAbsValue;
+		camera.mRegisters[ getValueOffset( info.id ) ] = encodeFeature( info );
+	}
+	// V_FORMAT_INQ, formats 0 and 7
+	camera.mRegisters[ 0x100 ] = 0x81000000;
+	return camera;
+}
+
+MockBus::Camera * MockBus::findCamera( uint64_t guid )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	for ( auto it = mCameras.begin(); it != mCameras.end(); ++it )
+	{
+		if ( it->mGuid == guid )
+			return &( *it );
+	}
+	return NULL;
+}
+
+vector< uint64_t > MockBus::getPresentGuids() const
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	vector< uint64_t > guids;
+	for ( auto it = mCameras.cbegin(); it != mCameras.cend(); ++it )
+	{
+		if ( it->mPresent )
+			guids.push_back( it->mGuid );
+	}
+	return guids;
+}
+
+void MockBus::setPresent( uint64_t guid, bool present )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	Camera *camera = findCamera( guid );
+	if ( camera )
+	{
+		camera->mPresent = present;
+		// a replugged camera comes back with its transmission off
+		camera->mTransmitting = false;
+		camera->mPendingShots = 0;
+	}
+}
+
+vector< MockBus::Camera * > MockBus::getReceivers( Camera *camera )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	vector< Camera * > receivers;
+	if ( !camera->mBroadcast )
+	{
+		receivers.push_back( camera );
+		return receivers;
+	}
+	for ( auto it = mCameras.begin(); it != mCameras.end(); ++it )
+	{
+		if ( it->mPresent )
+			receivers.push_back( &( *it ) );
+	}
+	return receivers;
+}
+
+void MockBus::fail( const string &function, dc1394error_t err, int count )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	Rule rule;
+	rule.mFunction = function;
+	rule.mError = err;
+	rule.mNumFailures = count;
+	rule.mLatency = 0.0;
+	mRules.push_back( rule );
+}
+
+void MockBus::setLatency( const string &function, double seconds )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	Rule rule;
+	rule.mFunction = function;
+	rule.mError = DC1394_SUCCESS;
+	rule.mNumFailures = 0;
+	rule.mLatency = seconds;
+	mRules.push_back( rule );
+}
+
+MockBus::Counter * MockBus::findCounter( const char *function )
+{
+	for ( size_t i = 0; i < mNumCounters; i++ )
+	{
+		if ( mCounters[ i ].mFunction == function )
+			return &mCounters[ i ];
+	}
+	if ( mNumCounters == kMaxCounters )
+		return NULL;
+	Counter &counter = mCounters[ mNumCounters++ ];
+	counter.mFunction = function;
+	counter.mNumCalls = 0;
+	counter.mNumRunning = 0;
+	counter.mMaxRunning = 0;
+	return &counter;
+}
+
+const MockBus::Counter * MockBus::findCounter( const string &function ) const
+{
+	for ( size_t i = 0; i < mNumCounters; i++ )
+	{
+		if ( function == mCounters[ i ].mFunction )
+			return &mCounters[ i ];
+	}
+	return NULL;
+}
+
+size_t MockBus::getNumCalls( const string &function ) const
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	const Counter *counter = findCounter( function );
+	return counter ? counter->mNumCalls : 0;
+}
+
+size_t MockBus::getMaxConcurrentCalls( const string &function ) const
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	const Counter *counter = findCounter( function );
+	return counter ? counter->mMaxRunning : 0;
+}
+
+size_t MockBus::getNumFreedHandleCalls() const
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	return mNumFreedHandleCalls;
+}
+
+dc1394error_t MockBus::enter( const char *function, dc1394camera_t *camera )
+{
+	double latency = 0.0;
+	dc1394error_t err = DC1394_SUCCESS;
+	{
+		lock_guard< recursive_mutex > lock( mMutex );
+		Counter *counter = findCounter( function );
+		if ( counter )
+		{
+			counter->mNumCalls++;
+			counter->mNumRunning++;
+			counter->mMaxRunning = std::max( counter->mMaxRunning, counter->mNumRunning );
+		}
+
+		if ( camera )
+		{
+			Handle *handle = getHandle( camera );
+			if ( handle->mFreed )
+			{
+				mNumFreedHandleCalls++;
+				return DC1394_CAMERA_NOT_INITIALIZED;
+			}
+			if ( ( handle->mDevice == NULL ) || ( !handle->mDevice->mPresent ) )
+				return DC1394_FAILURE;
+		}
+
+		// the rules are not copied, matching them does not allocate
+		for ( auto it = mRules.begin(); it != mRules.end(); ++it )
+		{
+			if ( it->mFunction != function )
+				continue;
+			latency = std::max( latency, it->mLatency );
+			if ( ( err == DC1394_SUCCESS ) && ( it->mNumFailures != 0 ) )
+			{
+				err = it->mError;
+				if ( it->mNumFailures > 0 )
+					it->mNumFailures--;
+			}
+		}
+	}
+
+	if ( latency > 0.0 )
+		this_thread::sleep_for( chrono::duration< double >( latency ) );
+	return err;
+}
+
+void MockBus::leave( const char *function )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	Counter *counter = findCounter( function );
+	if ( counter )
+		counter->mNumRunning--;
+}
+
+MockBus::Handle * MockBus::createHandle( Camera *camera )
+{
+	lock_guard< recursive_mutex > lock( mMutex );
+	unique_ptr< Handle > handle( new Handle );
+	memset( &handle->mCamera, 0, sizeof( handle->mCamera ) );
+	handle->mDevice = camera;
+	handle->mModel = camera->mModel;
+	handle->mFreed = false;
+	handle->mNextFrame = 0;
+	handle->mCamera.guid = camera->mGuid;
+	handle->mCamera.command_registers_base = 0xf00000;
+	handle->mCamera.model = &handle->mModel[ 0 ];
+	handle->mCamera.vendor_id = camera->mVendorId;
+	handle->mCamera.model_id = camera->mModelId;
+	handle->mCamera.unit_sub_sw_version = camera->mSwVersion;
+	handle->mCamera.bmode_capable = camera->mBModeCapable ? DC1394_TRUE : DC1394_FALSE;
+	handle->mCamera.one_shot_capable = DC1394_TRUE;
+	handle->mCamera.multi_shot_capable = DC1394_TRUE;
+	handle->mCamera.max_mem_channel = camera->mMaxMemChannel;
+	mHandles.push_back( std::move( handle ) );
+	return mHandles.back().get();
+}
+
+double MockBus::random( Camera *camera )
+{
+	// a linear congruential generator, std::normal_distribution might allocate its state
+	camera->mRandom = camera->mRandom * 1664525u + 1013904223u;
+	return ( camera->mRandom >> 8 ) / double( 1 << 23 ) - 1.0;
+}
+
+} } // namespace mndl::test
+
+using namespace mndl::test;
+
+struct __dc1394_t
+{
+	int mNumCameras;
+};
+
+/** Returns the host time in microseconds of \a steadyTime. The host clock is the system clock pinned to the steady clock,
+ *  so the cycle timer and its local time come from one reading like the ioctl behind dc1394_read_cycle_timer().
+ */
+static uint64_t getHostTime( chrono::steady_clock::time_point steadyTime )
+{
+	static const chrono::system_clock::duration sOffset = chrono::system_clock::now().time_since_epoch() -
+		chrono::duration_cast< chrono::system_clock::duration >( chrono::steady_clock::now().time_since_epoch() );
+	return chrono::duration_cast< chrono::microseconds >(
+			chrono::duration_cast< chrono::system_clock::duration >( steadyTime.time_since_epoch() ) + sOffset ).count();
+}
+
+//! Returns the camera behind \a handle, which entered the call successfully.
+static MockBus::Camera * getCamera( dc1394camera_t *handle )
+{
+	return MockBus::getHandle( handle )->mDevice;
+}
+
+/** Returns whether the broadcast of \a camera is on. Reads get no response then, which also fails the setters of libdc1394
+ *  reading their register before writing it.
+ */
+static bool isBroadcasting( dc1394camera_t *camera )
+{
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	return getCamera( camera )->mBroadcast;
+}
+
+//! Returns the Format7 mode \a videoMode of \a camera, NULL if the camera does not have it.
+static MockBus::Format7Mode * getFormat7Mode( MockBus::Camera *camera, dc1394video_mode_t videoMode )
+{
+	if ( !isFormat7( videoMode ) )
+		return NULL;
+	MockBus::Format7Mode *mode = &camera->mFormat7[ videoMode - DC1394_VIDEO_MODE_FORMAT7_MIN ];
+	return mode->mPresent ? mode : NULL;
+}
+
+dc1394_t * dc1394_new()
+{
+	MockCall call( __func__ );
+	static dc1394_t context = { 0 };
+	return &context;
+}
+
+void dc1394_free( dc1394_t * )
+{
+	MockCall call( __func__ );
+}
+
+dc1394error_t dc1394_camera_enumerate( dc1394_t *, dc1394camera_list_t **list )
+{
+	MockCall call( __func__ );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	vector< uint64_t > guids = MockBus::get().getPresentGuids();
+	*list = new dc1394camera_list_t;
+	( *list )->num = static_cast< uint32_t >( guids.size() );
+	( *list )->ids = new dc1394camera_id_t[ guids.size() + 1 ];
+	for ( size_t i = 0; i < guids.size(); i++ )
+	{
+		( *list )->ids[ i ].unit = 0;
+		( *list )->ids[ i ].guid = guids[ i ];
+	}
+	return DC1394_SUCCESS;
+}
+
+void dc1394_camera_free_list( dc1394camera_list_t *list )
+{
+	MockCall call( __func__ );
+	delete [] list->ids;
+	delete list;
+}
+
+dc1394camera_t * dc1394_camera_new( dc1394_t *, uint64_t guid )
+{
+	MockCall call( __func__ );
+	if ( call.getError() != DC1394_SUCCESS )
+		return NULL;
+	MockBus &bus = MockBus::get();
+	lock_guard< recursive_mutex > lock( bus.getMutex() );
+	MockBus::Camera *camera = bus.findCamera( guid );
+	if ( ( camera == NULL ) || ( !camera->mPresent ) )
+		return NULL;
+	return &bus.createHandle( camera )->mCamera;
+}
+
+void dc1394_camera_free( dc1394camera_t *camera )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() == DC1394_CAMERA_NOT_INITIALIZED )
+		return;
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	// the handle is kept, so later calls with it are detected
+	MockBus::Handle *handle = MockBus::getHandle( camera );
+	handle->mFreed = true;
+	handle->mRing.clear();
+	handle->mFrames.clear();
+	handle->mDequeued.clear();
+}
+
+dc1394error_t dc1394_camera_set_broadcast( dc1394camera_t *camera, dc1394bool_t pwr )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	getCamera( camera )->mBroadcast = ( pwr == DC1394_TRUE );
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_read_cycle_timer( dc1394camera_t *camera, uint32_t *cycle_timer, uint64_t *local_time )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	// the bus clock follows the steady clock, the host clock is the one of the frame timestamps
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	double bus = fmod( chrono::duration< double >( now.time_since_epoch() ).count(), 128.0 );
+	*local_time = getHostTime( now );
+	uint32_t seconds = static_cast< uint32_t >( bus );
+	uint32_t cycles = static_cast< uint32_t >( ( bus - seconds ) * 8000.0 );
+	uint32_t offset = static_cast< uint32_t >( ( ( bus - seconds ) * 8000.0 - cycles ) * 3072.0 );
+	*cycle_timer = ( seconds << 25 ) | ( std::min( cycles, 7999u ) << 12 ) | std::min( offset, 3071u );
+	return DC1394_SUCCESS;
+}
+
+// video modes
+
+dc1394error_t dc1394_video_get_supported_modes( dc1394camera_t *camera, dc1394video_modes_t *video_modes )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	video_modes->num = 0;
+	for ( auto it = device->mVideoModes.cbegin(); it != device->mVideoModes.cend(); ++it )
+		video_modes->modes[ video_modes->num++ ] = *it;
+	for ( int v = 0; v < DC1394_VIDEO_MODE_FORMAT7_NUM; v++ )
+	{
+		if ( device->mFormat7[ v ].mPresent )
+			video_modes->modes[ video_modes->num++ ] = dc1394video_mode_t( DC1394_VIDEO_MODE_FORMAT7_0 + v );
+	}
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_get_supported_framerates( dc1394camera_t *camera, dc1394video_mode_t video_mode,
+		dc1394framerates_t *framerates )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( find( device->mVideoModes.cbegin(), device->mVideoModes.cend(), video_mode ) == device->mVideoModes.cend() )
+		return DC1394_INVALID_VIDEO_MODE;
+	framerates->num = 0;
+	for ( auto it = device->mFrameRates.cbegin(); it != device->mFrameRates.cend(); ++it )
+		framerates->framerates[ framerates->num++ ] = *it;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_get_color_coding_from_video_mode( dc1394camera_t *camera, dc1394video_mode_t video_mode,
+		dc1394color_coding_t *color_coding )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	if ( isFixed( video_mode ) )
+	{
+		*color_coding = kFixedModes[ video_mode - DC1394_VIDEO_MODE_MIN ].mColorCoding;
+		return DC1394_SUCCESS;
+	}
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), video_mode );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	*color_coding = mode->mColorCoding;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_get_image_size_from_video_mode( dc1394camera_t *camera, uint32_t video_mode, uint32_t *width,
+		uint32_t *height )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	if ( isFixed( dc1394video_mode_t( video_mode ) ) )
+	{
+		*width = kFixedModes[ video_mode - DC1394_VIDEO_MODE_MIN ].mWidth;
+		*height = kFixedModes[ video_mode - DC1394_VIDEO_MODE_MIN ].mHeight;
+		return DC1394_SUCCESS;
+	}
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), dc1394video_mode_t( video_mode ) );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	*width = mode->mSize.x;
+	*height = mode->mSize.y;
+	return DC1394_SUCCESS;
+}
+
+dc1394bool_t dc1394_is_video_mode_scalable( dc1394video_mode_t video_mode )
+{
+	MockCall call( __func__ );
+	return isFormat7( video_mode ) ? DC1394_TRUE : DC1394_FALSE;
+}
+
+dc1394error_t dc1394_get_color_coding_bit_size( dc1394color_coding_t color_coding, uint32_t *bits )
+{
+	MockCall call( __func__ );
+	if ( ( color_coding < DC1394_COLOR_CODING_MIN ) || ( DC1394_COLOR_CODING_MAX < color_coding ) )
+		return DC1394_INVALID_COLOR_CODING;
+	*bits = kColorCodingBits[ color_coding - DC1394_COLOR_CODING_MIN ];
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_framerate_as_float( dc1394framerate_t framerate_enum, float *framerate )
+{
+	MockCall call( __func__ );
+	if ( ( framerate_enum < DC1394_FRAMERATE_MIN ) || ( DC1394_FRAMERATE_MAX < framerate_enum ) )
+		return DC1394_INVALID_FRAMERATE;
+	*framerate = 1.875f * powf( 2.f, float( framerate_enum - DC1394_FRAMERATE_MIN ) );
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_set_mode( dc1394camera_t *camera, dc1394video_mode_t video_mode )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( ( getFormat7Mode( device, video_mode ) == NULL ) &&
+		 ( find( device->mVideoModes.cbegin(), device->mVideoModes.cend(), video_mode ) == device->mVideoModes.cend() ) )
+		return DC1394_INVALID_VIDEO_MODE;
+	device->mVideoMode = video_mode;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_set_framerate( dc1394camera_t *camera, dc1394framerate_t framerate )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( find( device->mFrameRates.cbegin(), device->mFrameRates.cend(), framerate ) == device->mFrameRates.cend() )
+		return DC1394_INVALID_FRAMERATE;
+	device->mFrameRate = framerate;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_set_operation_mode( dc1394camera_t *camera, dc1394operation_mode_t mode )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( ( mode == DC1394_OPERATION_MODE_1394B ) && ( !device->mBModeCapable ) )
+		return DC1394_FUNCTION_NOT_SUPPORTED;
+	device->mOperationMode = mode;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_set_iso_speed( dc1394camera_t *camera, dc1394speed_t speed )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( ( speed > DC1394_ISO_SPEED_400 ) && ( device->mOperationMode != DC1394_OPERATION_MODE_1394B ) )
+		return DC1394_INVALID_ISO_SPEED;
+	// like a real camera, unsupported speeds are silently limited
+	device->mIsoSpeed = std::min( speed, device->mBModeCapable ? DC1394_ISO_SPEED_800 : DC1394_ISO_SPEED_400 );
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_get_iso_speed( dc1394camera_t *camera, dc1394speed_t *speed )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	*speed = getCamera( camera )->mIsoSpeed;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_set_iso_channel( dc1394camera_t *camera, uint32_t channel )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	getCamera( camera )->mIsoChannel = static_cast< int >( channel );
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_set_transmission( dc1394camera_t *camera, dc1394switch_t pwr )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( ( pwr == DC1394_ON ) && ( !device->mTransmitting ) )
+	{
+		// the cameras of a bus share the cycle clock, cameras of the same period send their frames at the same times
+		const chrono::steady_clock::duration period =
+			chrono::duration_cast< chrono::steady_clock::duration >( chrono::duration< double >( device->mFramePeriod ) );
+		device->mNextFrameTime = chrono::steady_clock::time_point(
+				( chrono::steady_clock::now().time_since_epoch() / period + 1 ) * period );
+	}
+	device->mTransmitting = ( pwr == DC1394_ON );
+	return DC1394_SUCCESS;
+}
+
+//! Queues \a numFrames triggered frames of \a camera, the first arrives after its transmission.
+static void shoot( MockBus::Camera *camera, uint32_t numFrames )
+{
+	if ( camera->mPendingShots == 0 )
+		camera->mNextFrameTime = chrono::steady_clock::now() + chrono::duration_cast< chrono::steady_clock::duration >(
+				chrono::duration< double >( getPacketsPerFrame( camera ) * kCycleDuration + 0.001 ) );
+	camera->mPendingShots += numFrames;
+}
+
+dc1394error_t dc1394_video_set_one_shot( dc1394camera_t *camera, dc1394switch_t pwr )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	if ( pwr == DC1394_ON )
+		shoot( getCamera( camera ), 1 );
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_video_set_multi_shot( dc1394camera_t *camera, uint32_t numFrames, dc1394switch_t pwr )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	if ( pwr == DC1394_ON )
+		shoot( getCamera( camera ), numFrames );
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_software_trigger_set_power( dc1394camera_t *camera, dc1394switch_t pwr )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	vector< MockBus::Camera * > receivers = MockBus::get().getReceivers( getCamera( camera ) );
+	for ( auto it = receivers.begin(); it != receivers.end(); ++it )
+	{
+		if ( ( pwr == DC1394_ON ) && ( *it )->mTriggerArmed )
+			shoot( *it, 1 );
+	}
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_external_trigger_set_mode( dc1394camera_t *camera, dc1394trigger_mode_t )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	return isBroadcasting( camera ) ? DC1394_FAILURE : DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_external_trigger_set_source( dc1394camera_t *camera, dc1394trigger_source_t )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	return isBroadcasting( camera ) ? DC1394_FAILURE : DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_external_trigger_set_power( dc1394camera_t *camera, dc1394switch_t pwr )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( device->mBroadcast )
+		return DC1394_FAILURE;
+	// the power bit of the trigger mode register, which the capture group writes directly
+	uint32_t &reg = device->mRegisters[ kTriggerModeOffset ];
+	reg = ( pwr == DC1394_ON ) ? ( reg | 0x02000000 ) : ( reg & ~0x02000000 );
+	device->mTriggerArmed = ( pwr == DC1394_ON );
+	return DC1394_SUCCESS;
+}
+
+// Format7
+
+dc1394error_t dc1394_format7_get_modeset( dc1394camera_t *camera, dc1394format7modeset_t *info )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	memset( info, 0, sizeof( *info ) );
+	for ( int v = 0; v < DC1394_VIDEO_MODE_FORMAT7_NUM; v++ )
+	{
+		const MockBus::Format7Mode &mode = device->mFormat7[ v ];
+		dc1394format7mode_t &out = info->mode[ v ];
+		if ( !mode.mPresent )
+			continue;
+		out.present = DC1394_TRUE;
+		out.size_x = mode.mSize.x;
+		out.size_y = mode.mSize.y;
+		out.max_size_x = mode.mMaxSize.x;
+		out.max_size_y = mode.mMaxSize.y;
+		out.pos_x = mode.mLeft;
+		out.pos_y = mode.mTop;
+		out.unit_size_x = mode.mUnitSize.x;
+		out.unit_size_y = mode.mUnitSize.y;
+		out.unit_pos_x = mode.mUnitSize.x;
+		out.unit_pos_y = mode.mUnitSize.y;
+		out.color_codings.num = 1;
+		out.color_codings.codings[ 0 ] = mode.mColorCoding;
+		out.color_coding = mode.mColorCoding;
+		out.pixnum = mode.mSize.x * mode.mSize.y;
+		out.packet_size = mode.mPacketBytes;
+		out.unit_packet_size = mode.mUnitBytes;
+		out.max_packet_size = mode.mMaxBytes;
+	}
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_format7_set_roi( dc1394camera_t *camera, dc1394video_mode_t video_mode, dc1394color_coding_t color_coding,
+		int32_t packet_size, int32_t left, int32_t top, int32_t width, int32_t height )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), video_mode );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	if ( ( color_coding != mode->mColorCoding ) && ( color_coding >= DC1394_COLOR_CODING_MIN ) )
+		return DC1394_INVALID_COLOR_CODING;
+
+	// negative arguments keep the current setting
+	ci::Vec2i size( ( width < 0 ) ? mode->mSize.x : width, ( height < 0 ) ? mode->mSize.y : height );
+	uint32_t x = ( left < 0 ) ? mode->mLeft : left, y = ( top < 0 ) ? mode->mTop : top;
+	if ( ( size.x <= 0 ) || ( size.y <= 0 ) || ( size.x % mode->mUnitSize.x ) || ( size.y % mode->mUnitSize.y ) ||
+		 ( x + size.x > uint32_t( mode->mMaxSize.x ) ) || ( y + size.y > uint32_t( mode->mMaxSize.y ) ) )
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	uint32_t packetBytes;
+	if ( ( packet_size == DC1394_USE_MAX_AVAIL ) || ( packet_size == DC1394_USE_RECOMMENDED ) )
+		packetBytes = mode->mMaxBytes;
+	else if ( packet_size == DC1394_QUERY_FROM_CAMERA )
+		packetBytes = mode->mPacketBytes ? mode->mPacketBytes : mode->mMaxBytes;
+	else
+		packetBytes = static_cast< uint32_t >( packet_size );
+	if ( ( packetBytes == 0 ) || ( packetBytes % mode->mUnitBytes ) || ( packetBytes > mode->mMaxBytes ) )
+		return DC1394_INVALID_ARGUMENT_VALUE;
+
+	mode->mSize = size;
+	mode->mLeft = x;
+	mode->mTop = y;
+	mode->mPacketBytes = packetBytes;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_format7_set_image_position( dc1394camera_t *camera, dc1394video_mode_t video_mode, uint32_t left, uint32_t top )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), video_mode );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	if ( ( left + mode->mSize.x > uint32_t( mode->mMaxSize.x ) ) || ( top + mode->mSize.y > uint32_t( mode->mMaxSize.y ) ) )
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	mode->mLeft = left;
+	mode->mTop = top;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_format7_get_packet_parameters( dc1394camera_t *camera, dc1394video_mode_t video_mode, uint32_t *unit_bytes,
+		uint32_t *max_bytes )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), video_mode );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	*unit_bytes = mode->mUnitBytes;
+	*max_bytes = mode->mMaxBytes;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_format7_get_packet_size( dc1394camera_t *camera, dc1394video_mode_t video_mode, uint32_t *packet_size )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), video_mode );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	*packet_size = mode->mPacketBytes;
+	return DC1394_SUCCESS;
+}
+
+//! Returns the packets of a frame of the Format7 mode \a mode.
+static uint32_t getFormat7PacketsPerFrame( const MockBus::Format7Mode *mode )
+{
+	uint64_t bytes = static_cast< uint64_t >( mode->mSize.x ) * mode->mSize.y *
+		kColorCodingBits[ mode->mColorCoding - DC1394_COLOR_CODING_MIN ] / 8;
+	return mode->mPacketBytes ? static_cast< uint32_t >( ( bytes + mode->mPacketBytes - 1 ) / mode->mPacketBytes ) : 0;
+}
+
+dc1394error_t dc1394_format7_get_packets_per_frame( dc1394camera_t *camera, dc1394video_mode_t video_mode, uint32_t *ppf )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), video_mode );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	*ppf = getFormat7PacketsPerFrame( mode );
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_format7_get_total_bytes( dc1394camera_t *camera, dc1394video_mode_t video_mode, uint64_t *total_bytes )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), video_mode );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	*total_bytes = static_cast< uint64_t >( getFormat7PacketsPerFrame( mode ) ) * mode->mPacketBytes;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_format7_get_frame_interval( dc1394camera_t *camera, dc1394video_mode_t video_mode, float *interval )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Format7Mode *mode = getFormat7Mode( getCamera( camera ), video_mode );
+	if ( mode == NULL )
+		return DC1394_INVALID_VIDEO_MODE;
+	if ( mode->mSensorInterval <= 0.0 )
+		return DC1394_FUNCTION_NOT_SUPPORTED;
+	*interval = static_cast< float >( std::max( getFormat7PacketsPerFrame( mode ) * kCycleDuration, mode->mSensorInterval ) );
+	return DC1394_SUCCESS;
+}
+
+// features
+
+dc1394error_t dc1394_feature_get_all( dc1394camera_t *camera, dc1394featureset_t *features )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( device->mBroadcast )
+		return DC1394_FAILURE;
+	*features = device->mFeatures;
+	// the current state lives in the value registers
+	for ( int i = 0; i < DC1394_FEATURE_NUM; i++ )
+	{
+		dc1394feature_info_t &info = features->feature[ i ];
+		if ( !info.available )
+			continue;
+		uint32_t reg = device->mRegisters[ getValueOffset( info.id ) ];
+		info.is_on = ( reg & 0x02000000 ) ? DC1394_ON : DC1394_OFF;
+		info.abs_control = ( reg & 0x40000000 ) ? DC1394_ON : DC1394_OFF;
+		if ( reg & 0x01000000 )
+			info.current_mode = DC1394_FEATURE_MODE_AUTO;
+		else if ( reg & 0x04000000 )
+			info.current_mode = DC1394_FEATURE_MODE_ONE_PUSH_AUTO;
+		else
+			info.current_mode = DC1394_FEATURE_MODE_MANUAL;
+		if ( info.id == DC1394_FEATURE_WHITE_BALANCE )
+		{
+			info.BU_value = ( reg >> 12 ) & 0xfff;
+			info.RV_value = reg & 0xfff;
+		}
+		else if ( info.id == DC1394_FEATURE_TEMPERATURE )
+			info.target_value = ( reg >> 12 ) & 0xfff;
+		else
+			info.value = reg & 0xfff;
+		info.abs_value = device->mAbsValues[ i ];
+	}
+	return DC1394_SUCCESS;
+}
+
+//! Replaces the bits \a mask of the value register of \a feature with \a bits. Fails for unavailable features.
+static dc1394error_t setFeatureBits( dc1394camera_t *camera, dc1394feature_t feature, uint32_t mask, uint32_t bits )
+{
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( ( feature < DC1394_FEATURE_MIN ) || ( DC1394_FEATURE_MAX < feature ) ||
+		 ( !device->mFeatures.feature[ feature - DC1394_FEATURE_MIN ].available ) )
+		return DC1394_INVALID_FEATURE;
+	// libdc1394 reads the register before writing it
+	if ( device->mBroadcast )
+		return DC1394_FAILURE;
+	uint32_t &reg = device->mRegisters[ getValueOffset( feature ) ];
+	reg = ( reg & ~mask ) | ( bits & mask );
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_feature_set_power( dc1394camera_t *camera, dc1394feature_t feature, dc1394switch_t pwr )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	return setFeatureBits( camera, feature, 0x02000000, ( pwr == DC1394_ON ) ? 0x02000000 : 0 );
+}
+
+dc1394error_t dc1394_feature_set_mode( dc1394camera_t *camera, dc1394feature_t feature, dc1394feature_mode_t mode )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	uint32_t bits = 0;
+	if ( mode == DC1394_FEATURE_MODE_AUTO )
+		bits = 0x01000000;
+	else if ( mode == DC1394_FEATURE_MODE_ONE_PUSH_AUTO )
+		bits = 0x04000000;
+	return setFeatureBits( camera, feature, 0x05000000, bits );
+}
+
+dc1394error_t dc1394_feature_set_value( dc1394camera_t *camera, dc1394feature_t feature, uint32_t value )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	if ( feature == DC1394_FEATURE_TEMPERATURE )
+		return setFeatureBits( camera, feature, 0x00fff000, value << 12 );
+	return setFeatureBits( camera, feature, 0x00000fff, value );
+}
+
+dc1394error_t dc1394_feature_whitebalance_set_value( dc1394camera_t *camera, uint32_t u_b_value, uint32_t v_r_value )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	return setFeatureBits( camera, DC1394_FEATURE_WHITE_BALANCE, 0x00ffffff,
+			( ( u_b_value & 0xfff ) << 12 ) | ( v_r_value & 0xfff ) );
+}
+
+dc1394error_t dc1394_feature_get_absolute_value( dc1394camera_t *camera, dc1394feature_t feature, float *value )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( device->mBroadcast )
+		return DC1394_FAILURE;
+	if ( !device->mFeatures.feature[ feature - DC1394_FEATURE_MIN ].absolute_capable )
+		return DC1394_FUNCTION_NOT_SUPPORTED;
+	*value = device->mAbsValues[ feature - DC1394_FEATURE_MIN ];
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_feature_set_absolute_value( dc1394camera_t *camera, dc1394feature_t feature, float value )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( !device->mFeatures.feature[ feature - DC1394_FEATURE_MIN ].absolute_capable )
+		return DC1394_FUNCTION_NOT_SUPPORTED;
+	device->mAbsValues[ feature - DC1394_FEATURE_MIN ] = value;
+	return DC1394_SUCCESS;
+}
+
+// registers and memory channels
+
+dc1394error_t dc1394_get_control_registers( dc1394camera_t *camera, uint64_t offset, uint32_t *value, uint32_t num_regs )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( device->mBroadcast )
+		return DC1394_FAILURE;
+	for ( uint32_t i = 0; i < num_regs; i++ )
+	{
+		auto it = device->mRegisters.find( offset + i * 4 );
+		value[ i ] = ( it == device->mRegisters.cend() ) ? 0 : it->second;
+	}
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_set_control_registers( dc1394camera_t *camera, uint64_t offset, const uint32_t *value, uint32_t num_regs )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	vector< MockBus::Camera * > receivers = MockBus::get().getReceivers( getCamera( camera ) );
+	for ( auto it = receivers.begin(); it != receivers.end(); ++it )
+	{
+		for ( uint32_t i = 0; i < num_regs; i++ )
+		{
+			uint64_t regOffset = offset + i * 4;
+			( *it )->mRegisters[ regOffset ] = value[ i ];
+			// the trigger registers act on the camera
+			if ( regOffset == kTriggerModeOffset )
+				( *it )->mTriggerArmed = ( value[ i ] & 0x02000000 ) != 0;
+			else if ( ( regOffset == kSoftwareTriggerOffset ) && ( value[ i ] & 0x80000000 ) && ( *it )->mTriggerArmed )
+				shoot( *it, 1 );
+		}
+	}
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_memory_save( dc1394camera_t *camera, uint32_t channel )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	if ( ( channel == 0 ) || ( static_cast< int >( channel ) > device->mMaxMemChannel ) )
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	device->mMemoryChannels[ channel ] = device->mRegisters;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_memory_load( dc1394camera_t *camera, uint32_t channel )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Camera *device = getCamera( camera );
+	auto it = device->mMemoryChannels.find( channel );
+	if ( it == device->mMemoryChannels.cend() )
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	device->mRegisters = it->second;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_memory_busy( dc1394camera_t *camera, dc1394bool_t *value )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	*value = DC1394_FALSE;
+	return DC1394_SUCCESS;
+}
+
+// isochronous resources
+
+dc1394error_t dc1394_iso_allocate_channel( dc1394camera_t *camera, uint64_t, int *channel )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	static int nextChannel = 0;
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	*channel = nextChannel++ % 64;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_iso_allocate_bandwidth( dc1394camera_t *camera, int bandwidth_units )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	getCamera( camera )->mBandwidthUnits += bandwidth_units;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_iso_release_all( dc1394camera_t *camera )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	getCamera( camera )->mBandwidthUnits = 0;
+	return DC1394_SUCCESS;
+}
+
+// capture
+
+dc1394error_t dc1394_capture_setup( dc1394camera_t *camera, uint32_t num_dma_buffers, uint32_t )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Handle *handle = MockBus::getHandle( camera );
+	MockBus::Camera *device = handle->mDevice;
+	if ( !handle->mRing.empty() )
+		return DC1394_CAPTURE_IS_RUNNING;
+
+	uint32_t width, height;
+	dc1394color_coding_t coding;
+	uint64_t bytes = getImageBytes( device, &width, &height, &coding );
+	handle->mRing.assign( num_dma_buffers, vector< uint8_t >( bytes ) );
+	handle->mFrames.assign( num_dma_buffers, dc1394video_frame_t() );
+	handle->mDequeued.assign( num_dma_buffers, false );
+	handle->mNextFrame = 0;
+	for ( uint32_t i = 0; i < num_dma_buffers; i++ )
+	{
+		dc1394video_frame_t &frame = handle->mFrames[ i ];
+		memset( &frame, 0, sizeof( frame ) );
+		frame.image = &handle->mRing[ i ][ 0 ];
+		frame.size[ 0 ] = width;
+		frame.size[ 1 ] = height;
+		frame.color_coding = coding;
+		frame.stride = static_cast< uint32_t >( bytes / height );
+		frame.video_mode = device->mVideoMode;
+		frame.image_bytes = static_cast< uint32_t >( bytes );
+		frame.total_bytes = bytes;
+		frame.allocated_image_bytes = bytes;
+		frame.packets_per_frame = getPacketsPerFrame( device );
+		frame.packet_size = frame.packets_per_frame ? static_cast< uint32_t >( ( bytes + frame.packets_per_frame - 1 ) /
+				frame.packets_per_frame ) : 0;
+		frame.camera = camera;
+		frame.id = i;
+	}
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_capture_stop( dc1394camera_t *camera )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Handle *handle = MockBus::getHandle( camera );
+	if ( handle->mRing.empty() )
+		return DC1394_CAPTURE_IS_NOT_SET;
+	handle->mRing.clear();
+	handle->mFrames.clear();
+	handle->mDequeued.clear();
+	return DC1394_SUCCESS;
+}
+
+int dc1394_capture_get_fileno( dc1394camera_t *camera )
+{
+	// no file descriptor, the capture thread polls
+	MockCall call( __func__, camera );
+	return -1;
+}
+
+dc1394error_t dc1394_capture_dequeue( dc1394camera_t *camera, dc1394capture_policy_t, dc1394video_frame_t **frame )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Handle *handle = MockBus::getHandle( camera );
+	MockBus::Camera *device = handle->mDevice;
+	if ( handle->mRing.empty() )
+		return DC1394_CAPTURE_IS_NOT_SET;
+
+	*frame = NULL;
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	bool sending = ( device->mTransmitting && ( !device->mTriggerArmed ) ) || ( device->mPendingShots > 0 );
+	if ( ( !sending ) || ( now < device->mNextFrameTime ) || handle->mDequeued[ handle->mNextFrame ] )
+		return DC1394_SUCCESS;
+
+	// the ring holds the frames sent since the last dequeue, older ones were overwritten
+	const chrono::steady_clock::duration period =
+		chrono::duration_cast< chrono::steady_clock::duration >( chrono::duration< double >( device->mFramePeriod ) );
+	while ( ( device->mPendingShots == 0 ) &&
+			( now - device->mNextFrameTime > period * static_cast< int >( handle->mFrames.size() ) ) )
+	{
+		device->mNextFrameTime += period;
+		device->mNumFrames++;
+	}
+	chrono::steady_clock::time_point frameTime = device->mNextFrameTime;
+	device->mNextFrameTime += period;
+	if ( device->mPendingShots > 0 )
+		device->mPendingShots--;
+	device->mNumFrames++;
+
+	dc1394video_frame_t *next = &handle->mFrames[ handle->mNextFrame ];
+	handle->mDequeued[ handle->mNextFrame ] = true;
+	handle->mNextFrame = ( handle->mNextFrame + 1 ) % handle->mFrames.size();
+	// every byte of a frame holds its number, so the copies can be told apart
+	memset( next->image, static_cast< int >( device->mNumFrames & 0xff ), next->image_bytes );
+	// stamped when the frame was completed, not when it is dequeued
+	next->timestamp = static_cast< uint64_t >( static_cast< int64_t >( getHostTime( frameTime ) ) + static_cast< int64_t >(
+				MockBus::random( device ) * device->mTimestampJitter * 1000000.0 ) );
+	next->frames_behind = 0;
+	*frame = next;
+	return DC1394_SUCCESS;
+}
+
+dc1394error_t dc1394_capture_enqueue( dc1394camera_t *camera, dc1394video_frame_t *frame )
+{
+	MockCall call( __func__, camera );
+	if ( call.getError() != DC1394_SUCCESS )
+		return call.getError();
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	MockBus::Handle *handle = MockBus::getHandle( camera );
+	if ( ( frame->camera != camera ) || ( frame->id >= handle->mDequeued.size() ) || ( !handle->mDequeued[ frame->id ] ) )
+		return DC1394_INVALID_ARGUMENT_VALUE;
+	handle->mDequeued[ frame->id ] = false;
+	return DC1394_SUCCESS;
+}
+
+dc1394bool_t dc1394_capture_is_frame_corrupt( dc1394camera_t *camera, dc1394video_frame_t * )
+{
+	MockCall call( __func__, camera );
+	return DC1394_FALSE;
+}
+
+// conversions
+
+dc1394error_t dc1394_convert_to_RGB8( uint8_t *src, uint8_t *dest, uint32_t width, uint32_t height, uint32_t,
+		dc1394color_coding_t source_coding, uint32_t bits )
+{
+	MockCall call( __func__ );
+	const size_t pixels = static_cast< size_t >( width ) * height;
+	switch ( source_coding )
+	{
+		case DC1394_COLOR_CODING_MONO8:
+			for ( size_t i = 0; i < pixels; i++ )
+				dest[ i * 3 ] = dest[ i * 3 + 1 ] = dest[ i * 3 + 2 ] = src[ i ];
+			return DC1394_SUCCESS;
+
+		case DC1394_COLOR_CODING_MONO16:
+			for ( size_t i = 0; i < pixels; i++ )
+				dest[ i * 3 ] = dest[ i * 3 + 1 ] = dest[ i * 3 + 2 ] =
+					static_cast< uint8_t >( ( ( src[ i * 2 ] << 8 ) | src[ i * 2 + 1 ] ) >> ( bits - 8 ) );
+			return DC1394_SUCCESS;
+
+		case DC1394_COLOR_CODING_RGB8:
+			memcpy( dest, src, pixels * 3 );
+			return DC1394_SUCCESS;
+
+		default:
+			return DC1394_FUNCTION_NOT_SUPPORTED;
+	}
+}
+
+dc1394error_t dc1394_convert_to_MONO8( uint8_t *src, uint8_t *dest, uint32_t width, uint32_t height, uint32_t,
+		dc1394color_coding_t source_coding, uint32_t bits )
+{
+	MockCall call( __func__ );
+	const size_t pixels = static_cast< size_t >( width ) * height;
+	switch ( source_coding )
+	{
+		case DC1394_COLOR_CODING_MONO8:
+			memcpy( dest, src, pixels );
+			return DC1394_SUCCESS;
+
+		case DC1394_COLOR_CODING_MONO16:
+			for ( size_t i = 0; i < pixels; i++ )
+				dest[ i ] = static_cast< uint8_t >( ( ( src[ i * 2 ] << 8 ) | src[ i * 2 + 1 ] ) >> ( bits - 8 ) );
+			return DC1394_SUCCESS;
+
+		default:
+			return DC1394_FUNCTION_NOT_SUPPORTED;
+	}
+}
+
+dc1394error_t dc1394_bayer_decoding_8bit( const uint8_t *bayer, uint8_t *rgb, uint32_t width, uint32_t height,
+		dc1394color_filter_t, dc1394bayer_method_t )
+{
+	// the mosaic is replicated to the three channels, enough to follow the data through the pipeline
+	MockCall call( __func__ );
+	const size_t pixels = static_cast< size_t >( width ) * height;
+	for ( size_t i = 0; i < pixels; i++ )
+		rgb[ i * 3 ] = rgb[ i * 3 + 1 ] = rgb[ i * 3 + 2 ] = bayer[ i ];
+	return DC1394_SUCCESS;
+}
+
+// strings
+
+const char * dc1394_error_get_string( dc1394error_t error )
+{
+	switch ( error )
+	{
+		case DC1394_SUCCESS:
+			return "Success";
+		case DC1394_FAILURE:
+			return "Generic failure";
+		case DC1394_CAMERA_NOT_INITIALIZED:
+			return "Camera not initialized";
+		case DC1394_FUNCTION_NOT_SUPPORTED:
+			return "Function not supported";
+		case DC1394_INVALID_ARGUMENT_VALUE:
+			return "Invalid argument value";
+		case DC1394_CAPTURE_IS_RUNNING:
+			return "Capture is running";
+		case DC1394_CAPTURE_IS_NOT_SET:
+			return "Capture is not set";
+		default:
+			return "Mock error";
+	}
+}
+
+const char * dc1394_feature_get_string( dc1394feature_t feature )
+{
+	static const char *names[ DC1394_FEATURE_NUM ] = {
+		"Brightness", "Exposure", "Sharpness", "White Balance", "Hue", "Saturation", "Gamma", "Shutter", "Gain", "Iris",
+		"Focus", "Temperature", "Trigger", "Trigger Delay", "White Shading", "Frame Rate", "Zoom", "Pan", "Tilt",
+		"Optical Filter", "Capture Size", "Capture Quality" };
+	if ( ( feature < DC1394_FEATURE_MIN ) || ( DC1394_FEATURE_MAX < feature ) )
+		return NULL;
+	return names[ feature - DC1394_FEATURE_MIN ];
+}
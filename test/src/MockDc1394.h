@@ -0,0 +1,222 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cinder/Cinder.h"
+#include "cinder/Vector.h"
+
+#include <dc1394/dc1394.h>
+
+namespace mndl { namespace test {
+
+/** Simulated 1394 bus behind the libdc1394 functions of MockDc1394.cpp, which the tests link instead of libdc1394.
+ *  Every call is counted, can be delayed and can be made to fail. The cameras keep their control registers, so the
+ *  feature functions and the register batches see the same state. Thread-safe.
+ */
+class MockBus
+{
+	public:
+		struct Format7Mode
+		{
+			Format7Mode() : mPresent( false ), mColorCoding( DC1394_COLOR_CODING_MONO8 ), mUnitBytes( 4 ), mMaxBytes( 4096 ),
+							mSensorInterval( 0.0 ), mPacketBytes( 0 ), mLeft( 0 ), mTop( 0 )
+			{}
+
+			bool mPresent;
+			ci::Vec2i mMaxSize;
+			ci::Vec2i mUnitSize;
+			dc1394color_coding_t mColorCoding;
+			//! PACKET_PARA_INQ, the packet size limits.
+			uint32_t mUnitBytes, mMaxBytes;
+			/** Shortest frame interval of the sensor in seconds, reported by the FRAME_INTERVAL_INQ register together with the
+			 *  transmission time of the packets. 0 leaves the register out.
+			 */
+			double mSensorInterval;
+
+			//! BYTE_PER_PACKET and the region of interest as last set.
+			uint32_t mPacketBytes;
+			ci::Vec2i mSize;
+			uint32_t mLeft, mTop;
+		};
+
+		struct Camera
+		{
+			Camera() : mGuid( 0 ), mVendorId( 0 ), mModelId( 0 ), mSwVersion( 0 ), mBModeCapable( false ), mMaxMemChannel( 0 ),
+					   mPresent( true ), mVideoMode( DC1394_VIDEO_MODE_640x480_MONO8 ),
+					   mFrameRate( DC1394_FRAMERATE_30 ), mIsoSpeed( DC1394_ISO_SPEED_400 ),
+					   mOperationMode( DC1394_OPERATION_MODE_LEGACY ), mTransmitting( false ), mTriggerArmed( false ),
+					   mPendingShots( 0 ), mBroadcast( false ), mIsoChannel( -1 ), mBandwidthUnits( 0 ),
+					   mFramePeriod( 0.005 ), mTimestampJitter( 0.0 ), mNumFrames( 0 ), mRandom( 1 )
+			{}
+
+			uint64_t mGuid;
+			std::string mModel;
+			uint32_t mVendorId, mModelId, mSwVersion;
+			bool mBModeCapable;
+			int mMaxMemChannel;
+			//! False while the camera is unplugged, its handles fail every call and it is not enumerated.
+			bool mPresent;
+
+			//! Fixed video modes, each with mFrameRates.
+			std::vector< dc1394video_mode_t > mVideoModes;
+			std::vector< dc1394framerate_t > mFrameRates;
+			Format7Mode mFormat7[ DC1394_VIDEO_MODE_FORMAT7_NUM ];
+			//! The available features and their limits, the current values live in the value registers.
+			dc1394featureset_t mFeatures;
+			float mAbsValues[ DC1394_FEATURE_NUM ];
+			//! Control registers by offset from the command registers base.
+			std::map< uint64_t, uint32_t > mRegisters;
+			std::map< uint32_t, std::map< uint64_t, uint32_t > > mMemoryChannels;
+
+			dc1394video_mode_t mVideoMode;
+			dc1394framerate_t mFrameRate;
+			dc1394speed_t mIsoSpeed;
+			dc1394operation_mode_t mOperationMode;
+			bool mTransmitting;
+			//! The camera waits for its trigger instead of sending frames while transmitting.
+			bool mTriggerArmed;
+			//! Frames left to send for the one-shot, multi-shot and software triggers.
+			uint32_t mPendingShots;
+			bool mBroadcast;
+			int mIsoChannel;
+			int mBandwidthUnits;
+
+			//! Seconds between two frames and the standard deviation of their host timestamps.
+			double mFramePeriod;
+			double mTimestampJitter;
+			std::chrono::steady_clock::time_point mNextFrameTime;
+			uint64_t mNumFrames;
+			uint32_t mRandom;
+		};
+
+		static MockBus & get();
+
+		//! Removes the cameras and the call rules. Handles of the removed cameras fail every call.
+		void reset();
+
+		//! Adds a present camera without features, modes or registers.
+		Camera & addCamera( uint64_t guid, const std::string &model );
+		//! Adds a camera with a 640x480 MONO8 and RGB8 mode, Format7 mode 0 and brightness, shutter, gain and white balance.
+		Camera & addDefaultCamera( uint64_t guid, const std::string &model );
+		//! Returns the camera of \a guid, NULL if there is none. The camera is guarded by getMutex().
+		Camera * findCamera( uint64_t guid );
+		//! Returns the guids of the cameras on the bus.
+		std::vector< uint64_t > getPresentGuids() const;
+		//! Sets whether the camera of \a guid is on the bus.
+		void setPresent( uint64_t guid, bool present );
+		//! Returns the cameras a command of \a camera reaches, every present camera while its broadcast is on.
+		std::vector< Camera * > getReceivers( Camera *camera );
+
+		//! Makes the next \a count calls of \a function fail with \a err, -1 makes every call fail.
+		void fail( const std::string &function, dc1394error_t err, int count = -1 );
+		//! Delays every call of \a function by \a seconds.
+		void setLatency( const std::string &function, double seconds );
+
+		size_t getNumCalls( const std::string &function ) const;
+		//! Returns the most calls of \a function that were running at the same time.
+		size_t getMaxConcurrentCalls( const std::string &function ) const;
+		//! Returns the number of calls with a handle after dc1394_camera_free() released it.
+		size_t getNumFreedHandleCalls() const;
+
+		std::recursive_mutex & getMutex() const { return mMutex; }
+
+		//! A camera handle returned by dc1394_camera_new(), freed handles are kept to detect their use.
+		struct Handle
+		{
+			dc1394camera_t mCamera;
+			//! NULL once reset() removed the camera.
+			Camera *mDevice;
+			std::string mModel;
+			bool mFreed;
+			//! The dma ring of the capture, empty if the capture is not set up.
+			std::vector< std::vector< uint8_t > > mRing;
+			std::vector< dc1394video_frame_t > mFrames;
+			std::vector< bool > mDequeued;
+			size_t mNextFrame;
+		};
+
+		//! Counts a call of \a function with \a camera and applies its rules. Returns the error the call fails with.
+		dc1394error_t enter( const char *function, dc1394camera_t *camera );
+		void leave( const char *function );
+
+		Handle * createHandle( Camera *camera );
+		static Handle * getHandle( dc1394camera_t *camera ) { return reinterpret_cast< Handle * >( camera ); }
+
+		//! Returns a pseudo random number of \a camera in [-1, 1], it does not allocate.
+		static double random( Camera *camera );
+
+	protected:
+		MockBus();
+
+		struct Rule
+		{
+			std::string mFunction;
+			dc1394error_t mError;
+			int mNumFailures;
+			double mLatency;
+		};
+
+		//! Counters by the address of the function name, a fixed table so counting never allocates.
+		struct Counter
+		{
+			const char *mFunction;
+			size_t mNumCalls;
+			size_t mNumRunning;
+			size_t mMaxRunning;
+		};
+		static const size_t kMaxCounters = 128;
+
+		Counter * findCounter( const char *function );
+		const Counter * findCounter( const std::string &function ) const;
+
+		std::deque< Camera > mCameras;
+		std::vector< Rule > mRules;
+		Counter mCounters[ kMaxCounters ];
+		size_t mNumCounters;
+		size_t mNumFreedHandleCalls;
+		std::vector< std::unique_ptr< Handle > > mHandles;
+
+		mutable std::recursive_mutex mMutex;
+};
+
+//! Counts a call on the mock bus for the lifetime of the object.
+class MockCall
+{
+	public:
+		MockCall( const char *function, dc1394camera_t *camera = NULL ) :
+			mFunction( function ), mError( MockBus::get().enter( function, camera ) )
+		{}
+		~MockCall() { MockBus::get().leave( mFunction ); }
+
+		//! The error the call has to fail with, DC1394_SUCCESS if it goes through.
+		dc1394error_t getError() const { return mError; }
+
+	protected:
+		const char *mFunction;
+		dc1394error_t mError;
+};
+
+} } // namespace mndl::test
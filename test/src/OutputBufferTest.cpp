@@ -0,0 +1,77 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Capture1394.h"
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+TEST( testOutputBufferReleasedAfterDelivery )
+{
+	MockBus::get().addDefaultCamera( 1, "Mock" );
+	Capture1394Ref capture = Capture1394::create( Capture1394::Options().videoMode( Capture1394::VideoMode( ci::Vec2i( 640, 480 ),
+					DC1394_VIDEO_MODE_640x480_MONO8, DC1394_COLOR_CODING_MONO8, DC1394_FRAMERATE_30 ) ),
+			Capture1394::getDevices( true ).at( 0 ) );
+
+	// two buffers, each marked as owned by the capture between acquire and release
+	vector< uint8_t > buffers[ 2 ] = { vector< uint8_t >( 640 * 480 ), vector< uint8_t >( 640 * 480 ) };
+	bool owned[ 2 ] = { false, false };
+	mutex ownedMutex;
+	size_t next = 0;
+	capture->setOutputBufferProvider( [ & ]( int32_t, int32_t, int32_t * ) -> uint8_t *
+			{
+				lock_guard< mutex > lock( ownedMutex );
+				size_t id = next++ % 2;
+				owned[ id ] = true;
+				return &buffers[ id ][ 0 ];
+			},
+			[ & ]( uint8_t *data, bool )
+			{
+				lock_guard< mutex > lock( ownedMutex );
+				owned[ ( data == &buffers[ 0 ][ 0 ] ) ? 0 : 1 ] = false;
+			}, DC1394_COLOR_CODING_MONO8 );
+
+	atomic< int > numFrames( 0 );
+	atomic< int > numReleased( 0 );
+	capture->setFrameCallback( [ & ]( const Capture1394::FrameInfo &frameInfo )
+			{
+				lock_guard< mutex > lock( ownedMutex );
+				if ( !owned[ ( frameInfo.mData == &buffers[ 0 ][ 0 ] ) ? 0 : 1 ] )
+					numReleased++;
+				numFrames++;
+			} );
+
+	capture->start();
+	chrono::steady_clock::time_point end = chrono::steady_clock::now() + chrono::seconds( 10 );
+	while ( ( numFrames < 10 ) && ( chrono::steady_clock::now() < end ) )
+		this_thread::sleep_for( chrono::milliseconds( 5 ) );
+	capture->stop();
+
+	CHECK( numFrames >= 10 );
+	// the frame callback never sees a buffer given back to the provider
+	CHECK_EQUAL( 0, int( numReleased ) );
+}
@@ -0,0 +1,94 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <vector>
+
+#include "Capture1394.h"
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+//! Bus time of each probing call.
+static const double kLatency = 0.02;
+
+//! Adds cameras of the \a guids with slow capability registers.
+static void addSlowCameras( const vector< uint64_t > &guids )
+{
+	for ( auto it = guids.cbegin(); it != guids.cend(); ++it )
+		MockBus::get().addDefaultCamera( *it, "Mock" );
+	MockBus::get().setLatency( "dc1394_camera_new", kLatency );
+	MockBus::get().setLatency( "dc1394_video_get_supported_modes", kLatency );
+	MockBus::get().setLatency( "dc1394_format7_get_modeset", kLatency );
+	MockBus::get().setLatency( "dc1394_feature_get_all", kLatency );
+}
+
+TEST( testConcurrentProbe )
+{
+	const uint64_t guids[] = { 4, 2, 3, 1 };
+	addSlowCameras( vector< uint64_t >( guids, guids + 4 ) );
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	const vector< Capture1394::DeviceRef > &devices = Capture1394::getDevices( true );
+	const double elapsed = chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+
+	// the devices are in GUID order, whichever probe finished first
+	CHECK_EQUAL( size_t( 4 ), devices.size() );
+	for ( size_t i = 0; i < devices.size(); i++ )
+		CHECK_EQUAL( uint64_t( i + 1 ), uint64_t( devices[ i ]->getUniqueId() ) );
+
+	// the cameras are created one by one, they share the context, then probed together
+	CHECK_EQUAL( size_t( 1 ), MockBus::get().getMaxConcurrentCalls( "dc1394_camera_new" ) );
+	CHECK( MockBus::get().getMaxConcurrentCalls( "dc1394_feature_get_all" ) > 1 );
+	CHECK( MockBus::get().getMaxConcurrentCalls( "dc1394_video_get_supported_modes" ) > 1 );
+
+	// 4 creations and 3 probing calls a camera, 0.32 s one after the other
+	const double serial = 4 * 4 * kLatency;
+	CHECK( elapsed >= 4 * kLatency + 3 * kLatency );
+	CHECK( elapsed < 0.75 * serial );
+
+	for ( auto it = devices.cbegin(); it != devices.cend(); ++it )
+		CHECK( !( *it )->getSupportedVideoModes().empty() );
+	CHECK_EQUAL( size_t( 4 ), MockBus::get().getNumCalls( "dc1394_video_get_supported_modes" ) );
+}
+
+TEST( testProbeFailure )
+{
+	// the failure of one probe is thrown on the calling thread once the others are done
+	const uint64_t guids[] = { 1, 2, 3 };
+	addSlowCameras( vector< uint64_t >( guids, guids + 3 ) );
+	MockBus::get().fail( "dc1394_format7_get_modeset", DC1394_FAILURE, 1 );
+
+	bool thrown = false;
+	try
+	{
+		Capture1394::getDevices( true );
+	}
+	catch ( const Capture1394Exc & )
+	{
+		thrown = true;
+	}
+	CHECK( thrown );
+	CHECK_EQUAL( size_t( 3 ), MockBus::get().getNumCalls( "dc1394_feature_get_all" ) + 1 );
+
+	// the next enumeration succeeds
+	CHECK_EQUAL( size_t( 3 ), Capture1394::getDevices( true ).size() );
+}
@@ -0,0 +1,138 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Capture1394.h"
+#include "CaptureGroup.h"
+#include "FeatureControl.h"
+#include "RegisterBatch.h"
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+static uint32_t getValueRegister( uint64_t guid, dc1394feature_t feature )
+{
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	return MockBus::get().findCamera( guid )->mRegisters[ RegisterBatch::getFeatureValueOffset( feature ) ];
+}
+
+TEST( testReconnectUnderLoad )
+{
+	for ( uint64_t guid = 1; guid <= 2; guid++ )
+		MockBus::get().addDefaultCamera( guid, "Mock" );
+	const vector< Capture1394::DeviceRef > devices = Capture1394::getDevices( true );
+	CHECK_EQUAL( size_t( 2 ), devices.size() );
+
+	vector< Capture1394Ref > captures;
+	vector< shared_ptr< atomic< uint64_t > > > numFrames;
+	for ( size_t i = 0; i < devices.size(); i++ )
+	{
+		captures.push_back( Capture1394::create( Capture1394::Options().reconnectInterval( 0.02 ).reconnectTimeout( 5.0 ).videoMode(
+						Capture1394::VideoMode( ci::Vec2i( 640, 480 ), DC1394_VIDEO_MODE_640x480_MONO8, DC1394_COLOR_CODING_MONO8,
+							DC1394_FRAMERATE_30 ) ), devices[ i ] ) );
+		shared_ptr< atomic< uint64_t > > counter( new atomic< uint64_t >( 0 ) );
+		captures.back()->setFrameCallback( [ counter ]( const Capture1394::FrameInfo & ) { ( *counter )++; } );
+		numFrames.push_back( counter );
+	}
+
+	mutex statesMutex;
+	vector< Capture1394::State > states;
+	captures[ 0 ]->setStateChangedCallback( [ & ]( Capture1394::State state )
+			{
+				lock_guard< mutex > lock( statesMutex );
+				states.push_back( state );
+			} );
+
+	// the group is only used for its broadcast commands, the captures deliver their frames themselves
+	CaptureGroupRef group = CaptureGroup::create( captures );
+	FeatureControlRef control = FeatureControl::create( devices[ 0 ], 0.0 );
+	dc1394featureset_t featureSet;
+	CHECK_EQUAL( DC1394_SUCCESS, dc1394_feature_get_all( devices[ 0 ]->getNative(), &featureSet ) );
+	control->setFeatureSet( featureSet );
+
+	for ( auto it = captures.begin(); it != captures.end(); ++it )
+		( *it )->start();
+
+	// the application keeps changing features of the cameras while the first one is replugged
+	atomic< bool > quit( false );
+	thread writer( [ & ]()
+			{
+				for ( uint32_t i = 0; !quit; i++ )
+				{
+					control->setValue( DC1394_FEATURE_BRIGHTNESS, i % 256 );
+					try
+					{
+						group->setFeatureValue( DC1394_FEATURE_GAIN, i % 680 );
+					}
+					catch ( const Capture1394Exc & )
+					{}
+					this_thread::sleep_for( chrono::milliseconds( 1 ) );
+				}
+			} );
+
+	CHECK( waitFor( [ & ]() { return *numFrames[ 0 ] >= 20; }, 2.0 ) );
+	// the camera comes back flaky, it cannot be opened twice and its first dma ring fails
+	MockBus::get().setPresent( 1, false );
+	this_thread::sleep_for( chrono::milliseconds( 200 ) );
+	const uint64_t otherFrames = *numFrames[ 1 ];
+	MockBus::get().fail( "dc1394_camera_new", DC1394_FAILURE, 2 );
+	MockBus::get().fail( "dc1394_capture_setup", DC1394_FAILURE, 1 );
+	MockBus::get().setPresent( 1, true );
+	const uint64_t lostFrames = *numFrames[ 0 ];
+
+	CHECK( waitFor( [ & ]() { return ( captures[ 0 ]->getState() == Capture1394::STATE_CAPTURING ) &&
+				( *numFrames[ 0 ] >= lostFrames + 20 ); }, 5.0 ) );
+	quit = true;
+	writer.join();
+
+	const Capture1394::Stats stats = captures[ 0 ]->getStats();
+	CHECK_EQUAL( 1u, stats.mNumReconnects );
+	CHECK( stats.mLastReconnectLatency > 0.2 );
+	CHECK( MockBus::get().getNumCalls( "dc1394_camera_new" ) >= 2 + 3 );
+	// the other camera kept capturing
+	CHECK_EQUAL( Capture1394::STATE_CAPTURING, captures[ 1 ]->getState() );
+	CHECK( *numFrames[ 1 ] > otherFrames );
+	{
+		lock_guard< mutex > lock( statesMutex );
+		CHECK( ( states.size() >= 4 ) && ( states[ states.size() - 3 ] == Capture1394::STATE_LOST ) &&
+			   ( states[ states.size() - 2 ] == Capture1394::STATE_RECONNECTING ) &&
+			   ( states.back() == Capture1394::STATE_CAPTURING ) );
+	}
+
+	// the controls reach the new handle
+	control->setValue( DC1394_FEATURE_BRIGHTNESS, 42 );
+	CHECK( control->flush() );
+	CHECK_EQUAL( FeatureControl::STATUS_DONE, control->getStatus( DC1394_FEATURE_BRIGHTNESS ) );
+	CHECK_EQUAL( 42u, getValueRegister( 1, DC1394_FEATURE_BRIGHTNESS ) & 0xfff );
+	CHECK( group->setFeatureValue( DC1394_FEATURE_GAIN, 123 ) );
+	CHECK_EQUAL( 123u, getValueRegister( 1, DC1394_FEATURE_GAIN ) & 0xfff );
+	CHECK_EQUAL( 123u, getValueRegister( 2, DC1394_FEATURE_GAIN ) & 0xfff );
+
+	for ( auto it = captures.begin(); it != captures.end(); ++it )
+		( *it )->stop();
+	// no thread used a handle the reconnect had freed
+	CHECK_EQUAL( size_t( 0 ), MockBus::get().getNumFreedHandleCalls() );
+}
@@ -0,0 +1,155 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+
+#include "RegisterBatch.h"
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+//! Simulated round-trip of a block transaction in seconds.
+static const double kLatency = 0.01;
+
+static dc1394camera_t * createCamera()
+{
+	MockBus &bus = MockBus::get();
+	MockBus::Camera &camera = bus.addCamera( 1, "Mock" );
+	for ( uint64_t offset = 0x800; offset < 0x900; offset += 4 )
+		camera.mRegisters[ offset ] = 0x80000000 | static_cast< uint32_t >( offset );
+	bus.setLatency( "dc1394_get_control_registers", kLatency );
+	bus.setLatency( "dc1394_set_control_registers", kLatency );
+	dc1394camera_t *handle = dc1394_camera_new( NULL, 1 );
+	CHECK( handle != NULL );
+	return handle;
+}
+
+static uint32_t getRegister( uint64_t offset )
+{
+	lock_guard< recursive_mutex > lock( MockBus::get().getMutex() );
+	return MockBus::get().findCamera( 1 )->mRegisters[ offset ];
+}
+
+//! Returns the seconds \a batch takes to execute.
+static double execute( RegisterBatch *batch, dc1394error_t expected = DC1394_SUCCESS )
+{
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	CHECK_EQUAL( expected, batch->execute() );
+	return chrono::duration< double >( chrono::steady_clock::now() - start ).count();
+}
+
+TEST( testContiguousRun )
+{
+	RegisterBatch batch( createCamera() );
+	for ( uint64_t offset = 0x800; offset < 0x820; offset += 4 )
+		batch.read( offset );
+	double seconds = execute( &batch );
+
+	// eight registers in one round-trip instead of eight
+	CHECK_EQUAL( 1u, batch.getNumTransactions() );
+	CHECK_EQUAL( 1u, MockBus::get().getNumCalls( "dc1394_get_control_registers" ) );
+	CHECK( seconds < 4 * kLatency );
+	for ( uint64_t offset = 0x800; offset < 0x820; offset += 4 )
+	{
+		uint32_t value = 0;
+		CHECK( batch.getValue( offset, &value ) );
+		CHECK_EQUAL( 0x80000000 | offset, value );
+	}
+
+	// the writes of a run share a block as well, a later write to the same register replaces the earlier one
+	batch.write( 0x804, 1 );
+	batch.write( 0x800, 2 );
+	batch.write( 0x808, 3 );
+	batch.write( 0x804, 4 );
+	execute( &batch );
+	CHECK_EQUAL( 1u, batch.getNumTransactions() );
+	CHECK_EQUAL( 2u, getRegister( 0x800 ) );
+	CHECK_EQUAL( 4u, getRegister( 0x804 ) );
+	CHECK_EQUAL( 3u, getRegister( 0x808 ) );
+}
+
+TEST( testRunWithGaps )
+{
+	RegisterBatch batch( createCamera() );
+	// three runs: 0x800-0x808, 0x810, 0x880-0x884
+	const uint64_t offsets[] = { 0x884, 0x800, 0x810, 0x804, 0x880, 0x808 };
+	for ( size_t i = 0; i < sizeof( offsets ) / sizeof( offsets[ 0 ] ); i++ )
+		batch.read( offsets[ i ] );
+	double seconds = execute( &batch );
+	CHECK_EQUAL( 3u, batch.getNumTransactions() );
+	CHECK_EQUAL( 3u, MockBus::get().getNumCalls( "dc1394_get_control_registers" ) );
+	CHECK( seconds >= 3 * kLatency );
+	CHECK( seconds < 6 * kLatency );
+
+	uint32_t value = 0;
+	for ( size_t i = 0; i < sizeof( offsets ) / sizeof( offsets[ 0 ] ); i++ )
+	{
+		CHECK( batch.getValue( offsets[ i ], &value ) );
+		CHECK_EQUAL( 0x80000000 | offsets[ i ], value );
+	}
+	// the registers in the gaps were not read
+	CHECK( !batch.getValue( 0x80c, &value ) );
+
+	// a read and a write of the same register are separate blocks, the write goes first
+	batch.write( 0x800, 5 );
+	batch.write( 0x808, 6 );
+	batch.read( 0x808 );
+	execute( &batch );
+	CHECK_EQUAL( 3u, batch.getNumTransactions() );
+	CHECK( batch.getValue( 0x808, &value ) );
+	CHECK_EQUAL( 6u, value );
+}
+
+TEST( testFailedBlock )
+{
+	RegisterBatch batch( createCamera() );
+	MockBus::get().fail( "dc1394_set_control_registers", DC1394_FAILURE, 1 );
+	MockBus::get().fail( "dc1394_get_control_registers", DC1394_CAMERA_NOT_INITIALIZED, 1 );
+
+	// the first block of each queue fails, the others still go through
+	batch.write( 0x800, 1 );
+	batch.write( 0x804, 2 );
+	batch.write( 0x820, 3 );
+	batch.read( 0x840 );
+	batch.read( 0x860 );
+	batch.read( 0x864 );
+	execute( &batch, DC1394_FAILURE );
+	CHECK_EQUAL( 4u, batch.getNumTransactions() );
+
+	CHECK_EQUAL( DC1394_FAILURE, batch.getError( 0x800 ) );
+	CHECK_EQUAL( DC1394_FAILURE, batch.getError( 0x804 ) );
+	CHECK_EQUAL( 0x80000800u, getRegister( 0x800 ) );
+	CHECK_EQUAL( DC1394_SUCCESS, batch.getError( 0x820 ) );
+	CHECK_EQUAL( 3u, getRegister( 0x820 ) );
+
+	uint32_t value = 0;
+	CHECK_EQUAL( DC1394_CAMERA_NOT_INITIALIZED, batch.getError( 0x840 ) );
+	CHECK( !batch.getValue( 0x840, &value ) );
+	CHECK_EQUAL( DC1394_SUCCESS, batch.getError( 0x864 ) );
+	CHECK( batch.getValue( 0x864, &value ) );
+	CHECK_EQUAL( 0x80000864u, value );
+
+	// the errors belong to the last execute()
+	batch.read( 0x840 );
+	execute( &batch );
+	CHECK_EQUAL( DC1394_SUCCESS, batch.getError( 0x800 ) );
+	CHECK( batch.getValue( 0x840, &value ) );
+}
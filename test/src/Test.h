@@ -0,0 +1,105 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace mndl { namespace test {
+
+//! Thrown by the checks, fails the running test.
+struct Failure
+{
+	Failure( const std::string &message ) : mMessage( message ) {}
+
+	std::string mMessage;
+};
+
+typedef void ( *TestFn )();
+
+struct TestCase
+{
+	const char *mName;
+	TestFn mFn;
+};
+
+//! Returns the tests registered by TEST() in the order of their definition within a file.
+std::vector< TestCase > & getTests();
+
+struct Registrar
+{
+	Registrar( const char *name, TestFn fn )
+	{
+		TestCase testCase = { name, fn };
+		getTests().push_back( testCase );
+	}
+};
+
+inline void fail( const char *file, int line, const std::string &message )
+{
+	std::stringstream ss;
+	ss << file << ":" << line << ": " << message;
+	throw Failure( ss.str() );
+}
+
+//! Polls \a condition until it holds or \a timeout seconds pass, returns whether it holds.
+template< typename Condition >
+bool waitFor( Condition condition, double timeout )
+{
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() +
+		std::chrono::duration_cast< std::chrono::steady_clock::duration >( std::chrono::duration< double >( timeout ) );
+	while ( ( !condition() ) && ( std::chrono::steady_clock::now() < end ) )
+		std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+	return condition();
+}
+
+} } // namespace mndl::test
+
+#define TEST( name ) \
+	static void name(); \
+	static ::mndl::test::Registrar name##Registrar( #name, name ); \
+	static void name()
+
+#define CHECK( condition ) \
+	do { if ( !( condition ) ) ::mndl::test::fail( __FILE__, __LINE__, "CHECK( " #condition " )" ); } while ( 0 )
+
+#define CHECK_EQUAL( expected, actual ) \
+	do \
+	{ \
+		if ( !( ( expected ) == ( actual ) ) ) \
+		{ \
+			std::stringstream ss; \
+			ss << "CHECK_EQUAL( " #expected ", " #actual " ): " << ( expected ) << " != " << ( actual ); \
+			::mndl::test::fail( __FILE__, __LINE__, ss.str() ); \
+		} \
+	} while ( 0 )
+
+#define CHECK_CLOSE( expected, actual, tolerance ) \
+	do \
+	{ \
+		if ( !( std::fabs( ( expected ) - ( actual ) ) <= ( tolerance ) ) ) \
+		{ \
+			std::stringstream ss; \
+			ss << "CHECK_CLOSE( " #expected ", " #actual " ): " << ( expected ) << " != " << ( actual ); \
+			::mndl::test::fail( __FILE__, __LINE__, ss.str() ); \
+		} \
+	} while ( 0 )
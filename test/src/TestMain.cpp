@@ -0,0 +1,74 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include "MockDc1394.h"
+#include "Test.h"
+
+using namespace std;
+
+namespace mndl { namespace test {
+
+vector< TestCase > & getTests()
+{
+	static vector< TestCase > tests;
+	return tests;
+}
+
+} } // namespace mndl::test
+
+//! Runs every test or the ones named on the command line, returns the number of failures.
+int main( int argc, char **argv )
+{
+	using namespace mndl::test;
+
+	int numRun = 0, numFailed = 0;
+	const vector< TestCase > &tests = getTests();
+	for ( auto it = tests.cbegin(); it != tests.cend(); ++it )
+	{
+		bool selected = ( argc < 2 );
+		for ( int i = 1; i < argc; i++ )
+			selected = selected || ( strcmp( argv[ i ], it->mName ) == 0 );
+		if ( !selected )
+			continue;
+
+		// every test starts with an empty bus
+		MockBus::get().reset();
+		numRun++;
+		try
+		{
+			it->mFn();
+			cout << "PASS " << it->mName << endl;
+		}
+		catch ( const Failure &failure )
+		{
+			numFailed++;
+			cout << "FAIL " << it->mName << ": " << failure.mMessage << endl;
+		}
+		catch ( const exception &exc )
+		{
+			numFailed++;
+			cout << "FAIL " << it->mName << ": unexpected exception: " << exc.what() << endl;
+		}
+	}
+
+	cout << numRun - numFailed << " of " << numRun << " tests passed" << endl;
+	return numFailed;
+}
@@ -0,0 +1,140 @@
+/*
+ Copyright (C) 2013 Gabor Papp
+
+ This program is free software; you can redistribute it and/or modify
+ it under the terms of the GNU Lesser General Public License as published
+ by the Free Software Foundation; either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ GNU Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public License
+ along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+
+#include "Capture1394.h"
+#include "VideoModeSolver.h"
+
+#include "Test.h"
+
+using namespace std;
+using namespace mndl;
+using namespace mndl::test;
+
+//! Modes of a camera with fixed 640x480 and 1024x768 modes and two 1280x960 Format7 modes.
+static vector< Capture1394::VideoMode > createVideoModes()
+{
+	vector< Capture1394::VideoMode > modes;
+	modes.push_back( Capture1394::VideoMode( ci::Vec2i( 640, 480 ), DC1394_VIDEO_MODE_640x480_MONO8, DC1394_COLOR_CODING_MONO8, DC1394_FRAMERATE_30 ) );
+	modes.push_back( Capture1394::VideoMode( ci::Vec2i( 640, 480 ), DC1394_VIDEO_MODE_640x480_RGB8, DC1394_COLOR_CODING_RGB8, DC1394_FRAMERATE_30 ) );
+	modes.push_back( Capture1394::VideoMode( ci::Vec2i( 640, 480 ), DC1394_VIDEO_MODE_640x480_YUV422, DC1394_COLOR_CODING_YUV422, DC1394_FRAMERATE_30 ) );
+	modes.push_back( Capture1394::VideoMode( ci::Vec2i( 640, 480 ), DC1394_VIDEO_MODE_640x480_MONO8, DC1394_COLOR_CODING_MONO8, DC1394_FRAMERATE_15 ) );
+	modes.push_back( Capture1394::VideoMode( ci::Vec2i( 1024, 768 ), DC1394_VIDEO_MODE_1024x768_MONO8, DC1394_COLOR_CODING_MONO8, DC1394_FRAMERATE_15 ) );
+	modes.push_back( Capture1394::VideoMode( ci::Vec2i( 1280, 960 ), DC1394_VIDEO_MODE_FORMAT7_0, DC1394_COLOR_CODING_MONO8 ) );
+	modes.push_back( Capture1394::VideoMode( ci::Vec2i( 1280, 960 ), DC1394_VIDEO_MODE_FORMAT7_1, DC1394_COLOR_CODING_RAW8 ) );
+	return modes;
+}
+
+static vector< Capture1394::Device::Format7Info > createFormat7Info()
+{
+	vector< Capture1394::Device::Format7Info > info;
+	for ( int i = 0; i < 2; i++ )
+	{
+		Capture1394::Device::Format7Info mode;
+		mode.mVideoMode = static_cast< dc1394video_mode_t >( DC1394_VIDEO_MODE_FORMAT7_0 + i );
+		mode.mMaxSize = ci::Vec2i( 1280, 960 );
+		mode.mUnitSize = ci::Vec2i( 8, 2 );
+		mode.mUnitPosition = ci::Vec2i( 8, 2 );
+		mode.mUnitBytes = 8;
+		mode.mMaxBytes = 4096;
+		info.push_back( mode );
+	}
+	return info;
+}
+
+//! Returns the indices of the ranked modes in createVideoModes().
+static vector< int > getOrder( const vector< VideoModeSolver::Candidate > &candidates )
+{
+	vector< Capture1394::VideoMode > modes = createVideoModes();
+	vector< int > order;
+	for ( auto it = candidates.cbegin(); it != candidates.cend(); ++it )
+	{
+		for ( size_t i = 0; i < modes.size(); i++ )
+		{
+			if ( ( modes[ i ].getVideoMode() == it->mVideoMode.getVideoMode() ) &&
+				 ( modes[ i ].getFrameRate() == it->mVideoMode.getFrameRate() ) )
+				order.push_back( static_cast< int >( i ) );
+		}
+	}
+	return order;
+}
+
+TEST( testRankThroughput )
+{
+	// the Format7 modes send 1228800 byte frames in 300 packets at 26.7 fps, the 640x480 modes at 30 fps tie,
+	// the cheaper conversion first, the coding order of the modes is kept between equal costs
+	vector< VideoModeSolver::Candidate > candidates = VideoModeSolver::rank( createVideoModes(), createFormat7Info(),
+			Capture1394::VideoModeConstraints() );
+	const int expected[] = { 5, 6, 4, 0, 1, 2, 3 };
+	CHECK( getOrder( candidates ) == vector< int >( expected, expected + 7 ) );
+	CHECK_CLOSE( 8000.f / 300.f, candidates[ 0 ].mFrameRate, 1e-3f );
+	CHECK_CLOSE( 1.2288 * 8000.0 / 300.0, candidates[ 0 ].mThroughput, 1e-3 );
+	CHECK_CLOSE( candidates[ 0 ].mThroughput * 0.5 / 1000.0, candidates[ 0 ].mCpuLoad, 1e-9 );
+	CHECK_EQUAL( size_t( 0 ), candidates[ 0 ].mPreference );
+}
+
+TEST( testRankPreferredCodings )
+{
+	Capture1394::VideoModeConstraints constraints;
+	constraints.mPreferredCodings.push_back( DC1394_COLOR_CODING_RAW8 );
+	constraints.mPreferredCodings.push_back( DC1394_COLOR_CODING_YUV422 );
+	vector< VideoModeSolver::Candidate > candidates = VideoModeSolver::rank( createVideoModes(), createFormat7Info(), constraints );
+
+	// the preference decides between equal throughputs only
+	const int expected[] = { 6, 5, 4, 2, 0, 1, 3 };
+	CHECK( getOrder( candidates ) == vector< int >( expected, expected + 7 ) );
+	CHECK_EQUAL( size_t( 0 ), candidates[ 0 ].mPreference );
+	CHECK_EQUAL( size_t( 2 ), candidates[ 1 ].mPreference );
+}
+
+TEST( testRankMinimumResolutionAndFrameRate )
+{
+	Capture1394::VideoModeConstraints constraints;
+	constraints.mMinResolution = ci::Vec2i( 801, 599 );
+	vector< VideoModeSolver::Candidate > candidates = VideoModeSolver::rank( createVideoModes(), createFormat7Info(), constraints );
+
+	// the Format7 modes are cropped to the units, 808x600 in 119 packets, faster than the 1024x768 mode
+	const int expected[] = { 5, 6, 4 };
+	CHECK( getOrder( candidates ) == vector< int >( expected, expected + 3 ) );
+	CHECK( candidates[ 0 ].mVideoMode.getResolution() == ci::Vec2i( 808, 600 ) );
+	CHECK_CLOSE( 8000.f / 119.f, candidates[ 0 ].mFrameRate, 1e-3f );
+	CHECK( candidates[ 2 ].mVideoMode.getResolution() == ci::Vec2i( 1024, 768 ) );
+
+	constraints.mMinFrameRate = 20.f;
+	candidates = VideoModeSolver::rank( createVideoModes(), createFormat7Info(), constraints );
+	CHECK( getOrder( candidates ) == vector< int >( expected, expected + 2 ) );
+
+	constraints.mMinResolution = ci::Vec2i( 2000, 2000 );
+	CHECK( VideoModeSolver::rank( createVideoModes(), createFormat7Info(), constraints ).empty() );
+}
+
+TEST( testRankCpuBudget )
+{
+	// 1% of a core, the Format7 modes are slowed down to fit, the fixed YUV422 mode does not fit
+	Capture1394::VideoModeConstraints constraints;
+	constraints.mCpuBudget = 0.01;
+	vector< VideoModeSolver::Candidate > candidates = VideoModeSolver::rank( createVideoModes(), createFormat7Info(), constraints );
+
+	const int expected[] = { 5, 4, 0, 1, 3, 6 };
+	CHECK( getOrder( candidates ) == vector< int >( expected, expected + 6 ) );
+	for ( auto it = candidates.cbegin(); it != candidates.cend(); ++it )
+		CHECK( it->mCpuLoad <= 0.01 * ( 1.0 + 1e-6 ) );
+	CHECK_CLOSE( 0.01 * 1000.0 / ( 1.2288 * 0.5 ), candidates[ 0 ].mFrameRate, 1e-3 );
+	CHECK_CLOSE( candidates[ 0 ].mFrameRate, candidates[ 0 ].mVideoMode.getTargetFrameRate(), 1e-6 );
+	CHECK_CLOSE( 0.01 * 1000.0 / ( 1.2288 * 3.0 ), candidates[ 5 ].mFrameRate, 1e-3 );
+}